@@ -0,0 +1,200 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Netlist.h"
+#include "CircuitSolver.h"
+#include "NetlistGenerator.h"
+#include "helpers.h"
+
+using namespace amcircuit;
+
+static const char* const default_sizes = "10,30,100,300,1000,10000,100000,1000000";
+static const int default_steps = 20;
+// The system is stored and solved densely, larger sizes are reported as skipped
+static const int default_max_unknowns = 1000;
+
+struct BenchOptions {
+  std::vector<int> sizes;
+  std::vector<std::string> circuits;
+  int steps;
+  int max_unknowns;
+  std::string label;
+  std::string output_file_name;
+};
+
+void show_usage(std::string program_name) {
+  std::cout << "usage: " << program_name << " [--sizes n,...] "
+            << "[--circuits name,...] [--steps n] [--max-unknowns n] "
+            << "[--label text] [-o results_file]" << std::endl
+            << "circuits:";
+  std::vector<std::string> circuits = NetlistGenerator::get_circuits();
+  for (size_t i = 0; i < circuits.size(); ++i) {
+    std::cout << " " << circuits[i];
+  }
+  std::cout << std::endl;
+}
+
+std::vector<std::string> split_list(const std::string& list) {
+  std::vector<std::string> items;
+  std::stringstream list_stream(list);
+  std::string item;
+  while (std::getline(list_stream, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+std::vector<int> parse_sizes(const std::string& list) {
+  std::vector<std::string> items = split_list(list);
+  std::vector<int> sizes;
+  for (size_t i = 0; i < items.size(); ++i) {
+    sizes.push_back(atoi(items[i].c_str()));
+  }
+  return sizes;
+}
+
+bool parse_options(int argc, char const *argv[], BenchOptions& options) {
+  options.sizes = parse_sizes(default_sizes);
+  options.circuits = NetlistGenerator::get_circuits();
+  options.steps = default_steps;
+  options.max_unknowns = default_max_unknowns;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--sizes") {
+      options.sizes = parse_sizes(value);
+    } else if (arg == "--circuits") {
+      options.circuits = split_list(value);
+    } else if (arg == "--steps") {
+      options.steps = atoi(value.c_str());
+    } else if (arg == "--max-unknowns") {
+      options.max_unknowns = atoi(value.c_str());
+    } else if (arg == "--label") {
+      options.label = value;
+    } else if (arg == "-o") {
+      options.output_file_name = value;
+    } else {
+      return false;
+    }
+  }
+  return !options.sizes.empty() && !options.circuits.empty() &&
+         options.steps > 0;
+}
+
+std::string json_string(const std::string& str) {
+  std::string escaped = "\"";
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] == '"' || str[i] == '\\') {
+      escaped += '\\';
+    }
+    escaped += str[i];
+  }
+  return escaped + "\"";
+}
+
+// Every result is a JSON object on its own line, so that results from many
+// runs may be appended to the same file and compared across commits
+void run_benchmark(const BenchOptions& options,
+                   const NetlistGenerator& generator, int target_unknowns,
+                   std::ostream& results) {
+  results << "{\"label\": " << json_string(options.label)
+          << ", \"circuit\": " << json_string(generator.get_circuit())
+          << ", \"target_unknowns\": " << target_unknowns
+          << ", \"unknowns\": " << generator.get_num_unknowns()
+          << ", \"elements\": " << generator.get_num_elements()
+          << ", \"steps\": " << options.steps;
+
+  if (generator.get_num_unknowns() > options.max_unknowns) {
+    results << ", \"skipped\": " << json_string("dense system too large")
+            << "}" << std::endl;
+    return;
+  }
+
+  const std::string base_name = "bench_" + generator.get_circuit() + "_" +
+                                to_str(target_unknowns);
+  const std::string netlist_file_name = base_name + ".net";
+  const std::string output_file_name = base_name + ".tab";
+  generator.write_to_file(netlist_file_name);
+
+  double parse_s = 0;
+  double solve_s = 0;
+  double output_s = 0;
+  try {
+    double start = get_wall_time_s();
+    Netlist netlist(netlist_file_name);
+    parse_s = get_wall_time_s() - start;
+
+    start = get_wall_time_s();
+    CircuitSolver solver(&netlist);
+    solve_s = get_wall_time_s() - start;
+
+    start = get_wall_time_s();
+    solver.write_to_file(output_file_name);
+    output_s = get_wall_time_s() - start;
+
+    const SolverStats stats = solver.get_stats();
+    results << ", \"nonzeros\": " << stats.num_nonzeros
+            << ", \"nr_iterations\": " << stats.num_nr_iterations
+            << ", \"nr_retries\": " << stats.num_retries
+            << ", \"parse_s\": " << parse_s
+            << ", \"assembly_s\": " << stats.assembly_s
+            << ", \"factorization_s\": " << stats.factorization_s
+            << ", \"newton_s\": "
+            << stats.newton_s - stats.assembly_s - stats.factorization_s
+            << ", \"solve_s\": " << solve_s
+            << ", \"output_s\": " << output_s
+            << ", \"memory_kb\": " << stats.peak_memory_kb;
+  } catch (const std::exception& e) {
+    results << ", \"error\": " << json_string(e.what());
+  }
+  results << "}" << std::endl;
+
+  std::remove(netlist_file_name.c_str());
+  std::remove(output_file_name.c_str());
+}
+
+int main(int argc, char const *argv[]) {
+  BenchOptions options;
+  if (!parse_options(argc, argv, options)) {
+    show_usage(argv[0]);
+    return 1;
+  }
+
+  std::ofstream output_file;
+  if (!options.output_file_name.empty()) {
+    output_file.open(options.output_file_name.c_str(), std::ios::app);
+    if (!output_file) {
+      std::cerr << "Could not open " << options.output_file_name << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& results = options.output_file_name.empty() ? std::cout
+                                                           : output_file;
+  results.precision(6);
+
+  try {
+    for (size_t i = 0; i < options.circuits.size(); ++i) {
+      for (size_t j = 0; j < options.sizes.size(); ++j) {
+        NetlistGenerator generator(options.circuits[i], options.sizes[j],
+                                   options.steps);
+        run_benchmark(options, generator, options.sizes[j], results);
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
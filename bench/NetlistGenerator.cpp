@@ -0,0 +1,208 @@
+#include <fstream>
+#include <cmath>
+
+#include "NetlistGenerator.h"
+#include "AMCircuitException.h"
+#include "helpers.h"
+
+namespace amcircuit {
+
+static const char* const circuit_names[] = {
+  "rc_ladder", "rlc_mesh", "power_grid", "diode_array", "switch_array"
+};
+static const int num_circuits = sizeof(circuit_names) / sizeof(circuit_names[0]);
+
+static const amc_float bench_step_s = 1E-5;
+
+// Node on row `i` and column `j` of a grid of side `side` starting at `first`
+inline int grid_node(int first, int side, int i, int j) {
+  return first + i * side + j;
+}
+
+inline int square_side(int num_nodes) {
+  int side = static_cast<int>(std::floor(std::sqrt(num_nodes) + 0.5));
+  return side < 2 ? 2 : side;
+}
+
+inline int at_least_one(int value) {
+  return value < 1 ? 1 : value;
+}
+
+NetlistGenerator::NetlistGenerator(const std::string& circuit,
+                                   int target_unknowns, int steps)
+    : circuit_name(circuit), circuit(RC_LADDER), steps(at_least_one(steps)),
+      size(0), num_nodes(0), num_elements(0), num_unknowns(0) {
+  int index = 0;
+  while (index < num_circuits && circuit_name != circuit_names[index]) {
+    ++index;
+  }
+  if (index == num_circuits) {
+    throw AMCircuitException("Unknown circuit: " + circuit_name);
+  }
+  this->circuit = static_cast<Circuit>(index);
+  calculate_size(target_unknowns);
+}
+
+void NetlistGenerator::calculate_size(int target_unknowns) {
+  switch (circuit) {
+    case RC_LADDER:
+      size = at_least_one(target_unknowns - 2);
+      num_nodes = size + 1;
+      num_elements = 2 * size + 1;
+      num_unknowns = num_nodes + 1;
+      break;
+    case RLC_MESH:
+      size = square_side(target_unknowns / 2);
+      num_nodes = size * size + 1;
+      num_elements = 2 * size * (size - 1) + size * size + 2;
+      num_unknowns = num_nodes + 1 + size * (size - 1);
+      break;
+    case POWER_GRID:
+      size = square_side(target_unknowns - 4);
+      num_nodes = size * size;
+      num_elements = 2 * size * (size - 1) + 2 * size * size + 4;
+      num_unknowns = num_nodes + 4;
+      break;
+    case DIODE_ARRAY:
+      size = at_least_one(target_unknowns - 2);
+      num_nodes = size + 1;
+      num_elements = 2 * size + 1;
+      num_unknowns = num_nodes + 1;
+      break;
+    case SWITCH_ARRAY:
+      size = at_least_one(target_unknowns - 4);
+      num_nodes = size + 2;
+      num_elements = 3 * size + 2;
+      num_unknowns = num_nodes + 2;
+      break;
+  }
+}
+
+void NetlistGenerator::write_to_stream(std::ostream& ostream) const {
+  ostream << num_nodes << std::endl;
+  switch (circuit) {
+    case RC_LADDER: write_rc_ladder(ostream); break;
+    case RLC_MESH: write_rlc_mesh(ostream); break;
+    case POWER_GRID: write_power_grid(ostream); break;
+    case DIODE_ARRAY: write_diode_array(ostream); break;
+    case SWITCH_ARRAY: write_switch_array(ostream); break;
+  }
+  write_analysis(ostream);
+}
+
+void NetlistGenerator::write_to_file(const std::string& file_name) const {
+  std::ofstream file(file_name.c_str());
+  if (!file) {
+    throw FileNotFound(file_name);
+  }
+  write_to_stream(file);
+}
+
+// Node 1 is the source, the sections go from node 2 to node size + 1
+void NetlistGenerator::write_rc_ladder(std::ostream& ostream) const {
+  ostream << "V1 1 0 SIN 0 1 1e3 0 0 0 1000" << std::endl;
+  for (int i = 1; i <= size; ++i) {
+    ostream << "R" << i << " " << i << " " << i + 1 << " 10" << std::endl;
+    ostream << "C" << i << " " << i + 1 << " 0 1e-6" << std::endl;
+  }
+}
+
+// Node 1 is the source, the grid starts on node 2
+void NetlistGenerator::write_rlc_mesh(std::ostream& ostream) const {
+  ostream << "V1 1 0 SIN 0 1 1e3 0 0 0 1000" << std::endl;
+  ostream << "R0 1 2 1" << std::endl;
+  int element = 0;
+  for (int i = 0; i < size; ++i) {
+    for (int j = 0; j < size; ++j) {
+      const int node = grid_node(2, size, i, j);
+      ++element;
+      if (j + 1 < size) {
+        ostream << "R" << element << " " << node << " "
+                << grid_node(2, size, i, j + 1) << " 10" << std::endl;
+      }
+      if (i + 1 < size) {
+        ostream << "L" << element << " " << node << " "
+                << grid_node(2, size, i + 1, j) << " 1e-3" << std::endl;
+      }
+      ostream << "C" << element << " " << node << " 0 1e-6" << std::endl;
+    }
+  }
+}
+
+void NetlistGenerator::write_power_grid(std::ostream& ostream) const {
+  const int corners[] = {
+    grid_node(1, size, 0, 0), grid_node(1, size, 0, size - 1),
+    grid_node(1, size, size - 1, 0), grid_node(1, size, size - 1, size - 1)
+  };
+  for (int i = 0; i < 4; ++i) {
+    ostream << "V" << i << " " << corners[i] << " 0 DC 1" << std::endl;
+  }
+  int element = 0;
+  for (int i = 0; i < size; ++i) {
+    for (int j = 0; j < size; ++j) {
+      const int node = grid_node(1, size, i, j);
+      ++element;
+      if (j + 1 < size) {
+        ostream << "RH" << element << " " << node << " "
+                << grid_node(1, size, i, j + 1) << " 0.1" << std::endl;
+      }
+      if (i + 1 < size) {
+        ostream << "RV" << element << " " << node << " "
+                << grid_node(1, size, i + 1, j) << " 0.1" << std::endl;
+      }
+      ostream << "C" << element << " " << node << " 0 1e-6" << std::endl;
+      ostream << "I" << element << " " << node << " 0 PULSE 0 1e-3 "
+              << (element % 10) * bench_step_s << " 1e-5 1e-5 5e-5 1e-4 1000"
+              << std::endl;
+    }
+  }
+}
+
+// Same diode as on the test netlists, one for each node of a resistive ladder
+void NetlistGenerator::write_diode_array(std::ostream& ostream) const {
+  ostream << "V1 1 0 SIN 0 4 1e3 0 0 0 1000" << std::endl;
+  for (int i = 1; i <= size; ++i) {
+    ostream << "R" << i << " " << i << " " << i + 1 << " 10" << std::endl;
+    ostream << "N" << i << " " << i + 1
+            << " 0 -1000 -1e-6 0 0 0.6 1e-3 2 20" << std::endl;
+  }
+}
+
+// Node 1 is the supply, node 2 the control and cells start on node 3
+void NetlistGenerator::write_switch_array(std::ostream& ostream) const {
+  ostream << "V1 1 0 DC 5" << std::endl;
+  ostream << "V2 2 0 PULSE 0 5 0 1e-5 1e-5 5e-5 1e-4 1000" << std::endl;
+  for (int i = 1; i <= size; ++i) {
+    const int node = i + 2;
+    ostream << "R" << i << " 1 " << node << " 100" << std::endl;
+    ostream << "C" << i << " " << node << " 0 1e-7" << std::endl;
+    ostream << "$" << i << " " << node << " 0 2 0 1e3 1e-9 2.5" << std::endl;
+  }
+}
+
+void NetlistGenerator::write_analysis(std::ostream& ostream) const {
+  ostream << ".TRAN " << steps * bench_step_s << " " << bench_step_s
+          << " ADMO2 1 UIC" << std::endl;
+}
+
+const std::string& NetlistGenerator::get_circuit() const {
+  return circuit_name;
+}
+
+int NetlistGenerator::get_num_nodes() const {
+  return num_nodes;
+}
+
+int NetlistGenerator::get_num_elements() const {
+  return num_elements;
+}
+
+int NetlistGenerator::get_num_unknowns() const {
+  return num_unknowns;
+}
+
+std::vector<std::string> NetlistGenerator::get_circuits() {
+  return std::vector<std::string>(circuit_names, circuit_names + num_circuits);
+}
+
+}  // namespace amcircuit
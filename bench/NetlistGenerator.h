@@ -0,0 +1,59 @@
+#ifndef AMCIRCUIT_NETLISTGENERATOR_H
+#define AMCIRCUIT_NETLISTGENERATOR_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace amcircuit {
+
+// Writes synthetic netlists with about `target_unknowns` unknowns, followed by
+// a transient analysis of `steps` samples. Available circuits:
+// - rc_ladder: RC low-pass sections in series driven by a sine source
+// - rlc_mesh: square grid of resistors (rows) and inductors (columns) with a
+//   capacitor from every node to ground
+// - power_grid: resistive square grid fed on the corners with decoupling
+//   capacitors and pulsed loads on every node
+// - diode_array: resistive ladder with a diode from every node to ground
+// - switch_array: capacitors charged through resistors and discharged by
+//   switches driven by a common pulse
+// Sizes are computed on construction, so the netlist need not be written to
+// know how large it is.
+class NetlistGenerator {
+ public:
+  NetlistGenerator(const std::string& circuit, int target_unknowns, int steps);
+
+  void write_to_stream(std::ostream& ostream) const;
+  void write_to_file(const std::string& file_name) const;
+
+  const std::string& get_circuit() const;
+  int get_num_nodes() const;
+  int get_num_elements() const;
+  int get_num_unknowns() const;
+
+  static std::vector<std::string> get_circuits();
+
+ private:
+  enum Circuit { RC_LADDER, RLC_MESH, POWER_GRID, DIODE_ARRAY, SWITCH_ARRAY };
+
+  std::string circuit_name;
+  Circuit circuit;
+  int steps;
+  // Cells on the ladders and arrays, side of the square on the grids
+  int size;
+  int num_nodes;
+  int num_elements;
+  int num_unknowns;
+
+  void calculate_size(int target_unknowns);
+  void write_rc_ladder(std::ostream& ostream) const;
+  void write_rlc_mesh(std::ostream& ostream) const;
+  void write_power_grid(std::ostream& ostream) const;
+  void write_diode_array(std::ostream& ostream) const;
+  void write_switch_array(std::ostream& ostream) const;
+  void write_analysis(std::ostream& ostream) const;
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_NETLISTGENERATOR_H
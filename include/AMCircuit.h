@@ -20,6 +20,60 @@ static const amc_float IC_SCALING_STEP = 1e-8;
 
 static const int NUM_STEPS_IC = 20;
 
+// How many times a DC sweep increment may be halved before giving up
+static const int DC_SWEEP_MAX_HALVINGS = 10;
+
+// Shooting-Newton parameters for the periodic steady state analysis
+static const int PSS_ITERATIONS_LIMIT = 20;
+// A state variable is periodic once it changes over a period by less than the
+// relative error of its value plus an absolute one, volts for capacitors and
+// amperes for inductors
+static const amc_float PSS_RELATIVE_ERROR = 1E-5;
+static const amc_float PSS_VOLTAGE_ERROR = 1E-6;
+static const amc_float PSS_CURRENT_ERROR = 1E-9;
+static const amc_float PSS_PERTURBATION = 1E-6;
+static const amc_float PSS_REGULARIZATION = 1E-6;
+
+// Netlists are parsed in parallel only when each chunk gets at least this many
+// bytes, below that starting threads costs more than it saves
+static const long PARALLEL_PARSE_MIN_CHUNK_BYTES = 1 << 20;
+static const int PARALLEL_PARSE_CHUNKS_PER_WORKER = 4;
+
+// Spans kept by the tracer, older ones are overwritten
+static const int TRACE_BUFFER_SPANS = 1 << 18;
+
+// Appended to the netlist file name to name its cache
+static const char NETLIST_CACHE_EXTENSION[] = ".cache";
+
+// Non linear resistors look for the segment holding the voltage starting from
+// the last one used, moving at most this many segments before searching the
+// whole table. Tables with at least `..._GRID_MIN_POINTS` points are indexed
+// by a uniform grid so that the search takes constant time when their points
+// are evenly spread.
+static const int NONLINEAR_RESISTOR_CURSOR_MOVES = 2;
+static const int NONLINEAR_RESISTOR_GRID_MIN_POINTS = 32;
+
+// Piecewise linear signals move at most this many segments from the last one
+// used, points further ahead are found by a binary search
+static const int PWL_CURSOR_MOVES = 4;
+
+// Conductance across semiconductor junctions and channels, so that devices
+// that are off don't leave nodes floating. Smaller values would fall below the
+// pivots the linear system takes as zero.
+static const amc_float SEMICONDUCTOR_GMIN = 1E-9;
+// Thermal voltage (kT/q) at 300 K
+static const amc_float THERMAL_VOLTAGE = 25.852E-3;
+
+// Switch crossings closer than this fraction of a step to one of its ends are
+// taken as being there, as are those this close to the first one. A point is
+// solved again at most `SWITCH_EVENTS_LIMIT` times for switches changing, the
+// analysis failing if they still do.
+static const amc_float SWITCH_MIN_CUT = 1E-3;
+static const int SWITCH_EVENTS_LIMIT = 10;
+
+// Deepest subcircuit nesting, deeper instances are taken as recursive
+static const int SUBCIRCUIT_MAX_DEPTH = 64;
+
 
 } // namespace amcircuit
 
@@ -0,0 +1,90 @@
+#ifndef AMCIRCUIT_ADAMSMOULTON_H
+#define AMCIRCUIT_ADAMSMOULTON_H
+
+#include "AMCircuit.h"
+#include "AMCircuitException.h"
+#include "helpers.h"
+
+namespace amcircuit {
+
+// Adams-Moulton methods used to integrate reactive elements. On each step a
+// capacitor becomes a conductance `G = gain(C, step)` in parallel with a
+// current source `I = source(G * v, i0, i1, i2)`, where `v` is the voltage on
+// the last step and `i0`, `i1`, `i2` are the currents on the last steps, the
+// newest first. Inductors are the dual: a resistance `R = gain(L, step)` in
+// series with a voltage source `V = source(R * i, v0, v1, v2)`.
+// There is one specialization per order, so loops over many elements may be
+// compiled for a single one.
+template<int order> struct AdamsMoulton;
+
+template<> struct AdamsMoulton<1> {
+  static amc_float gain(amc_float value, amc_float step_s) {
+    return value/step_s;
+  }
+  static amc_float source(amc_float present, amc_float, amc_float,
+                          amc_float) {
+    return present;
+  }
+};
+
+template<> struct AdamsMoulton<2> {
+  static amc_float gain(amc_float value, amc_float step_s) {
+    return 2 * value/step_s;
+  }
+  static amc_float source(amc_float present, amc_float past0, amc_float,
+                          amc_float) {
+    return present + past0;
+  }
+};
+
+template<> struct AdamsMoulton<3> {
+  static amc_float gain(amc_float value, amc_float step_s) {
+    return 12.0/5.0 * value/step_s;
+  }
+  static amc_float source(amc_float present, amc_float past0, amc_float past1,
+                          amc_float) {
+    return present - 1.0/5.0 * past1 + 8.0/5.0 * past0;
+  }
+};
+
+template<> struct AdamsMoulton<4> {
+  static amc_float gain(amc_float value, amc_float step_s) {
+    return 8.0/3.0 * value/step_s;
+  }
+  static amc_float source(amc_float present, amc_float past0, amc_float past1,
+                          amc_float past2) {
+    return present + 1.0/9.0 * past2 - 5.0/9.0 * past1 + 19.0/9.0 * past0;
+  }
+};
+
+template<int order>
+inline void adams_moulton(amc_float value, amc_float step_s,
+                          amc_float last_value, const amc_float* past,
+                          amc_float& gain, amc_float& source) {
+  gain = AdamsMoulton<order>::gain(value, step_s);
+  source = AdamsMoulton<order>::source(gain * last_value, past[0], past[1],
+                                       past[2]);
+}
+
+// For a single element, the order is only known when running
+inline void adams_moulton(int order, amc_float value, amc_float step_s,
+                          amc_float last_value, const amc_float* past,
+                          amc_float& gain, amc_float& source) {
+  switch (order) {
+    case 1: adams_moulton<1>(value, step_s, last_value, past, gain, source);
+      break;
+    case 2: adams_moulton<2>(value, step_s, last_value, past, gain, source);
+      break;
+    case 3: adams_moulton<3>(value, step_s, last_value, past, gain, source);
+      break;
+    case 4: adams_moulton<4>(value, step_s, last_value, past, gain, source);
+      break;
+    default:
+      throw InvalidIntegrationMethod(
+          to_str("Invalid Adams-Moulton order: " << order));
+  }
+}
+
+}  // namespace amcircuit
+
+#endif  // AMCIRCUIT_ADAMSMOULTON_H
@@ -0,0 +1,75 @@
+#ifndef AMCIRCUIT_BATCHRUNNER_H
+#define AMCIRCUIT_BATCHRUNNER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "JobScheduler.h"
+
+namespace amcircuit {
+
+// Simulates a single netlist, writing the results to a file
+class NetlistJob : public Job {
+ public:
+  NetlistJob(const std::string& netlist_file_name,
+             const std::string& output_file_name);
+
+  virtual void run();
+  virtual double get_cost_estimate() const;
+
+  const std::string& get_netlist_file_name() const;
+  const std::string& get_output_file_name() const;
+  bool succeeded() const;
+  const std::string& get_error() const;
+  double get_run_time_s() const;
+  long get_num_nr_iterations() const;
+  long get_allocated_bytes() const;
+
+ private:
+  std::string netlist_file_name;
+  std::string output_file_name;
+  double cost_estimate;
+  bool success;
+  std::string error;
+  double run_time_s;
+  long num_nr_iterations;
+  long allocated_bytes;
+
+  double estimate_cost() const;
+};
+
+// Runs many netlists on a JobScheduler. Inputs may be netlists (`.net`),
+// directories, whose netlists are all run, or manifests. A manifest lists one
+// netlist per line, optionally followed by its output file, paths relative to
+// the manifest. Empty lines and lines starting with `#` or `*` are ignored.
+// Outputs are written next to the netlists unless an output directory is given.
+class BatchRunner {
+ public:
+  BatchRunner(const std::vector<std::string>& inputs,
+              const std::string& output_directory, int num_workers);
+  ~BatchRunner();
+
+  void run();
+  void write_report(std::ostream& ostream) const;
+  int get_num_jobs() const;
+  int get_num_failed() const;
+
+ private:
+  std::string output_directory;
+  int num_workers;
+  double wall_time_s;
+  std::vector<NetlistJob*> jobs;
+
+  void add_input(const std::string& input);
+  void add_manifest(const std::string& manifest_file_name);
+  void add_netlist(const std::string& netlist_file_name,
+                   const std::string& output_file_name = "");
+
+  BatchRunner(const BatchRunner& other);
+  BatchRunner& operator=(const BatchRunner& other);
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_BATCHRUNNER_H
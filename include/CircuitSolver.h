@@ -12,40 +12,134 @@
 
 #include "Netlist.h"
 #include "Statement.h"
+#include "SolverStats.h"
+#include "Tracer.h"
+#include "ElementGroups.h"
 
 namespace amcircuit {
 
+// The solver may be used in two ways:
+// - Constructed only with the netlist it runs the first analysis statement
+//   found on it, keeping every sample to be written afterwards.
+// - Constructed with a transient configuration nothing is simulated nor kept,
+//   the caller drives the simulation with `initialize` and `advance_to`,
+//   reading unknowns and changing sources between calls. The configuration
+//   must outlive the solver.
+// A tracer, if given, records the solver activity. It is not owned and must
+// outlive the solver.
+// The netlist is only read, all the simulation state belongs to the solver.
+// Many solvers may thus share the same netlist, even from different threads.
 class CircuitSolver {
  public:
-  explicit CircuitSolver(Netlist* netlist);
+  explicit CircuitSolver(const Netlist* netlist, Tracer* tracer = NULL);
+  CircuitSolver(const Netlist* netlist, const Tran& config,
+                Tracer* tracer = NULL);
   ~CircuitSolver();
 
   void write_to_stream(std::ostream& ostream) const;
   void write_to_file(const std::string& file_name) const;
   void write_to_screen() const;
 
+  // Finds the initial conditions, going back to t = 0
+  void initialize();
+  // Integrates up to `time`, which is rounded to the nearest internal step
+  void advance_to(amc_float time);
+  amc_float get_time() const;
+
+  // Unknowns are named as on the output header: node numbers and branch
+  // currents prefixed with `j` (e.g. "2", "jV0200")
+  int get_system_size() const;
+  int find_unknown(const std::string& name) const;
+  amc_float get_unknown(int index) const;
+
+  void set_source_signal(const std::string& source_name,
+                         Signal::Handler signal);
+  void set_source_value(const std::string& source_name, amc_float value);
+
+  long get_num_nr_iterations() const;
+  // Peak memory is measured when called
+  SolverStats get_stats() const;
+  // Memory taken by the system and the kept samples
+  long get_allocated_bytes() const;
+
  private:
-  Tran& find_first_tran_statement();
+  void find_first_analysis_statement();
   void assembly_circuit();
   int get_num_extra_lines();
-  int get_system_size();
+  int calculate_system_size();
+  int get_num_states();
+  void initialize_states();
   void prepare_circuit();
+  // Templates over the Adams-Moulton order used by the reactive elements,
+  // chosen once per run (or per call from outside)
+  template<int order> bool newton_raphson(amc_float time,
+                                          bool fixed_switches = false);
+  template<int order> void converge_with_retries(amc_float time,
+                                                 bool fixed_switches = false);
+  template<int order> void converge_with_switches(amc_float time);
+  template<int order> bool step(amc_float start, amc_float step_s);
+  bool switching_at_ends();
+  void check_switch_events(int events, amc_float point) const;
+  void change_switches();
   void calculate_till_converge(const amc_float initial_time,
                                const amc_float time_step, const int steps);
+  void integrate(const amc_float step_s, const int steps);
+  template<int order> void integrate(const amc_float step_s, const int steps);
+  template<int order> void integrate_samples();
+  amc_float get_inner_step_s() const;
   void solve_circuit();
-  void update_circuit(amc_float time);
-  inline void add_solution(int index, amc_float time);
+  void solve_transient();
+  void solve_dc_sweep();
+  void sweep_source(int source);
+  void solve_periodic_steady_state();
+  void find_state_elements();
+  void retry_initial();
+  void set_initial_state(const amc_float* state);
+  void get_state(amc_float* state) const;
+  void shoot(const amc_float* initial_state, amc_float* final_state);
+  int find_source(const std::string& name) const;
+  void replace_source_signal(int index, Signal::Handler signal);
+  void replace_element(int index, const Element::Handler& element);
+  template<int order> void update_circuit(amc_float time);
+  inline void add_solution(int index, amc_float abscissa);
+  std::vector<std::string> get_variable_names() const;
   std::string get_variables_header() const;
   CircuitSolver(const CircuitSolver& other);
   CircuitSolver& operator=(const CircuitSolver& other);
 
-  Netlist& netlist;
-  Tran& config;
+  const Netlist& netlist;
+  // Set when the elements are flattened, right below
+  std::vector<std::string> node_names;
+  // Shares the netlist elements, subcircuits flattened, sources may be
+  // replaced to change signals
+  std::vector<Element::Handler> elements;
+  const Tran* tran;
+  const DCSweep* dc_sweep;
+  const PeriodicSteadyState* pss;
   int num_extra_lines;
   int system_size;
+  int num_states;
+  // The same elements, as stamped
+  ElementGroups groups;
   StampParameters stamp_params;
+  amc_float current_time;
+  // Highest order the past values allow on the next step
+  int usable_order;
+  unsigned random_seed;
+  // Output time is added by the const write methods
+  mutable SolverStats stats;
+  Tracer* tracer;
   int num_solution_samples;
   amc_float** solutions;
+
+  // Elements holding the state carried between periods on PSS
+  struct StateElement {
+    const DoubleTerminalElement* element;
+    int state_position;
+    int currents_position;
+  };
+  std::vector<StateElement> state_capacitors;
+  std::vector<StateElement> state_inductors;
 };
 
 }  // namespace amcircuit
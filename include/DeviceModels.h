@@ -0,0 +1,143 @@
+#ifndef AMCIRCUIT_DEVICEMODELS_H
+#define AMCIRCUIT_DEVICEMODELS_H
+
+#include <algorithm>
+#include <cmath>
+
+#include "AMCircuit.h"
+#include "FastMath.h"
+
+namespace amcircuit {
+
+// Equations of the semiconductor devices, shared by the elements and by the
+// loops stamping many of them at once. They have no branches that depend on
+// anything but values, so those loops may be vectorized.
+
+// Diode current I = Is * (exp(v / nVt) - 1), linearized at `voltage` as a
+// conductance `G` in parallel with a current source `I`
+inline void linearize_diode(amc_float voltage, amc_float Is, amc_float nVt,
+                            amc_float& G, amc_float& I) {
+  const amc_float e = fast_exp(voltage / nVt);
+  const amc_float Gd = Is / nVt * e;
+  G = Gd + SEMICONDUCTOR_GMIN;
+  I = Is * (e - 1) - Gd * voltage;
+}
+
+// Level 1 (Shichman-Hodges) drain current of an n channel MOSFET with
+// `vds >= 0`, along with its derivatives on `vgs` (`gm`) and `vds` (`gds`).
+// The triode equations hold everywhere once the overdrive is taken as zero
+// when cut off and `vds` as the overdrive when saturated.
+inline void mosfet_current(amc_float vgs, amc_float vds, amc_float K,
+                           amc_float Vt, amc_float lambda, amc_float& Id,
+                           amc_float& gm, amc_float& gds) {
+  const amc_float overdrive = vgs - Vt > 0 ? vgs - Vt : 0;
+  const amc_float channel = vds < overdrive ? vds : overdrive;
+  const amc_float modulation = 1 + lambda * vds;
+  const amc_float current = K * (2 * overdrive - channel) * channel;
+  Id = current * modulation;
+  gm = 2 * K * channel * modulation;
+  gds = 2 * K * (overdrive - channel) * modulation + current * lambda;
+}
+
+// Newton-Raphson trials may be far from the solution, linearizing devices there
+// makes the next trial even farther. The voltages they are linearized at are
+// thus only allowed to move so much on each iteration, as SPICE does.
+
+// Above the critical voltage the exponential grows so fast that the junction
+// voltage only moves logarithmically
+inline amc_float limit_junction_voltage(amc_float voltage,
+                                        amc_float last_voltage,
+                                        amc_float nVt,
+                                        amc_float critical_voltage) {
+  if (voltage > critical_voltage &&
+      std::abs(voltage - last_voltage) > 2 * nVt) {
+    if (last_voltage > 0) {
+      const amc_float arg = 1 + (voltage - last_voltage) / nVt;
+      return arg > 0 ? last_voltage + nVt * std::log(arg) : critical_voltage;
+    }
+    return nVt * std::log(voltage / nVt);
+  }
+  return voltage;
+}
+
+inline amc_float junction_critical_voltage(amc_float Is, amc_float nVt) {
+  return nVt * std::log(nVt / (std::sqrt(2.0) * Is));
+}
+
+// As SPICE's fetlim: the gate voltage moves by at most about twice its
+// distance to the threshold, and stops near the threshold when crossing it, so
+// the region where the current changes the most isn't skipped over
+inline amc_float limit_gate_voltage(amc_float vgs, amc_float last_vgs,
+                                    amc_float Vt) {
+  const amc_float step_high = std::abs(2 * (last_vgs - Vt)) + 2;
+  const amc_float step_low = step_high / 2 + 2;
+  const amc_float fully_on = Vt + 3.5;
+  const amc_float delta = vgs - last_vgs;
+
+  if (last_vgs >= Vt) {
+    if (last_vgs >= fully_on) {
+      if (delta <= 0) {
+        if (vgs >= fully_on) {
+          return -delta > step_low ? last_vgs - step_low : vgs;
+        }
+        return std::max(vgs, Vt + 2);
+      }
+      return delta >= step_high ? last_vgs + step_high : vgs;
+    }
+    return delta <= 0 ? std::max(vgs, Vt - 0.5) : std::min(vgs, Vt + 4);
+  }
+  if (delta <= 0) {
+    return -delta > step_high ? last_vgs - step_high : vgs;
+  }
+  if (vgs <= Vt + 0.5) {
+    return delta > step_low ? last_vgs + step_low : vgs;
+  }
+  return Vt + 0.5;
+}
+
+// As SPICE's limvds, for the drain voltage on the direction it is conducting
+inline amc_float limit_drain_voltage(amc_float vds, amc_float last_vds) {
+  if (last_vds >= 3.5) {
+    if (vds > last_vds) {
+      return vds < 3 * last_vds + 2 ? vds : 3 * last_vds + 2;
+    }
+    return vds < 2 ? 2 : vds;
+  }
+  if (vds > last_vds) {
+    return vds < 4 ? vds : 4;
+  }
+  return vds > -0.5 ? vds : -0.5;
+}
+
+// Drain and source swap roles when `vds` changes sign, the limits apply to
+// whichever is acting as the source on the last trial. Voltages are left
+// untouched, rather than found again from one another, unless limited.
+inline void limit_mosfet_voltages(amc_float& vgs, amc_float& vds,
+                                  amc_float last_vgs, amc_float last_vds,
+                                  amc_float Vt) {
+  amc_float vgd = vgs - vds;
+  if (last_vds >= 0) {
+    const amc_float limited_vgs = limit_gate_voltage(vgs, last_vgs, Vt);
+    if (limited_vgs != vgs) {
+      vgs = limited_vgs;
+      vds = vgs - vgd;
+    }
+    vds = limit_drain_voltage(vds, last_vds);
+  } else {
+    const amc_float limited_vgd = limit_gate_voltage(vgd, last_vgs - last_vds,
+                                                     Vt);
+    if (limited_vgd != vgd) {
+      vgd = limited_vgd;
+      vds = vgs - vgd;
+    }
+    const amc_float limited_vds = -limit_drain_voltage(-vds, -last_vds);
+    if (limited_vds != vds) {
+      vds = limited_vds;
+      vgs = vgd + vds;
+    }
+  }
+}
+
+}  // namespace amcircuit
+
+#endif  // AMCIRCUIT_DEVICEMODELS_H
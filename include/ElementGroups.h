@@ -0,0 +1,248 @@
+#ifndef AMCIRCUIT_ELEMENTGROUPS_H
+#define AMCIRCUIT_ELEMENTGROUPS_H
+
+#include <string>
+#include <vector>
+
+#include "Elements.h"
+
+namespace amcircuit {
+
+// Flattened elements grouped by type. The parameters of each group are kept on
+// contiguous arrays and stamped by a single loop, with no virtual call nor
+// pointer chasing per element. Types without a group of their own are stamped
+// one by one, through `place_stamp`.
+// Branch currents and states are placed just as if the elements were stamped
+// in order, so the unknowns of the system are the same either way.
+// Capacitors and inductors keep their integration history here, rather than on
+// `StampParameters::state` (which still gives their initial conditions). It is
+// kept on ring buffers shared by the whole group, so moving to the next step
+// shifts no values, and their companion models are found in a single pass.
+// Coupled inductors are kept as dense blocks, one per set of windings coupled
+// with each other, stamped on the branch current lines they were found at.
+// Transmission lines keep the waves each port sent on a ring buffer per line,
+// until they reach the other port.
+// Switches are stamped on the state on `StampParameters::state`, which only
+// changes through `change_switches`.
+// Sources are evaluated once per time point, not on every Newton-Raphson
+// iteration, all signals of a type at once.
+// Semiconductors are linearized in three passes: voltages are gathered and
+// limited, then every device of a type is evaluated by a loop that only
+// touches arrays, and at last the stamps are scattered on the system.
+// Stamping is compiled for each integration order, callers choosing it once
+// for as long as it holds.
+class ElementGroups {
+ public:
+  // `first_current_line` is the system line of the first branch current
+  ElementGroups(const std::vector<Element::Handler>& elements,
+                int first_current_line);
+
+  // Reactive elements are integrated with the Adams-Moulton method of the
+  // given order, the one on `p` being ignored. Only orders 1 to 4 exist.
+  template<int order> void place_stamps(StampParameters& p);
+  // Same, with the order on `p` (1 while using initial conditions)
+  void place_stamps(StampParameters& p);
+  // The element at `index` was replaced by one of the same type, as sources
+  // are to change signals
+  void replace(int index, const Element::Handler& element);
+
+  // Whether a switch is on the wrong state on solution `to`. If so `fraction`
+  // is the part of the step from solution `from` where the first of them
+  // crosses its reference, taking control voltages as linear along the step.
+  // The switches crossing then are kept to be changed by `change_switches`.
+  bool find_switching(const StampParameters& p, const amc_float* from,
+                      const amc_float* to, amc_float& fraction);
+  void change_switches(const StampParameters& p);
+
+ private:
+  struct Resistors {
+    std::vector<int> node1;
+    std::vector<int> node2;
+    std::vector<amc_float> G;
+  };
+  // Past currents (voltages for inductors) are on `past[newest]`, then on
+  // `past[(newest + 1) % 3]` and `past[(newest + 2) % 3]`
+  struct Capacitors {
+    std::vector<int> node1;
+    std::vector<int> node2;
+    std::vector<amc_float> C;
+    std::vector<int> state_position;
+    std::vector<amc_float> last_voltage;
+    std::vector<amc_float> G;
+    std::vector<amc_float> I;
+    std::vector<amc_float> past[3];
+    int newest;
+  };
+  struct Inductors {
+    std::vector<int> node1;
+    std::vector<int> node2;
+    std::vector<amc_float> L;
+    std::vector<int> currents_position;
+    std::vector<int> state_position;
+    std::vector<amc_float> last_current;
+    std::vector<amc_float> R;
+    std::vector<amc_float> V;
+    std::vector<amc_float> past[3];
+    int newest;
+    std::vector<std::string> name; // upper case, for couplings
+  };
+  // Block `k` couples the inductors from `first_member[k]` to
+  // `first_member[k + 1]`. Its mutual inductances (zero on the diagonal) are
+  // on a row major matrix starting at `first_entry[k]`.
+  struct CouplingBlocks {
+    std::vector<int> first_member;
+    std::vector<int> member; // position on the inductors group
+    std::vector<int> line;
+    std::vector<int> first_entry;
+    std::vector<amc_float> k;
+    std::vector<amc_float> M;
+    std::vector<amc_float> gain;
+    std::vector<Element::Handler> mutuals;
+  };
+  // Waves sent by each port (`v + Z0 * i`) at the times of past steps, oldest
+  // first, starting at `oldest` and wrapping around
+  struct LineHistory {
+    std::vector<amc_float> time;
+    std::vector<amc_float> sent1;
+    std::vector<amc_float> sent2;
+    int oldest;
+    int count;
+  };
+  struct TransmissionLines {
+    std::vector<int> port1_p;
+    std::vector<int> port1_n;
+    std::vector<int> port2_p;
+    std::vector<int> port2_n;
+    std::vector<amc_float> Z0;
+    std::vector<amc_float> TD;
+    std::vector<int> currents_position;
+    std::vector<int> state_position;
+    std::vector<LineHistory> history;
+    // Time of the last step stamped, whose solution is sent on the next one
+    amc_float last_time;
+    bool stepped;
+  };
+  struct Diodes {
+    std::vector<int> node1;
+    std::vector<int> node2;
+    std::vector<amc_float> Is;
+    std::vector<amc_float> nVt;
+    std::vector<amc_float> critical_voltage;
+    std::vector<int> state_position;
+    std::vector<amc_float> voltage;
+    std::vector<amc_float> G;
+    std::vector<amc_float> I;
+  };
+  // Voltages are those of n channel transistors (negated on p channel ones,
+  // `sign` being -1), after swapping drain and source when they are reversed
+  struct Mosfets {
+    std::vector<int> drain;
+    std::vector<int> gate;
+    std::vector<int> source;
+    std::vector<amc_float> sign;
+    std::vector<amc_float> K;
+    std::vector<amc_float> Vt;
+    std::vector<amc_float> lambda;
+    std::vector<int> state_position;
+    std::vector<int> effective_drain;
+    std::vector<int> effective_source;
+    std::vector<amc_float> vgs;
+    std::vector<amc_float> vds;
+    std::vector<amc_float> Id;
+    std::vector<amc_float> gm;
+    std::vector<amc_float> gds;
+  };
+  struct Switches {
+    std::vector<int> node_p;
+    std::vector<int> node_n;
+    std::vector<int> node_ctrl_p;
+    std::vector<int> node_ctrl_n;
+    std::vector<amc_float> g_on;
+    std::vector<amc_float> g_off;
+    std::vector<amc_float> v_ref;
+    std::vector<int> state_position;
+    std::vector<amc_float> fraction; // of the step where each one crossed
+    std::vector<int> changing; // positions found by `find_switching`
+  };
+  struct Sources {
+    std::vector<int> node_p;
+    std::vector<int> node_n;
+    std::vector<int> currents_position; // voltage sources only
+    std::vector<Signal::Handler> signal;
+  };
+  // Values of the signals of every source, voltage sources first, at `time`.
+  // Each signal type is evaluated by a loop of its own, signals of other types
+  // one by one (DC ones only when grouped).
+  struct SignalValues {
+    std::vector<amc_float> value;
+    amc_float time;
+    bool valid;
+
+    std::vector<int> sin_source;
+    std::vector<amc_float> offset;
+    std::vector<amc_float> amplitude;
+    std::vector<amc_float> freq_hz;
+    std::vector<amc_float> time_delay;
+    std::vector<amc_float> damping_factor;
+    std::vector<amc_float> phase_cycles;
+    std::vector<amc_float> cycles;
+    std::vector<amc_float> sin_value;
+
+    std::vector<int> pulse_source;
+    std::vector<amc_float> initial;
+    std::vector<amc_float> pulsed;
+    std::vector<amc_float> delay_time;
+    std::vector<amc_float> rise_time;
+    std::vector<amc_float> fall_time;
+    std::vector<amc_float> pulse_width;
+    std::vector<amc_float> period;
+    std::vector<int> pulse_cycles;
+    std::vector<amc_float> pulse_value;
+
+    std::vector<int> other_source;
+    std::vector<unsigned> cursor; // kept by the signal between steps
+  };
+  struct Others {
+    std::vector<Element::Handler> element;
+    std::vector<int> currents_position;
+    std::vector<int> state_position;
+  };
+
+  Resistors resistors;
+  Capacitors capacitors;
+  Inductors inductors;
+  CouplingBlocks couplings;
+  TransmissionLines lines;
+  Diodes diodes;
+  Mosfets mosfets;
+  Switches switches;
+  Sources voltage_sources;
+  Sources current_sources;
+  SignalValues signals;
+  Others others;
+  // Position of each element on its group
+  std::vector<int> group_positions;
+
+  void group_signals();
+  void add_signal(int source);
+  void remove_signal(int source);
+  void replace_signal(int source);
+  void update_signal_values(amc_float time);
+  void couple_inductors();
+  void update_mutual_inductances();
+  void update_histories(const StampParameters& p);
+  template<int order> void update_companions(amc_float step_s);
+  static void send_waves(LineHistory& history, amc_float time,
+                         amc_float sent1, amc_float sent2);
+  static void sent_at(const LineHistory& history, amc_float time,
+                      amc_float& sent1, amc_float& sent2);
+  static void drop_sent_before(LineHistory& history, amc_float time);
+  void update_incident_waves(const StampParameters& p);
+  void stamp_lines(StampParameters& p);
+  void stamp_diodes(const StampParameters& p);
+  void stamp_mosfets(const StampParameters& p);
+};
+
+}  // namespace amcircuit
+
+#endif  // AMCIRCUIT_ELEMENTGROUPS_H
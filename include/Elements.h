@@ -6,50 +6,70 @@
 #define AMCIRCUIT_ELEMENT_H
 
 #include <string>
-#include <sstream>
 #include <vector>
 #include <utility>
 
 #include "AMCircuit.h"
+#include "Expression.h"
 #include "Signal.h"
 #include "ResourceHandler.h"
+#include "Tokenizer.h"
 
 namespace amcircuit {
 
+// Everything that changes during a simulation lives here, elements themselves
+// are never modified so a netlist may be shared by many simulations
 struct StampParameters {
-  StampParameters(int system_size);
+  StampParameters(int system_size, int num_states = 0);
   ~StampParameters();
 
   amc_float** A;
   amc_float* x;
   amc_float* b;
   amc_float* last_nr_trial;
+  amc_float* state;
   int method_order;
   amc_float step_s;
 
   bool use_ic;
+  bool dc_analysis; // capacitors are open and inductors are short circuits
   bool new_nr_cycle;
+  // Set by elements linearized somewhere other than on the last trial, so
+  // the iteration can't be taken as converged
+  mutable bool limited;
   amc_float time;
   int currents_position;
+  int state_position;
  private:
   int system_size;
+  StampParameters(const StampParameters& other);
+  StampParameters& operator=(const StampParameters& other);
 };
 
+class NodeMap;
+
 class Element {
  public:
-  explicit Element(const std::string& params);
+  explicit Element(const std::string& name);
+  explicit Element(Tokenizer& params);
   virtual ~Element() = 0;
 
   typedef ResourceHandler<Element> Handler;
-  static Element::Handler get_element(const std::string& element_string);
+  static Element::Handler get_element(Tokenizer element_string);
 
   std::string get_name() const;
+  // Appends the nodes the element is connected to
+  virtual void append_nodes(std::vector<int>& nodes) const = 0;
+  // A copy of this element for an instance of the subcircuit it is defined
+  // in, named `prefix + name` and connected to the nodes mapped by `nodes`
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const = 0;
   virtual int get_num_of_currents() const = 0;
-//  virtual void flush_values();
-  virtual void place_stamp(const StampParameters&) = 0;
-
- protected:
-  std::stringstream line_stream;
+  // Elements that keep values between steps (e.g. the integration history)
+  // store them on `StampParameters::state`, starting at `state_position`
+  virtual int get_num_of_states() const;
+  virtual void initialize_state(amc_float* state) const;
+  virtual void place_stamp(const StampParameters&) const = 0;
 
  private:
   std::string name;
@@ -60,9 +80,10 @@ class Element {
 class DoubleTerminalElement : public Element {
  public:
   DoubleTerminalElement(const std::string& name, int node1, int node2);
-  explicit DoubleTerminalElement(const std::string& params);
+  explicit DoubleTerminalElement(Tokenizer& params);
   int get_node1() const;
   int get_node2() const;
+  virtual void append_nodes(std::vector<int>& nodes) const;
  private:
   int node1;
   int node2;
@@ -71,9 +92,10 @@ class DoubleTerminalElement : public Element {
 class SimpleSourceElement : public Element {
  public:
   SimpleSourceElement(const std::string& name, int node_p, int node_n);
-  explicit SimpleSourceElement(const std::string& params);
+  explicit SimpleSourceElement(Tokenizer& params);
   int get_node_p() const;
   int get_node_n() const;
+  virtual void append_nodes(std::vector<int>& nodes) const;
 
  private:
   int node_p;
@@ -84,8 +106,10 @@ class ArbitrarySourceElement : public SimpleSourceElement {
  public:
   ArbitrarySourceElement(const std::string& name, int node_p, int node_n,
                          Signal::Handler signal);
-  explicit ArbitrarySourceElement(const std::string& params);
+  explicit ArbitrarySourceElement(Tokenizer& params);
   const Signal::Handler& get_signal() const;
+  // A copy of this source driven by another signal
+  virtual Element::Handler with_signal(Signal::Handler signal) const = 0;
  protected:
   Signal::Handler signal;
 };
@@ -94,11 +118,12 @@ class ControlledElement : public Element {
  public:
   ControlledElement(const std::string& name, int node_p, int node_n,
                     int node_ctrl_p, int node_ctrl_n);
-  explicit ControlledElement(const std::string& params);
+  explicit ControlledElement(Tokenizer& params);
   int get_node_p() const;
   int get_node_n() const;
   int get_node_ctrl_p() const;
   int get_node_ctrl_n() const;
+  virtual void append_nodes(std::vector<int>& nodes) const;
 
  private:
   int node_p;
@@ -110,12 +135,14 @@ class ControlledElement : public Element {
 class Resistor : public DoubleTerminalElement {
  public:
   Resistor(const std::string& name, int node1, int node2, amc_float R);
-  explicit Resistor(const std::string& params);
+  explicit Resistor(Tokenizer params);
 
   amc_float get_R() const;
 
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   amc_float R;
@@ -126,29 +153,61 @@ class NonLinearResistor : public DoubleTerminalElement {
   typedef std::pair<amc_float, amc_float> coordinate;
   NonLinearResistor(const std::string& name, int node1, int node2,
                     const std::vector<coordinate>& coordinates);
-  explicit NonLinearResistor(const std::string& params);
+  explicit NonLinearResistor(Tokenizer params);
   const std::vector<coordinate>& get_coordinates() const;
-
+  // Segment holding `voltage`, between coordinates `k - 1` and `k`. The first
+  // and last segments are extended beyond the table. The search starts from
+  // segment `hint`.
+  int find_segment(amc_float voltage, int hint) const;
+
+  // Last segment used
+  enum State { SEGMENT, NUM_OF_STATES };
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual int get_num_of_states() const;
+  virtual void initialize_state(amc_float* state) const;
+  virtual void place_stamp(const StampParameters&) const;
 
  protected:
   std::vector<coordinate> coordinates;
+
+ private:
+  // Segment search starting points for evenly spaced voltages, bin `b` starts
+  // at voltage `grid_origin + b / grid_scale`. Empty for small tables.
+  std::vector<int> grid;
+  amc_float grid_origin;
+  amc_float grid_scale;
+
+  void build_grid();
 };
 
+// Conductance `g_on` when the control voltage is at least `v_ref`, `g_off`
+// otherwise. Its state is only changed by the solver, between solutions, so
+// Newton-Raphson always sees a linear element.
+// Example input:
+// $1 2 3 4 0 1e3 1e-9 2.5
 class VoltageControlledSwitch : public ControlledElement {
  public:
   VoltageControlledSwitch(const std::string& name, int node_p, int node_n,
                           int node_ctrl_p, int node_ctrl_n, amc_float g_on,
                           amc_float g_off, amc_float v_ref);
-  explicit VoltageControlledSwitch(const std::string& params);
+  explicit VoltageControlledSwitch(Tokenizer params);
 
   amc_float get_g_on() const;
   amc_float get_g_off() const;
   amc_float get_v_ref() const;
+  // Whether the switch should be on with `control` volts on its control
+  bool is_on_at(amc_float control) const;
 
+  // 1 when on, 0 when off. Switches start as with no voltage on the control.
+  enum State { ON, NUM_OF_STATES };
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual int get_num_of_states() const;
+  virtual void initialize_state(amc_float* state) const;
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   amc_float g_on;
@@ -156,46 +215,197 @@ class VoltageControlledSwitch : public ControlledElement {
   amc_float v_ref;
 };
 
+// Shockley diode from `node1` (anode) to `node2` (cathode). The saturation
+// current and the emission coefficient may follow the nodes, defaulting to
+// 1E-14 A and 1.
+// Example input:
+// D1 2 3 1e-14 1.8
+class Diode : public DoubleTerminalElement {
+ public:
+  Diode(const std::string& name, int anode, int cathode, amc_float Is,
+        amc_float n);
+  explicit Diode(Tokenizer params);
+
+  amc_float get_Is() const;
+  amc_float get_n() const;
+  // Voltage above which each Newton-Raphson iteration is limited
+  amc_float get_critical_voltage() const;
+
+  // Voltage the diode was last linearized at
+  enum State { LAST_VOLTAGE, NUM_OF_STATES };
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
+  virtual int get_num_of_currents() const;
+  virtual int get_num_of_states() const;
+  virtual void place_stamp(const StampParameters&) const;
+
+ private:
+  amc_float Is;
+  amc_float n;
+  amc_float critical_voltage;
+};
+
+// Level 1 MOSFET, with no body effect. In saturation the drain current is
+// `K * (Vgs - Vt)^2 * (1 + lambda * Vds)`, `lambda` being optional. Thresholds
+// of p channel transistors are given as on SPICE, negative when enhancement.
+// Drain and source are swapped whenever the current flows the other way.
+// Example input:
+// M1 3 2 0 NMOS 1e-3 1 0.01
+class Mosfet : public Element {
+ public:
+  Mosfet(const std::string& name, int drain, int gate, int source,
+         bool p_channel, amc_float K, amc_float Vt, amc_float lambda);
+  explicit Mosfet(Tokenizer params);
+
+  int get_drain() const;
+  int get_gate() const;
+  int get_source() const;
+  bool is_p_channel() const;
+  amc_float get_K() const;
+  amc_float get_Vt() const;
+  amc_float get_lambda() const;
+
+  // Gate and drain voltages the transistor was last linearized at, as on an n
+  // channel one and before swapping drain and source
+  enum State { LAST_VGS, LAST_VDS, NUM_OF_STATES };
+  virtual void append_nodes(std::vector<int>& nodes) const;
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
+  virtual int get_num_of_currents() const;
+  virtual int get_num_of_states() const;
+  virtual void place_stamp(const StampParameters&) const;
+
+ private:
+  int drain;
+  int gate;
+  int source;
+  bool p_channel;
+  amc_float K;
+  amc_float Vt;
+  amc_float lambda;
+};
+
 class Inductor : public DoubleTerminalElement {
  public:
   Inductor(const std::string& name, int node1, int node2, amc_float L,
            amc_float initial_current);
-  explicit Inductor(const std::string& params);
+  explicit Inductor(Tokenizer params);
 
   amc_float get_L() const;
   amc_float get_initial_current() const;
 
+  enum State { INITIAL_CURRENT, LAST_CURRENT, PAST_VOLTAGES,
+               NUM_OF_STATES = PAST_VOLTAGES + 3 };
+  // Stamps an inductor whose states start at `state`, for those stamped
+  // without an Inductor object
+  static void stamp(const StampParameters& p, int node1, int node2,
+                    int currents_position, amc_float L, amc_float* state);
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual int get_num_of_states() const;
+  virtual void initialize_state(amc_float* state) const;
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   amc_float L;
   amc_float initial_current;
-  amc_float past_voltages[3];
-  amc_float last_current;
-  void initialize();
+};
+
+// Magnetic coupling between inductors, given by name, with coefficient `k`.
+// Every pair of the inductors listed is coupled, so a transformer with many
+// windings takes a single line. The inductors are looked up when the circuit
+// is solved and the coupling is stamped along with them.
+// Example input:
+// K1 L1 L2 L3 0.99
+class MutualInductance : public Element {
+ public:
+  MutualInductance(const std::string& name,
+                   const std::vector<std::string>& inductors, amc_float k);
+  explicit MutualInductance(Tokenizer params);
+
+  const std::vector<std::string>& get_inductors() const;
+  amc_float get_k() const;
+
+  virtual void append_nodes(std::vector<int>& nodes) const;
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
+  virtual int get_num_of_currents() const;
+  virtual void place_stamp(const StampParameters&) const;
+
+ private:
+  std::vector<std::string> inductors;
+  amc_float k;
 };
 
 class Capacitor : public DoubleTerminalElement {
  public:
   Capacitor(const std::string& name, int node1, int node2, amc_float C,
             amc_float initial_voltage);
-  explicit Capacitor(const std::string& params);
+  explicit Capacitor(Tokenizer params);
 
   amc_float get_C() const;
   amc_float get_initial_voltage() const;
 
+  enum State { INITIAL_VOLTAGE, LAST_VOLTAGE, LAST_G, LAST_I, PAST_CURRENTS,
+               NUM_OF_STATES = PAST_CURRENTS + 3 };
+  // Stamps a capacitor whose states start at `state`, for those stamped
+  // without a Capacitor object
+  static void stamp(const StampParameters& p, int node1, int node2,
+                    amc_float C, amc_float* state);
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual int get_num_of_states() const;
+  virtual void initialize_state(amc_float* state) const;
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   amc_float C;
   amc_float initial_voltage;
-  amc_float past_currents[3];
-  amc_float last_voltage;
-  amc_float last_G;
-  amc_float last_I;
-  void initialize();
+};
+
+// Lossless transmission line with characteristic impedance `Z0` and delay
+// `TD` (Branin's model). Each port is the resistance `Z0` in series with the
+// wave the other port sent `TD` earlier, so the port currents are the only
+// unknowns. Lines start discharged and are wires on DC.
+// Example input:
+// T1 1 0 2 0 50 1e-9
+class TransmissionLine : public Element {
+ public:
+  TransmissionLine(const std::string& name, int port1_p, int port1_n,
+                   int port2_p, int port2_n, amc_float Z0, amc_float TD);
+  explicit TransmissionLine(Tokenizer params);
+
+  int get_port1_p() const;
+  int get_port1_n() const;
+  int get_port2_p() const;
+  int get_port2_n() const;
+  amc_float get_Z0() const;
+  amc_float get_TD() const;
+
+  // Waves reaching each port on the present step, kept by the solver as the
+  // line history lives with the other lines
+  enum State { INCIDENT1, INCIDENT2, NUM_OF_STATES };
+  // Stamps a line whose states start at `state`, for those stamped without a
+  // TransmissionLine object
+  static void stamp(const StampParameters& p, int port1_p, int port1_n,
+                    int port2_p, int port2_n, amc_float Z0,
+                    const amc_float* state);
+  virtual void append_nodes(std::vector<int>& nodes) const;
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
+  virtual int get_num_of_currents() const;
+  virtual int get_num_of_states() const;
+  virtual void place_stamp(const StampParameters&) const;
+
+ private:
+  int port1_p;
+  int port1_n;
+  int port2_p;
+  int port2_n;
+  amc_float Z0;
+  amc_float TD;
 };
 
 class VoltageControlledVoltageSource : public ControlledElement {
@@ -203,11 +413,13 @@ class VoltageControlledVoltageSource : public ControlledElement {
   VoltageControlledVoltageSource(const std::string& name, int node_p,
                                  int node_n, int node_ctrl_p, int node_ctrl_n,
                                  amc_float Av);
-  explicit VoltageControlledVoltageSource(const std::string& params);
+  explicit VoltageControlledVoltageSource(Tokenizer params);
   amc_float get_Av() const;
 
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   amc_float Av;
@@ -218,11 +430,13 @@ class CurrentControlledCurrentSource : public ControlledElement {
   CurrentControlledCurrentSource(const std::string& name, int node_p,
                                  int node_n, int node_ctrl_p, int node_ctrl_n,
                                  amc_float Ai);
-  explicit CurrentControlledCurrentSource(const std::string& params);
+  explicit CurrentControlledCurrentSource(Tokenizer params);
   amc_float get_Ai() const;
 
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   amc_float Ai;
@@ -233,11 +447,13 @@ class VoltageControlledCurrentSource : public ControlledElement {
   VoltageControlledCurrentSource(const std::string& name, int node_p,
                                  int node_n, int node_ctrl_p, int node_ctrl_n,
                                  amc_float Gm);
-  explicit VoltageControlledCurrentSource(const std::string& params);
+  explicit VoltageControlledCurrentSource(Tokenizer params);
   amc_float get_Gm() const;
 
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   amc_float Gm;
@@ -248,48 +464,89 @@ class CurrentControlledVoltageSource : public ControlledElement {
   CurrentControlledVoltageSource(const std::string& name, int node_p,
                                  int node_n, int node_ctrl_p, int node_ctrl_n,
                                  amc_float Rm);
-  explicit CurrentControlledVoltageSource(const std::string& params);
+  explicit CurrentControlledVoltageSource(Tokenizer params);
   amc_float get_Rm() const;
 
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   amc_float Rm;
 };
 
+// `B name n+ n- V=<expression>` (or `I=`), linearized on the last trial with
+// the derivatives found along with its value. Currents on the expression are
+// measured by short circuits, each with a branch current after the one of the
+// source itself (voltage sources only).
+class BehavioralSource : public SimpleSourceElement {
+ public:
+  BehavioralSource(const std::string& name, int node_p, int node_n,
+                   bool voltage_output, const Expression& expression);
+  explicit BehavioralSource(Tokenizer params);
+  bool is_voltage_output() const;
+  const Expression& get_expression() const;
+
+  // The output nodes, then those of each control
+  virtual void append_nodes(std::vector<int>& nodes) const;
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
+  virtual int get_num_of_currents() const;
+  // The registers of the expression
+  virtual int get_num_of_states() const;
+  virtual void initialize_state(amc_float* state) const;
+  virtual void place_stamp(const StampParameters& p) const;
+
+ private:
+  bool voltage_output;
+  Expression expression;
+
+  void stamp_dependence(const StampParameters& p, int column,
+                        amc_float derivative) const;
+};
+
 class CurrentSource : public ArbitrarySourceElement {
  public:
   CurrentSource(const std::string& name, int node_p, int node_n,
                 Signal::Handler signal);
-  explicit CurrentSource(const std::string& params);
+  explicit CurrentSource(Tokenizer params);
 
+  virtual Element::Handler with_signal(Signal::Handler signal) const;
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual void place_stamp(const StampParameters&) const;
 };
 
 class VoltageSource : public ArbitrarySourceElement {
  public:
   VoltageSource(const std::string& name, int node_p, int node_n,
                 Signal::Handler signal);
-  explicit VoltageSource(const std::string& params);
+  explicit VoltageSource(Tokenizer params);
 
+  virtual Element::Handler with_signal(Signal::Handler signal) const;
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual void place_stamp(const StampParameters&) const;
 };
 
 class IdealOpAmp : public Element {
  public:
   IdealOpAmp(const std::string& name, int out_p, int out_n, int in_p, int in_n);
-  explicit IdealOpAmp(const std::string& params);
+  explicit IdealOpAmp(Tokenizer params);
 
   int get_out_p() const;
   int get_out_n() const;
   int get_in_p() const;
   int get_in_n() const;
 
+  virtual void append_nodes(std::vector<int>& nodes) const;
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
   virtual int get_num_of_currents() const;
-  virtual void place_stamp(const StampParameters&);
+  virtual void place_stamp(const StampParameters&) const;
 
  private:
   int out_p;
@@ -298,6 +555,31 @@ class IdealOpAmp : public Element {
   int in_n;
 };
 
+// Instance of a subcircuit defined on the netlist, the nodes are connected to
+// the subcircuit ports in order. It is replaced by the subcircuit elements when
+// the netlist is flattened, so it never places a stamp.
+// Example input:
+// X1 4 7 RCCELL
+class SubcircuitInstance : public Element {
+ public:
+  SubcircuitInstance(const std::string& name, const std::vector<int>& nodes,
+                     const std::string& subcircuit_name);
+  explicit SubcircuitInstance(Tokenizer params);
+
+  const std::vector<int>& get_nodes() const;
+  const std::string& get_subcircuit_name() const;
+
+  virtual void append_nodes(std::vector<int>& nodes) const;
+  virtual Element::Handler instantiate(const std::string& prefix,
+                                       NodeMap& nodes) const;
+  virtual int get_num_of_currents() const;
+  virtual void place_stamp(const StampParameters&) const;
+
+ private:
+  std::vector<int> nodes;
+  std::string subcircuit_name;
+};
+
 } // namespace amcircuit
 
 #endif //AMCIRCUIT_ELEMENT_H
@@ -0,0 +1,73 @@
+#ifndef AMCIRCUIT_EXPRESSION_H
+#define AMCIRCUIT_EXPRESSION_H
+
+#include <string>
+#include <vector>
+
+#include "AMCircuit.h"
+#include "Tokenizer.h"
+
+namespace amcircuit {
+
+// Arithmetic expression over node voltages (`V(a)`, `V(a, b)`), branch
+// currents (`I(a, b)`, through a short circuit from `a` to `b`) and `TIME`,
+// compiled once to a register bytecode.
+// Registers hold a value along with its derivatives on each control, which
+// every instruction finds from those of its operands (forward automatic
+// differentiation), so a single pass gives what is needed to linearize it.
+// The first registers are the controls, followed by time, the constants and
+// then the result of each instruction, in order. Instructions only read
+// registers before their own, constants are folded when compiling.
+class Expression {
+ public:
+  enum ControlType { VOLTAGE, CURRENT };
+  struct Control {
+    ControlType type;
+    int node_p;
+    int node_n;
+  };
+  enum Opcode { ADD, SUB, MUL, DIV, POW, MIN, MAX, NEG, EXP, LOG, SQRT, SIN,
+                COS, TAN, TANH, ATAN, ABS, NUM_OF_OPCODES };
+  // Unary operations read the same register twice
+  struct Instruction {
+    Opcode op;
+    int a;
+    int b;
+  };
+
+  // Named nodes are read with `line`, the tokenizer of the element
+  Expression(const std::string& text, const Tokenizer& line);
+  Expression(const std::string& text, const std::vector<Control>& controls,
+             const std::vector<amc_float>& constants,
+             const std::vector<Instruction>& program, int result);
+
+  const std::string& str() const;
+  const std::vector<Control>& get_controls() const;
+  const std::vector<amc_float>& get_constants() const;
+  const std::vector<Instruction>& get_program() const;
+  int get_result() const;
+  // The same expression on other controls, as its element on a subcircuit
+  Expression with_controls(const std::vector<Control>& controls) const;
+
+  // Room taken by the registers, values and derivatives
+  int get_num_of_registers() const;
+  // Sets the constants and derivatives that never change
+  void initialize_registers(amc_float* registers) const;
+  // Value at the controls on the first registers, `derivatives` pointing to
+  // its derivative on each control
+  amc_float evaluate(amc_float time, amc_float* registers,
+                     const amc_float*& derivatives) const;
+
+ private:
+  class Parser;
+
+  std::string text;
+  std::vector<Control> controls;
+  std::vector<amc_float> constants;
+  std::vector<Instruction> program;
+  int result;
+};
+
+}  // namespace amcircuit
+
+#endif  // AMCIRCUIT_EXPRESSION_H
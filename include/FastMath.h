@@ -0,0 +1,94 @@
+#ifndef AMCIRCUIT_FASTMATH_H
+#define AMCIRCUIT_FASTMATH_H
+
+#include <cstring>
+
+#include "AMCircuit.h"
+
+namespace amcircuit {
+
+// Elementary functions with no calls nor branches, so loops using them may be
+// vectorized. Integers are rounded by adding a number large enough to leave
+// them on the lowest mantissa bits.
+static const amc_float ROUNDING_SHIFTER = 6755399441055744.0; // 1.5 * 2^52
+
+// exp(x) within a couple of ulps. The argument is clamped to where the result
+// is a normal number. The integer nearest to x / ln(2) is moved from the
+// mantissa bits to the exponent of the scale factor.
+inline amc_float fast_exp(amc_float x) {
+  static const amc_float log2e = 1.4426950408889634;
+  static const amc_float ln2_high = 6.93147180369123816490e-01;
+  static const amc_float ln2_low = 1.90821492927058770002e-10;
+
+  x = x < -708.0 ? -708.0 : x;
+  x = x > 709.0 ? 709.0 : x;
+  const amc_float shifted = x * log2e + ROUNDING_SHIFTER;
+  const amc_float k = shifted - ROUNDING_SHIFTER;
+  const amc_float r = (x - k * ln2_high) - k * ln2_low; // |r| <= ln(2) / 2
+
+  // Taylor series, the first neglected term is below 3e-16
+  amc_float p = 1.0/479001600;
+  p = p * r + 1.0/39916800;
+  p = p * r + 1.0/3628800;
+  p = p * r + 1.0/362880;
+  p = p * r + 1.0/40320;
+  p = p * r + 1.0/5040;
+  p = p * r + 1.0/720;
+  p = p * r + 1.0/120;
+  p = p * r + 1.0/24;
+  p = p * r + 1.0/6;
+  p = p * r + 0.5;
+  p = p * r + 1.0;
+  p = p * r + 1.0;
+
+  unsigned long long bits;
+  memcpy(&bits, &shifted, sizeof(bits));
+  bits = (bits + 1023) << 52;
+  amc_float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+// sin(2 * pi * cycles) within a couple of ulps. Whole quarters of a cycle are
+// taken out exactly, leaving at most an eighth of a cycle for the series, and
+// pick which of sin and cos it is and their sign. The quarter is found without
+// integers, which would need instructions SSE2 lacks to select doubles.
+inline amc_float sin_of_cycles(amc_float cycles) {
+  static const amc_float two_pi = 6.28318530717958647693;
+
+  const amc_float shifted = cycles * 4 + ROUNDING_SHIFTER;
+  const amc_float quarters = shifted - ROUNDING_SHIFTER;
+  const amc_float r = (cycles - quarters * 0.25) * two_pi; // |r| <= pi/4
+  const amc_float r2 = r * r;
+
+  // Taylor series, the first neglected terms are below 1e-17
+  amc_float s = -1.0/355687428096000;
+  s = s * r2 + 1.0/1307674368000;
+  s = s * r2 - 1.0/6227020800;
+  s = s * r2 + 1.0/39916800;
+  s = s * r2 - 1.0/362880;
+  s = s * r2 + 1.0/5040;
+  s = s * r2 - 1.0/120;
+  s = s * r2 + 1.0/6;
+  s = r - s * r2 * r;
+  amc_float c = 1.0/6402373705728000;
+  c = c * r2 - 1.0/20922789888000;
+  c = c * r2 + 1.0/87178291200;
+  c = c * r2 - 1.0/479001600;
+  c = c * r2 + 1.0/3628800;
+  c = c * r2 - 1.0/40320;
+  c = c * r2 + 1.0/720;
+  c = c * r2 - 1.0/24;
+  c = c * r2 + 0.5;
+  c = 1 - c * r2;
+
+  // From -2 to 2, as quarters are rounded to the nearest multiple of 4
+  const amc_float quarter =
+      quarters - 4 * ((quarters * 0.25 + ROUNDING_SHIFTER) - ROUNDING_SHIFTER);
+  const amc_float value = (quarter == 1) | (quarter == -1) ? c : s;
+  return (quarter > 1.5) | (quarter < -0.5) ? -value : value;
+}
+
+}  // namespace amcircuit
+
+#endif  // AMCIRCUIT_FASTMATH_H
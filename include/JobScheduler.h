@@ -0,0 +1,57 @@
+#ifndef AMCIRCUIT_JOBSCHEDULER_H
+#define AMCIRCUIT_JOBSCHEDULER_H
+
+#include <deque>
+#include <vector>
+
+#include <pthread.h>
+
+namespace amcircuit {
+
+class Job {
+ public:
+  virtual ~Job();
+  // Must not throw, failures should be kept by the job itself
+  virtual void run() = 0;
+  // Only used to compare jobs, the larger ones are started first
+  virtual double get_cost_estimate() const;
+};
+
+// Work-stealing pool. Jobs are dealt among the workers, largest first, and
+// each worker runs its own queue from the front. A worker with an empty queue
+// steals from the back of another worker's queue, so long jobs started early
+// don't leave the other workers idle at the end.
+class JobScheduler {
+ public:
+  explicit JobScheduler(int num_workers);
+  ~JobScheduler();
+
+  // Jobs are not owned by the scheduler
+  void add_job(Job* job);
+  // Blocks until every job added is done
+  void run();
+  int get_num_workers() const;
+
+ private:
+  struct Worker {
+    JobScheduler* scheduler;
+    int id;
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    std::deque<Job*> jobs;
+  };
+
+  static void* worker_main(void* worker);
+  Job* take_job(int worker_id);
+
+  std::vector<Job*> pending_jobs;
+  std::vector<Worker> workers;
+
+  JobScheduler(const JobScheduler& other);
+  JobScheduler& operator=(const JobScheduler& other);
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_JOBSCHEDULER_H
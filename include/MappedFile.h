@@ -0,0 +1,32 @@
+#ifndef AMCIRCUIT_MAPPEDFILE_H
+#define AMCIRCUIT_MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+namespace amcircuit {
+
+// Read only view of a whole file. The file is memory mapped where that is
+// available, elsewhere it is read into memory.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& file_name);
+  ~MappedFile();
+
+  const char* begin() const;
+  const char* end() const;
+  size_t size() const;
+
+ private:
+  const char* data;
+  size_t length;
+  bool mapped;
+  std::string buffer;
+
+  MappedFile(const MappedFile& other);
+  MappedFile& operator=(const MappedFile& other);
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_MAPPEDFILE_H
@@ -8,15 +8,27 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <map>
 
 #include "Elements.h"
 #include "Statement.h"
+#include "Subcircuit.h"
 
 namespace amcircuit {
 
+// Large files are split at line boundaries and parsed by `num_workers` threads
+// (one per processor by default), the result is the same as parsing it
+// serially: elements and statements are kept in file order.
+// Subcircuits are kept as a single definition no matter how many instances
+// there are, the circuit is only flattened when it is about to be solved.
+// Nodes may be numbers or names, they are numbered again from 1 so unused
+// numbers take no room on the system. The first line is just a title.
+// With `use_cache` the parsed netlist is kept on `<file_name>.cache` and later
+// loaded from there, as long as the netlist file is left unchanged.
 class Netlist {
  public:
-  explicit Netlist(const std::string& file_name);
+  explicit Netlist(const std::string& file_name, int num_workers = 0,
+                   bool use_cache = false);
 //  Netlist(const Netlist& other);
 //  ~Netlist();
 //  Netlist& operator=(const Netlist& other);
@@ -25,17 +37,35 @@ class Netlist {
   const std::vector<Statement::Handler>& get_statements() const;
   std::vector<Statement::Handler>& get_statements();
   int get_number_of_nodes() const;
+  // Name of each node as written on the netlist, the ground first
+  const std::vector<std::string>& get_node_names() const;
+  const Subcircuit& get_subcircuit(const std::string& name) const;
+  // Elements with every subcircuit instance replaced by its elements, named
+  // `<instance>.<element>`. `node_names` gets the names of the nodes, internal
+  // nodes of the instances included (named `<instance>.<node>`).
+  std::vector<Element::Handler> get_flat_elements(
+      std::vector<std::string>& node_names) const;
+  void write_cache(const std::string& cache_file_name) const;
 
  private:
   const std::string file_name;
   std::string title;
-  int current_line;
-  int number_of_nodes;
+  int num_workers;
+  std::vector<std::string> node_names;
+  std::vector<std::string> named_nodes; // by id, named node `-(i + 1)` at `i`
   std::vector<Element::Handler> elements;
   std::vector<Statement::Handler> statements;
+  std::map<std::string, Subcircuit> subcircuits; // by upper case name
 
   void process_file();
-  void handle_line(const std::string& line);
+  void parse_lines(const char* begin, const char* end);
+  Subcircuit* add_statement(const Statement::Handler& statement,
+                            Subcircuit* subcircuit);
+  void renumber_nodes();
+  bool read_cache(const std::string& cache_file_name);
+  void flatten(const Element::Handler& element,
+               std::vector<Element::Handler>& flat_elements,
+               std::vector<std::string>& node_names, int depth) const;
 };
 
 }  // namespace amcircuit
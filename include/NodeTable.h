@@ -0,0 +1,50 @@
+#ifndef AMCIRCUIT_NODETABLE_H
+#define AMCIRCUIT_NODETABLE_H
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+namespace amcircuit {
+
+// Open addressing hash table giving ids to node names. Names get negative ids
+// (-1, -2, ...) in the order they are first seen, so they never clash with
+// numbered nodes.
+// A table may be backed by a shared one, it is then a cache of the shared
+// table: ids come from it and it is only locked for names not seen before.
+// This way threads parsing different parts of a netlist agree on the ids.
+class NodeTable {
+ public:
+  explicit NodeTable(NodeTable* shared = NULL);
+  ~NodeTable();
+
+  int get_id(const char* begin, const char* end);
+  // Names in id order, name of id `-(i + 1)` at `i` (on the shared table)
+  const std::vector<std::string>& get_names() const;
+
+ private:
+  struct Slot {
+    Slot() : hash(0), id(0) { }
+    unsigned hash;
+    int id; // 0 if the slot is empty
+    std::string name;
+  };
+
+  std::vector<Slot> slots;
+  unsigned num_used;
+  std::vector<std::string> names;
+  NodeTable* shared;
+  pthread_mutex_t lock;
+
+  int get_shared_id(const char* begin, const char* end);
+  unsigned find_slot(unsigned hash, const char* begin, const char* end) const;
+  void grow();
+
+  NodeTable(const NodeTable& other);
+  NodeTable& operator=(const NodeTable& other);
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_NODETABLE_H
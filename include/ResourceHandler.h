@@ -5,9 +5,15 @@
 #ifndef AMCIRCUIT_RESOURCEHANDLER_H
 #define AMCIRCUIT_RESOURCEHANDLER_H
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 // Template to handle resources
 // This works pretty similar to a smart pointer. The reason I didn't something
 // like `auto_ptr` here is that I didn't want to depend on C++11 or Boost.
+// The reference counter is updated atomically so that handlers pointing to the
+// same resource can be copied and destroyed from different threads.
 template<typename T>
 class ResourceHandler {
  public:
@@ -48,16 +54,29 @@ class ResourceHandler {
   void add(const ResourceHandler& other) {
     ref_counter = other.ref_counter;
     resource_ptr = other.resource_ptr;
-    (*ref_counter)++;
+    increment(ref_counter);
   }
   void remove() {
-    if (*ref_counter > 1) {
-      (*ref_counter)--;
-    } else {
+    if (decrement(ref_counter) == 0) {
       delete resource_ptr;
       delete ref_counter;
     }
   }
+#ifdef _MSC_VER
+  static int increment(int* counter) {
+    return _InterlockedIncrement(reinterpret_cast<volatile long*>(counter));
+  }
+  static int decrement(int* counter) {
+    return _InterlockedDecrement(reinterpret_cast<volatile long*>(counter));
+  }
+#else
+  static int increment(int* counter) {
+    return __sync_add_and_fetch(counter, 1);
+  }
+  static int decrement(int* counter) {
+    return __sync_sub_and_fetch(counter, 1);
+  }
+#endif
 };
 
 #endif //AMCIRCUIT_RESOURCEHANDLER_H
@@ -6,28 +6,32 @@
 #define AMCIRCUIT_SIGNAL_H
 
 #include <string>
-#include <sstream>
+#include <vector>
 #include <cmath>
 
 #include "AMCircuit.h"
+#include "FastMath.h"
 #include "ResourceHandler.h"
+#include "Tokenizer.h"
+#include "MappedFile.h"
 
 namespace amcircuit {
 
 class Signal {
  public:
   Signal();
-  Signal(const std::string& params);
   virtual ~Signal() = 0;
 
   typedef ResourceHandler<Signal> Handler;
   static Signal::Handler get_signal(std::string params);
-  static Signal::Handler get_signal(std::istream& stream);
+  // Reads the signal type and its parameters from the rest of the line
+  static Signal::Handler get_signal(Tokenizer& params);
 
   virtual amc_float get_value(amc_float time) const = 0;
-
- protected:
-  std::stringstream line_stream;
+  // Same, for callers evaluating the signal at times that mostly increase.
+  // They keep `cursor` between calls (starting at 0), so signals may resume
+  // from where they stopped rather than searching again.
+  virtual amc_float get_value_from(amc_float time, unsigned& cursor) const;
 
  private:
   explicit Signal(const Signal& other);
@@ -37,7 +41,7 @@ class Signal {
 class DC : public Signal {
  public:
   explicit DC(const amc_float value);
-  explicit DC(const std::string& params);
+  explicit DC(Tokenizer params);
 
   virtual amc_float get_value(amc_float time) const;
  private:
@@ -49,7 +53,7 @@ class Sin : public Signal {
   Sin(amc_float offset, amc_float amplitude, amc_float freq_hz,
       amc_float time_delay, amc_float damping_factor, amc_float phase_deg,
       int cycles);
-  explicit Sin(const std::string& params);
+  explicit Sin(Tokenizer params);
 
   amc_float get_offset() const;
   amc_float get_amplitude() const;
@@ -60,6 +64,17 @@ class Sin : public Signal {
   int get_cycles() const;
 
   virtual amc_float get_value(amc_float time) const;
+  // Same as `get_value`, with no calls nor branches so loops over many
+  // signals may be vectorized. The phase is in cycles.
+  static amc_float value_at(amc_float offset, amc_float amplitude,
+                            amc_float freq_hz, amc_float time_delay,
+                            amc_float damping_factor, amc_float phase_cycles,
+                            amc_float cycles, amc_float time) {
+    amc_float t = time > time_delay ? time - time_delay : 0;
+    t = t * freq_hz > cycles ? 0 : t;
+    return offset + amplitude * fast_exp(-damping_factor * t)
+                    * sin_of_cycles(freq_hz * t + phase_cycles);
+  }
 
  protected:
   amc_float offset;
@@ -69,8 +84,6 @@ class Sin : public Signal {
   amc_float damping_factor;
   amc_float phase_deg;
   int cycles;
-
-  static const amc_float PI;
 };
 
 class Pulse : public Signal {
@@ -78,7 +91,7 @@ class Pulse : public Signal {
   Pulse(amc_float initial, amc_float pulsed, amc_float delay_time,
         amc_float rise_time, amc_float fall_time, amc_float pulse_width,
         amc_float period, int cycles);
-  explicit Pulse(const std::string& params);
+  explicit Pulse(Tokenizer params);
 
   amc_float get_initial() const;
   amc_float get_pulsed() const;
@@ -90,6 +103,39 @@ class Pulse : public Signal {
   int get_cycles() const;
 
   virtual amc_float get_value(amc_float time) const;
+  // Same as `get_value`, for loops over many signals
+  static amc_float value_at(amc_float initial, amc_float pulsed,
+                            amc_float delay_time, amc_float rise_time,
+                            amc_float fall_time, amc_float pulse_width,
+                            amc_float period, int cycles, amc_float time) {
+    amc_float t;
+    if (time > period*cycles) {
+      t = 0;
+    } else {
+      t = fmod(time, period);
+    }
+
+    t -= delay_time;
+    if (t <= 0) {
+      return initial;
+    }
+
+    if (t < rise_time) {
+      return t * (pulsed - initial) / rise_time + initial;
+    }
+    t -= rise_time;
+
+    t -= pulse_width;
+    if (t <= 0) {
+      return pulsed;
+    }
+
+    if (t < fall_time) {
+      return t * (initial - pulsed) / fall_time + pulsed;
+    }
+
+    return initial;
+  }
 
  protected:
   amc_float initial;
@@ -102,6 +148,47 @@ class Pulse : public Signal {
   int cycles;
 };
 
+// Piecewise linear signal through `(time, value)` points, holding the first
+// and last values outside them. Points are given on the line (`PWL t0 v0 t1
+// v1 ...`) or on a file (`PWL FILE=<name>`): text files have the pairs
+// separated by whitespace or commas, `#` starting comments, while `.bin` files
+// have them as native floating point numbers and are used in place, memory
+// mapped, so only the pages around the time being simulated are read.
+class Pwl : public Signal {
+ public:
+  // `points` has each time followed by its value
+  explicit Pwl(const std::vector<amc_float>& points);
+  explicit Pwl(const std::string& file_name);
+  explicit Pwl(Tokenizer params);
+  virtual ~Pwl();
+
+  // Empty for points given on the line
+  const std::string& get_file_name() const;
+  unsigned get_num_of_points() const;
+  amc_float get_time(unsigned point) const;
+  amc_float get_point_value(unsigned point) const;
+
+  // Binary search over the points
+  virtual amc_float get_value(amc_float time) const;
+  // The cursor is the point starting the segment last used. It moves forward
+  // at most `PWL_CURSOR_MOVES` segments, a binary search finding the segment
+  // when time goes back or further ahead.
+  virtual amc_float get_value_from(amc_float time, unsigned& cursor) const;
+
+ private:
+  std::vector<amc_float> loaded_points;
+  std::string file_name;
+  MappedFile* file;
+  const amc_float* points;
+  unsigned num_points;
+
+  void load(const std::string& name);
+  void use_loaded_points();
+  void check_segment(unsigned segment) const;
+  unsigned find_segment(amc_float time) const;
+  amc_float interpolate(amc_float time, unsigned segment) const;
+};
+
 }  // namespace amcircuit
 
 #endif //AMCIRCUIT_SIGNAL_H
@@ -0,0 +1,55 @@
+#ifndef AMCIRCUIT_SOLVERSTATS_H
+#define AMCIRCUIT_SOLVERSTATS_H
+
+#include <vector>
+#include <iostream>
+
+#include "helpers.h"
+
+// Instrumentation may be compiled out by defining AMCIRCUIT_NO_STATS, leaving
+// only the Newton-Raphson iterations count, which is always kept
+#ifdef AMCIRCUIT_NO_STATS
+#define AMC_STATS(statement)
+#define AMC_STATS_TIMER(name, total)
+#else
+#define AMC_STATS(statement) statement
+#define AMC_STATS_TIMER(name, total) ScopeTimer name(total)
+#endif
+
+namespace amcircuit {
+
+// What the solver has done so far. A step is every point that had to converge:
+// transient steps, initial condition steps and DC sweep trials.
+struct SolverStats {
+  SolverStats();
+
+  void reset();
+  void add_step(int nr_iterations);
+  double get_mean_nr_iterations_per_step() const;
+
+  void write_summary(std::ostream& ostream) const;
+  void write_json(std::ostream& ostream) const;
+
+  // Wall time of each phase. The Newton-Raphson time includes assembly and
+  // factorization.
+  double assembly_s;
+  double factorization_s;
+  double newton_s;
+  double output_s;
+
+  long num_nr_iterations;
+  long num_steps;
+  long num_retries; // random restarts after Newton-Raphson failed
+  long num_switch_events; // points solved again as switches changed
+  int max_nr_iterations_per_step;
+  // `nr_iterations_histogram[i]` steps took `i` iterations to converge
+  std::vector<long> nr_iterations_histogram;
+
+  int system_size;
+  long num_nonzeros; // on the first assembled matrix
+  long peak_memory_kb;
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_SOLVERSTATS_H
@@ -6,24 +6,21 @@
 #define AMCIRCUIT_STATEMENT_H
 
 #include <string>
-#include <sstream>
+#include <vector>
 
 #include "AMCircuit.h"
 #include "ResourceHandler.h"
+#include "Tokenizer.h"
 
 namespace amcircuit {
 
 class Statement {
  public:
   Statement();
-  Statement(const std::string& params);
   virtual ~Statement() = 0;
 
   typedef ResourceHandler<Statement> Handler;
-  static Statement::Handler get_statement(std::string params);
-
- protected:
-  std::stringstream line_stream;
+  static Statement::Handler get_statement(Tokenizer params);
 
  private:
   Statement(const Statement& other);
@@ -40,7 +37,7 @@ class Tran : public Statement {
  public:
   explicit Tran(amc_float t_stop_s, amc_float t_step_s, int admo_order,
                 int internal_steps);
-  explicit Tran(const std::string& params);
+  explicit Tran(Tokenizer params);
 
   amc_float get_t_stop_s() const;
   amc_float get_t_step_s() const;
@@ -56,6 +53,75 @@ class Tran : public Statement {
   bool uic;
 };
 
+
+// Periodic steady state through shooting-Newton. Integration is done just as
+// in `TRAN`, over a single period, until the state of capacitors and inductors
+// at the end of the period matches the one at the beginning.
+// Example input:
+// .PSS 1E-3 5E-6 ADMO3 1
+class PeriodicSteadyState : public Tran {
+ public:
+  explicit PeriodicSteadyState(amc_float period_s, amc_float t_step_s,
+                               int admo_order, int internal_steps);
+  explicit PeriodicSteadyState(Tokenizer params);
+
+  amc_float get_period_s() const;
+};
+
+
+// DC sweep of an independent source (`V` or `I`). Reactive elements are
+// replaced by their DC equivalents and each point starts Newton-Raphson from
+// the previous solution, halving the step locally when convergence is hard.
+// Example input:
+// .DC V0200 0 10 0.5
+class DCSweep : public Statement {
+ public:
+  explicit DCSweep(const std::string& source_name, amc_float start,
+                   amc_float stop, amc_float step);
+  explicit DCSweep(Tokenizer params);
+
+  const std::string& get_source_name() const;
+  amc_float get_start() const;
+  amc_float get_stop() const;
+  amc_float get_step() const;
+  int get_num_points() const;
+
+ private:
+  std::string source_name;
+  amc_float start;
+  amc_float stop;
+  amc_float step;
+  void validate() const;
+};
+
+
+// Starts a subcircuit definition, every element up to the matching `.ENDS`
+// belongs to it. Followed by the subcircuit name and its ports.
+// Example input:
+// .SUBCKT RCCELL 1 2
+class SubcircuitBegin : public Statement {
+ public:
+  explicit SubcircuitBegin(const std::string& name,
+                           const std::vector<int>& ports);
+  explicit SubcircuitBegin(Tokenizer params);
+
+  const std::string& get_name() const;
+  const std::vector<int>& get_ports() const;
+
+ private:
+  std::string name;
+  std::vector<int> ports;
+};
+
+
+// Ends the current subcircuit definition
+// Example input:
+// .ENDS
+class SubcircuitEnd : public Statement {
+ public:
+  SubcircuitEnd();
+};
+
 } // namespace amcircuit
 
 #endif //AMCIRCUIT_STATEMENT_H
@@ -0,0 +1,56 @@
+#ifndef AMCIRCUIT_SUBCIRCUIT_H
+#define AMCIRCUIT_SUBCIRCUIT_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "Elements.h"
+
+namespace amcircuit {
+
+// A `.SUBCKT` definition, parsed once and shared by all its instances. Nodes
+// are local to the definition: the ports are connected to the nodes of each
+// instance, the ground is global and any other node is internal.
+// Example input:
+// .SUBCKT RCCELL 1 2
+// R1 1 3 1E3
+// C1 3 2 1E-6
+// .ENDS
+class Subcircuit {
+ public:
+  Subcircuit(const std::string& name, const std::vector<int>& ports);
+
+  const std::string& get_name() const;
+  const std::vector<int>& get_ports() const;
+  const std::vector<Element::Handler>& get_elements() const;
+  void add_element(Element::Handler element);
+
+ private:
+  std::string name;
+  std::vector<int> ports;
+  std::vector<Element::Handler> elements;
+};
+
+// Maps the nodes of elements to those of the flattened circuit. Nodes that were
+// not added are new nodes: they are appended to `node_names` as they are first
+// seen, named `prefix` followed by their number or, for named nodes, their
+// name on `local_names`.
+class NodeMap {
+ public:
+  NodeMap(std::vector<std::string>& node_names, const std::string& prefix,
+          const std::vector<std::string>& local_names);
+
+  void add(int node, int mapped_node);
+  int map(int node);
+
+ private:
+  std::map<int, int> mapped_nodes;
+  std::vector<std::string>& node_names;
+  const std::string prefix;
+  const std::vector<std::string>& local_names;
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_SUBCIRCUIT_H
@@ -0,0 +1,68 @@
+#ifndef AMCIRCUIT_TOKENIZER_H
+#define AMCIRCUIT_TOKENIZER_H
+
+#include <string>
+
+#include "AMCircuit.h"
+
+namespace amcircuit {
+
+class NodeTable;
+
+// Node read with `tokens >> as_node(node)`
+struct NodeField {
+  explicit NodeField(int& id) : id(id) { }
+  int& id;
+};
+
+inline NodeField as_node(int& id) {
+  return NodeField(id);
+}
+
+// Reads whitespace separated values from a line without copying it. It is used
+// just like an input stream: values are read with `>>` and a failed read fails
+// every read after it, which can be checked converting it to bool.
+// Numbers are read the same way streams do, only the longest prefix that is a
+// valid number is consumed and the rest is left for the next read.
+// The characters are not owned, they must outlive the tokenizer.
+// Nodes are numbers or names, `0` and `GND` being the ground. Names are only
+// accepted if there is a node table to give them ids.
+class Tokenizer {
+ public:
+  Tokenizer(const char* begin, const char* end, NodeTable* node_table = NULL);
+  Tokenizer(const char* line);
+  Tokenizer(const std::string& line);
+
+  Tokenizer& operator>>(amc_float& value);
+  Tokenizer& operator>>(int& value);
+  Tokenizer& operator>>(std::string& value);
+  Tokenizer& operator>>(const NodeField& node);
+
+  operator bool() const;
+  bool operator!() const;
+
+  // First character of the line, whitespace included ('\0' if it is empty)
+  char first() const;
+  // Whether only whitespace is left
+  bool at_end();
+  // Whatever is left on the line, without the surrounding whitespace
+  std::string rest();
+  // Tokenizer over part of the line, or of a field read from it, giving ids to
+  // node names from the same table
+  Tokenizer part(const char* part_begin, const char* part_end) const;
+  // The whole line, as used on error messages
+  std::string str() const;
+
+ private:
+  const char* begin;
+  const char* end;
+  const char* position;
+  bool failed;
+  NodeTable* node_table;
+
+  void skip_whitespace();
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_TOKENIZER_H
@@ -0,0 +1,80 @@
+#ifndef AMCIRCUIT_TRACER_H
+#define AMCIRCUIT_TRACER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "AMCircuit.h"
+#include "helpers.h"
+
+// Spans are compiled out with the rest of the instrumentation
+#ifdef AMCIRCUIT_NO_STATS
+#define AMC_TRACE(name, tracer, span_name, sim_time, index)
+#else
+#define AMC_TRACE(name, tracer, span_name, sim_time, index) \
+  TraceSpan name(tracer, span_name, sim_time, index)
+#endif
+
+namespace amcircuit {
+
+// Keeps the last `capacity` spans of solver activity on a ring buffer, older
+// spans are overwritten. Spans are written as Chrome trace events, which may
+// be opened on chrome://tracing or Perfetto.
+class Tracer {
+ public:
+  explicit Tracer(int capacity = TRACE_BUFFER_SPANS);
+
+  // `name` must outlive the tracer, string literals are expected. `index` is
+  // written only if not negative (e.g. the Newton-Raphson iteration).
+  void add_span(const char* name, double start_s, double end_s,
+                amc_float sim_time, int index);
+
+  void write_chrome_trace(std::ostream& ostream) const;
+  void write_to_file(const std::string& file_name) const;
+
+  int get_num_spans() const;
+  long get_num_dropped() const;
+
+ private:
+  struct Span {
+    const char* name;
+    double start_s;
+    double duration_s;
+    amc_float sim_time;
+    int index;
+  };
+
+  std::vector<Span> spans;
+  int next_span;
+  long num_recorded;
+  double origin_s;
+};
+
+// Adds a span to the tracer from construction to destruction. Does nothing
+// without a tracer.
+class TraceSpan {
+ public:
+  TraceSpan(Tracer* tracer, const char* name, amc_float sim_time,
+            int index = -1)
+      : tracer(tracer), name(name), sim_time(sim_time), index(index),
+        start_s(tracer != NULL ? get_wall_time_s() : 0) { }
+  ~TraceSpan() {
+    if (tracer != NULL) {
+      tracer->add_span(name, start_s, get_wall_time_s(), sim_time, index);
+    }
+  }
+
+ private:
+  Tracer* tracer;
+  const char* name;
+  amc_float sim_time;
+  int index;
+  double start_s;
+  TraceSpan(const TraceSpan& other);
+  TraceSpan& operator=(const TraceSpan& other);
+};
+
+}  // namespace amcircuit
+
+#endif //AMCIRCUIT_TRACER_H
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "AMCircuit.h"
 
@@ -16,8 +17,44 @@ std::string str_upper(std::string);
 
 std::string get_executable_path();
 
+// Seconds from an arbitrary point, only differences are meaningful
+double get_wall_time_s();
+
+// Adds the wall time spent on its scope to `total`
+class ScopeTimer {
+ public:
+  explicit ScopeTimer(double& total) : total(total), start(get_wall_time_s()) { }
+  ~ScopeTimer() { total += get_wall_time_s() - start; }
+ private:
+  double& total;
+  double start;
+  ScopeTimer(const ScopeTimer& other);
+  ScopeTimer& operator=(const ScopeTimer& other);
+};
+
+// Largest resident set size the process has had so far
+long get_peak_memory_kb();
+
+int get_num_processors();
+
+// Files on `directory` whose names end with `extension`, sorted by name
+std::vector<std::string> list_directory(const std::string& directory,
+                                        const std::string& extension);
+
+bool is_directory(const std::string& path);
+
+// Enough to tell whether a file changed
+struct FileStamp {
+  FileStamp() : size_bytes(0), modified(0) { }
+  long long size_bytes;
+  long long modified; // in nanoseconds, 100 ns units on Windows
+};
+
+// False if the file does not exist
+bool get_file_stamp(const std::string& path, FileStamp& stamp);
+
 #define to_str( x ) static_cast< std::ostringstream & >( \
-  ( std::ostringstream() << std::dec << x ) ).str()
+  ( std::ostringstream().flush() << std::dec << x ) ).str()
 
 // C style function to allocate arbitrary dimension arrays
 // It allocates arrays in a way that can be passed to functions easily
@@ -0,0 +1,328 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+
+#include "BatchRunner.h"
+#include "helpers.h"
+
+using namespace amcircuit;
+
+static const int default_repetitions = 3;
+// A run is slower than its baseline if it takes more than
+// `time_factor * baseline + time_slack_s`, the slack keeps very short runs
+// from failing because of noise. Run times are only checked when a factor is
+// given, as those on the baseline were measured on a single machine.
+static const double time_slack_s = 0.05;
+// Same for the Newton-Raphson iterations, which only change when the solver
+// does (or on random restarts)
+static const double default_iterations_factor = 1.1;
+static const long iterations_slack = 10;
+
+struct RegressionOptions {
+  std::string support_directory;
+  std::string baseline_file_name;
+  int repetitions;
+  double time_factor; // run times are not checked if not positive
+  double iterations_factor;
+  bool update;
+};
+
+// Reference values for a netlist. Results are compared against
+// `expected_data/<netlist>.tab` only when a tolerance is given.
+struct Baseline {
+  Baseline() : should_fail(false), tolerance(-1), wall_s(0),
+               nr_iterations(0) { }
+
+  bool should_fail;
+  double tolerance; // on the error relative to the largest expected value
+  double wall_s;
+  long nr_iterations;
+};
+
+typedef std::map<std::string, Baseline> Baselines;
+
+struct Table {
+  std::vector<std::string> header;
+  std::vector<std::vector<amc_float> > rows;
+};
+
+void show_usage(std::string program_name) {
+  std::cout << "usage: " << program_name << " [--support dir] "
+            << "[--baseline file] [--repeat n] [--time-factor x] "
+            << "[--iterations-factor x] [--update]" << std::endl;
+}
+
+bool parse_options(int argc, char const *argv[], RegressionOptions& options) {
+  options.support_directory = get_executable_path() + "/../test/support";
+  options.repetitions = default_repetitions;
+  options.time_factor = 0;
+  options.iterations_factor = default_iterations_factor;
+  options.update = false;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--update") {
+      options.update = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--support") {
+      options.support_directory = value;
+    } else if (arg == "--baseline") {
+      options.baseline_file_name = value;
+    } else if (arg == "--repeat") {
+      options.repetitions = atoi(value.c_str());
+    } else if (arg == "--time-factor") {
+      options.time_factor = atof(value.c_str());
+    } else if (arg == "--iterations-factor") {
+      options.iterations_factor = atof(value.c_str());
+    } else {
+      return false;
+    }
+  }
+  if (options.baseline_file_name.empty()) {
+    options.baseline_file_name = options.support_directory
+                                 + "/regression_baseline.txt";
+  }
+  return options.repetitions > 0;
+}
+
+std::string base_name_of(const std::string& path) {
+  std::string::size_type begin = path.find_last_of("\\/");
+  begin = begin == std::string::npos ? 0 : begin + 1;
+  std::string::size_type end = path.find_last_of('.');
+  return path.substr(begin, end == std::string::npos || end < begin
+                            ? std::string::npos : end - begin);
+}
+
+// One netlist per line: name, `ok` or `fail`, tolerance (`-` for none), wall
+// time and Newton-Raphson iterations. Lines starting with `#` are ignored.
+Baselines read_baselines(const std::string& file_name) {
+  Baselines baselines;
+  std::ifstream data(file_name.c_str());
+  std::string line;
+  while (std::getline(data, line)) {
+    std::stringstream line_stream(line);
+    std::string name, status, tolerance;
+    if (!(line_stream >> name) || name[0] == '#') {
+      continue;
+    }
+    Baseline& baseline = baselines[name];
+    line_stream >> status >> tolerance >> baseline.wall_s
+                >> baseline.nr_iterations;
+    baseline.should_fail = status == "fail";
+    baseline.tolerance = tolerance == "-" ? -1 : atof(tolerance.c_str());
+  }
+  return baselines;
+}
+
+void write_baselines(const std::string& file_name,
+                     const Baselines& baselines) {
+  std::ofstream data(file_name.c_str());
+  data << "# netlist status tolerance wall_s nr_iterations" << std::endl;
+  for (Baselines::const_iterator it = baselines.begin(); it != baselines.end();
+       ++it) {
+    const Baseline& baseline = it->second;
+    data << it->first << " " << (baseline.should_fail ? "fail" : "ok") << " ";
+    if (baseline.tolerance < 0) {
+      data << "-";
+    } else {
+      data << baseline.tolerance;
+    }
+    data << " " << baseline.wall_s << " " << baseline.nr_iterations
+         << std::endl;
+  }
+}
+
+bool read_table(const std::string& file_name, Table& table) {
+  std::ifstream data(file_name.c_str());
+  std::string line;
+  if (!std::getline(data, line)) {
+    return false;
+  }
+  std::stringstream header_stream(line);
+  std::string name;
+  while (header_stream >> name) {
+    table.header.push_back(name);
+  }
+  while (std::getline(data, line)) {
+    std::stringstream line_stream(line);
+    std::vector<amc_float> row;
+    amc_float value;
+    while (line_stream >> value) {
+      row.push_back(value);
+    }
+    if (row.size() == table.header.size()) {
+      table.rows.push_back(row);
+    }
+  }
+  return !table.rows.empty();
+}
+
+// Largest difference between the columns present on both tables, relative to
+// the largest expected value. Expected values are interpolated at the result
+// abscissas, so tables need not share the same points. Returns a negative
+// value if nothing could be compared.
+double relative_error(const Table& expected, const Table& result) {
+  std::vector<int> columns(result.header.size(), -1);
+  for (unsigned i = 1; i < result.header.size(); ++i) {
+    for (unsigned j = 1; j < expected.header.size(); ++j) {
+      if (str_upper(result.header[i]) == str_upper(expected.header[j])) {
+        columns[i] = j;
+      }
+    }
+  }
+
+  double max_error = 0;
+  double scale = 0;
+  bool compared = false;
+  unsigned cursor = 0;
+  for (unsigned row = 0; row < result.rows.size(); ++row) {
+    const amc_float x = result.rows[row][0];
+    while (cursor + 1 < expected.rows.size() &&
+           expected.rows[cursor + 1][0] < x) {
+      ++cursor;
+    }
+    if (cursor + 1 >= expected.rows.size() || x < expected.rows[cursor][0]) {
+      continue;
+    }
+    const std::vector<amc_float>& before = expected.rows[cursor];
+    const std::vector<amc_float>& after = expected.rows[cursor + 1];
+    const amc_float span = after[0] - before[0];
+    const amc_float weight = span > 0 ? (x - before[0]) / span : 0;
+    for (unsigned i = 1; i < columns.size(); ++i) {
+      if (columns[i] < 0) {
+        continue;
+      }
+      const amc_float value = before[columns[i]]
+          + weight * (after[columns[i]] - before[columns[i]]);
+      max_error = std::max(max_error, std::abs(value - result.rows[row][i]));
+      scale = std::max(scale, std::abs(value));
+      compared = true;
+    }
+  }
+  if (!compared) {
+    return -1;
+  }
+  return scale > 0 ? max_error / scale : max_error;
+}
+
+// Runs every netlist on the support directory, returning how many regressed
+int run_regression(const RegressionOptions& options, Baselines& baselines,
+                   std::ostream& report) {
+  const std::vector<std::string> netlists =
+      list_directory(options.support_directory, ".net");
+  int num_regressions = 0;
+
+  report << "netlist status error wall_s (baseline) nr_iterations (baseline) "
+         << "verdict" << std::endl;
+  for (unsigned i = 0; i < netlists.size(); ++i) {
+    const std::string name = base_name_of(netlists[i]);
+    const std::string output_file_name = options.support_directory
+        + "/result_data/" + name + ".tab";
+
+    // The fastest repetition is the least disturbed by everything else
+    NetlistJob job(netlists[i], output_file_name);
+    job.run();
+    double wall_s = job.get_run_time_s();
+    for (int repetition = 1; repetition < options.repetitions; ++repetition) {
+      NetlistJob repeated_job(netlists[i], output_file_name);
+      repeated_job.run();
+      wall_s = std::min(wall_s, repeated_job.get_run_time_s());
+    }
+
+    const bool has_baseline = baselines.count(name) > 0;
+    Baseline& baseline = baselines[name];
+    std::vector<std::string> problems;
+    if (!has_baseline) {
+      baseline.should_fail = !job.succeeded();
+      problems.push_back("no baseline");
+    } else if (job.succeeded() == baseline.should_fail) {
+      problems.push_back(job.succeeded() ? "should fail"
+                                         : "failed: " + job.get_error());
+    }
+
+    double error = -1;
+    Table expected, result;
+    if (job.succeeded() &&
+        read_table(options.support_directory + "/expected_data/" + name
+                   + ".tab", expected) &&
+        read_table(output_file_name, result)) {
+      error = relative_error(expected, result);
+    }
+    if (baseline.tolerance >= 0 && (error < 0 || error > baseline.tolerance)) {
+      problems.push_back(error < 0 ? "nothing to compare" : "inaccurate");
+    }
+
+    if (has_baseline && job.succeeded()) {
+      if (options.time_factor > 0 &&
+          wall_s > baseline.wall_s * options.time_factor + time_slack_s) {
+        problems.push_back("slower");
+      }
+      if (job.get_num_nr_iterations() >
+          baseline.nr_iterations * options.iterations_factor
+          + iterations_slack) {
+        problems.push_back("more iterations");
+      }
+    }
+
+    report << name << " " << (job.succeeded() ? "ok" : "fail") << " ";
+    if (error < 0) {
+      report << "-";
+    } else {
+      report << error;
+    }
+    report << " " << wall_s << " (" << baseline.wall_s << ") "
+           << job.get_num_nr_iterations() << " (" << baseline.nr_iterations
+           << ") ";
+    if (problems.empty()) {
+      report << "pass";
+    } else {
+      report << "REGRESSED:";
+      for (unsigned j = 0; j < problems.size(); ++j) {
+        report << (j > 0 ? ", " : " ") << problems[j];
+      }
+      ++num_regressions;
+    }
+    report << std::endl;
+
+    if (options.update) {
+      baseline.wall_s = wall_s;
+      baseline.nr_iterations = job.get_num_nr_iterations();
+    }
+  }
+  report << "total: " << netlists.size() << " netlists, " << num_regressions
+         << " regressed" << std::endl;
+  return num_regressions;
+}
+
+int main(int argc, char const *argv[]) {
+  RegressionOptions options;
+  if (!parse_options(argc, argv, options)) {
+    show_usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    Baselines baselines = read_baselines(options.baseline_file_name);
+    const int num_regressions = run_regression(options, baselines, std::cout);
+    if (options.update) {
+      write_baselines(options.baseline_file_name, baselines);
+      std::cout << "Baseline written to " << options.baseline_file_name
+                << std::endl;
+      return 0;
+    }
+    return num_regressions > 0;
+  } catch (const std::exception& e) {
+    std::cout << "Error: " << e.what() << std::endl;
+  }
+  return 1;
+}
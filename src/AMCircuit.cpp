@@ -3,42 +3,116 @@
 //
 
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <vector>
+#include <cstdlib>
 
 #include "Netlist.h"
 #include "CircuitSolver.h"
+#include "BatchRunner.h"
+#include "Tracer.h"
 #include "helpers.h"
 
 using namespace amcircuit;
 
 void show_usage(std::string program_name) {
-  std::cout << "usage: " << program_name << " <netlist_file> [output_file]"
-            << std::endl;
+  std::cout << "usage: " << program_name << " [--stats] [--stats-json file] "
+            << "[--trace file] [--cache] <netlist_file> [output_file]"
+            << std::endl
+            << "       " << program_name << " --batch [-j workers] "
+            << "[-o output_dir] <netlist|directory|manifest>..." << std::endl;
+}
+
+int run_batch(int argc, char const *argv[]) {
+  int num_workers = get_num_processors();
+  std::string output_directory;
+  std::vector<std::string> inputs;
+
+  for (int i = 2; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      num_workers = atoi(argv[++i]);
+    } else if (arg == "-o" && i + 1 < argc) {
+      output_directory = argv[++i];
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  if (inputs.empty() || num_workers < 1) {
+    show_usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    BatchRunner batch(inputs, output_directory, num_workers);
+    batch.run();
+    batch.write_report(std::cout);
+    return batch.get_num_failed() > 0;
+  } catch (const std::exception& e) {
+    std::cout << "Error: " << e.what() << std::endl;
+  }
+  return 1;
 }
 
 int main(int argc, char const *argv[]) {
-  if (argc < 2 || argc > 3) {
+  if (argc >= 2 && std::string(argv[1]) == "--batch") {
+    return run_batch(argc, argv);
+  }
+
+  bool print_stats = false;
+  bool use_cache = false;
+  std::string stats_file_name;
+  std::string trace_file_name;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--stats") {
+      print_stats = true;
+    } else if (arg == "--stats-json" && i + 1 < argc) {
+      stats_file_name = argv[++i];
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_file_name = argv[++i];
+    } else if (arg == "--cache") {
+      use_cache = true;
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  if (files.empty() || files.size() > 2) {
     show_usage(argv[0]);
     return 1;
   }
 
-  const std::string netlist_file_name = argv[1];
+  const std::string netlist_file_name = files[0];
   std::string output_file_name;
-  if (argc == 2) {
+  if (files.size() == 1) {
     output_file_name = netlist_file_name + ".tab";
   } else {
-    output_file_name = argv[2];
+    output_file_name = files[1];
   }
 
   try {
-    Netlist nl = Netlist(netlist_file_name);
-    CircuitSolver cs(&nl);
+    Netlist nl = Netlist(netlist_file_name, 0, use_cache);
+    Tracer tracer(trace_file_name.empty() ? 1 : TRACE_BUFFER_SPANS);
+    CircuitSolver cs(&nl, trace_file_name.empty() ? NULL : &tracer);
     cs.write_to_file(output_file_name);
+    if (!trace_file_name.empty()) {
+      tracer.write_to_file(trace_file_name);
+    }
+
+    const SolverStats stats = cs.get_stats();
+    if (print_stats) {
+      stats.write_summary(std::cout);
+    }
+    if (!stats_file_name.empty()) {
+      std::ofstream stats_file(stats_file_name.c_str());
+      stats.write_json(stats_file);
+    }
   } catch (const std::exception& e) {
     std::cout << "Error: " << e.what() << std::endl;
   }
 
-
-
   return 0;
 }
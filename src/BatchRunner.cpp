@@ -0,0 +1,224 @@
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+
+#include "BatchRunner.h"
+#include "Netlist.h"
+#include "CircuitSolver.h"
+#include "AMCircuitException.h"
+#include "helpers.h"
+
+namespace amcircuit {
+
+inline std::string directory_of(const std::string& path) {
+  std::string::size_type pos = path.find_last_of("\\/");
+  return pos == std::string::npos ? "" : path.substr(0, pos + 1);
+}
+
+inline std::string base_name_of(const std::string& path) {
+  std::string::size_type pos = path.find_last_of("\\/");
+  return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+inline bool ends_with(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+         str_upper(str.substr(str.size() - suffix.size())) == str_upper(suffix);
+}
+
+NetlistJob::NetlistJob(const std::string& netlist_file_name,
+                       const std::string& output_file_name)
+    : netlist_file_name(netlist_file_name), output_file_name(output_file_name),
+      success(false), run_time_s(0), num_nr_iterations(0),
+      allocated_bytes(0) {
+  cost_estimate = estimate_cost();
+}
+
+void NetlistJob::run() {
+  double start = get_wall_time_s();
+  try {
+    // Jobs already run in parallel, so each netlist is parsed serially
+    Netlist nl = Netlist(netlist_file_name, 1);
+    CircuitSolver cs(&nl);
+    cs.write_to_file(output_file_name);
+    num_nr_iterations = cs.get_num_nr_iterations();
+    allocated_bytes = cs.get_allocated_bytes();
+    success = true;
+  } catch (const std::exception& e) {
+    error = e.what();
+  } catch (...) {
+    error = "Unknown error";
+  }
+  run_time_s = get_wall_time_s() - start;
+}
+
+double NetlistJob::get_cost_estimate() const {
+  return cost_estimate;
+}
+
+// The system is solved densely, so each step costs about the cube of the number
+// of lines. Only the first line and the analysis statement are looked at.
+double NetlistJob::estimate_cost() const {
+  std::ifstream data(netlist_file_name.c_str());
+  std::string line;
+  if (!std::getline(data, line)) {
+    return 0;
+  }
+  double size = atoi(line.c_str());
+  double steps = 1;
+  while (std::getline(data, line)) {
+    if (line.empty() || line[0] == '*') {
+      continue;
+    }
+    if (line[0] != '.') {
+      ++size;
+      continue;
+    }
+    std::stringstream statement(line);
+    std::string type;
+    amc_float a, b, c;
+    statement >> type >> a >> b;
+    type = str_upper(type);
+    if ((type == ".TRAN" || type == ".PSS") && b > 0) {
+      steps = a / b;
+    } else if (type == ".DC" && statement >> c && c != 0) {
+      steps = std::abs((b - a) / c);
+    }
+  }
+  return size * size * size * steps;
+}
+
+const std::string& NetlistJob::get_netlist_file_name() const {
+  return netlist_file_name;
+}
+
+const std::string& NetlistJob::get_output_file_name() const {
+  return output_file_name;
+}
+
+bool NetlistJob::succeeded() const {
+  return success;
+}
+
+const std::string& NetlistJob::get_error() const {
+  return error;
+}
+
+double NetlistJob::get_run_time_s() const {
+  return run_time_s;
+}
+
+long NetlistJob::get_num_nr_iterations() const {
+  return num_nr_iterations;
+}
+
+long NetlistJob::get_allocated_bytes() const {
+  return allocated_bytes;
+}
+
+BatchRunner::BatchRunner(const std::vector<std::string>& inputs,
+                         const std::string& output_directory, int num_workers)
+    : output_directory(output_directory), num_workers(num_workers),
+      wall_time_s(0) {
+  for (unsigned i = 0; i < inputs.size(); ++i) {
+    add_input(inputs[i]);
+  }
+}
+
+BatchRunner::~BatchRunner() {
+  for (unsigned i = 0; i < jobs.size(); ++i) {
+    delete jobs[i];
+  }
+}
+
+void BatchRunner::add_input(const std::string& input) {
+  if (is_directory(input)) {
+    std::vector<std::string> netlists = list_directory(input, ".net");
+    for (unsigned i = 0; i < netlists.size(); ++i) {
+      add_netlist(netlists[i]);
+    }
+  } else if (ends_with(input, ".net")) {
+    add_netlist(input);
+  } else {
+    add_manifest(input);
+  }
+}
+
+void BatchRunner::add_manifest(const std::string& manifest_file_name) {
+  std::ifstream data(manifest_file_name.c_str());
+  if (!data) {
+    throw FileNotFound("Cannot open file \"" + manifest_file_name + "\"");
+  }
+  const std::string base_directory = directory_of(manifest_file_name);
+  std::string line;
+  while (std::getline(data, line)) {
+    std::stringstream line_stream(line);
+    std::string netlist_file_name, output_file_name;
+    if (!(line_stream >> netlist_file_name) || netlist_file_name[0] == '#' ||
+        netlist_file_name[0] == '*') {
+      continue;
+    }
+    if (netlist_file_name[0] != '/') {
+      netlist_file_name = base_directory + netlist_file_name;
+    }
+    if (line_stream >> output_file_name && output_file_name[0] != '/') {
+      output_file_name = base_directory + output_file_name;
+    }
+    add_netlist(netlist_file_name, output_file_name);
+  }
+}
+
+void BatchRunner::add_netlist(const std::string& netlist_file_name,
+                              const std::string& output_file_name) {
+  std::string output = output_file_name;
+  if (output.empty()) {
+    output = output_directory.empty()
+             ? netlist_file_name + ".tab"
+             : output_directory + "/" + base_name_of(netlist_file_name)
+               + ".tab";
+  }
+  jobs.push_back(new NetlistJob(netlist_file_name, output));
+}
+
+void BatchRunner::run() {
+  double start = get_wall_time_s();
+  JobScheduler scheduler(num_workers);
+  for (unsigned i = 0; i < jobs.size(); ++i) {
+    scheduler.add_job(jobs[i]);
+  }
+  scheduler.run();
+  wall_time_s = get_wall_time_s() - start;
+}
+
+void BatchRunner::write_report(std::ostream& ostream) const {
+  ostream << "netlist status wall_s nr_iterations memory_kb" << std::endl;
+  for (unsigned i = 0; i < jobs.size(); ++i) {
+    const NetlistJob& job = *jobs[i];
+    ostream << job.get_netlist_file_name() << " "
+            << (job.succeeded() ? "ok" : "failed") << " "
+            << job.get_run_time_s() << " " << job.get_num_nr_iterations()
+            << " " << job.get_allocated_bytes() / 1024;
+    if (!job.succeeded()) {
+      ostream << " \"" << job.get_error() << "\"";
+    }
+    ostream << std::endl;
+  }
+  ostream << "total: " << jobs.size() << " jobs, " << get_num_failed()
+          << " failed, " << wall_time_s << " s on " << num_workers
+          << " workers, process peak memory " << get_peak_memory_kb() << " kB"
+          << std::endl;
+}
+
+int BatchRunner::get_num_jobs() const {
+  return jobs.size();
+}
+
+int BatchRunner::get_num_failed() const {
+  int num_failed = 0;
+  for (unsigned i = 0; i < jobs.size(); ++i) {
+    num_failed += !jobs[i]->succeeded();
+  }
+  return num_failed;
+}
+
+}  // namespace amcircuit
@@ -2,13 +2,13 @@
 // Created by Hugo Sadok on 2/13/16.
 //
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
 #include <ctime>
 #include <cstring>
-#include <CircuitSolver.h>
 
 #include "CircuitSolver.h"
 #include "Elements.h"
@@ -21,20 +21,43 @@
 namespace amcircuit {
 
 
-CircuitSolver::CircuitSolver(Netlist* netlist)
-    : netlist(*netlist), config(find_first_tran_statement()),
-      num_extra_lines(get_num_extra_lines()), system_size(get_system_size()),
-      stamp_params(system_size) {
-  srand (static_cast<unsigned>(time(0)));
+CircuitSolver::CircuitSolver(const Netlist* netlist, Tracer* tracer)
+    : netlist(*netlist),
+      elements(netlist->get_flat_elements(node_names)), tran(NULL),
+      dc_sweep(NULL), pss(NULL), num_extra_lines(get_num_extra_lines()),
+      system_size(calculate_system_size()), num_states(get_num_states()),
+      groups(elements, system_size - num_extra_lines),
+      stamp_params(system_size, num_states), current_time(0), usable_order(0),
+      random_seed(static_cast<unsigned>(time(0))), tracer(tracer) {
+  stats.system_size = system_size;
+  initialize_states();
+  find_first_analysis_statement();
   prepare_circuit();
   solve_circuit();
 }
 
+CircuitSolver::CircuitSolver(const Netlist* netlist, const Tran& config,
+                             Tracer* tracer)
+    : netlist(*netlist),
+      elements(netlist->get_flat_elements(node_names)), tran(&config),
+      dc_sweep(NULL), pss(NULL), num_extra_lines(get_num_extra_lines()),
+      system_size(calculate_system_size()), num_states(get_num_states()),
+      groups(elements, system_size - num_extra_lines),
+      stamp_params(system_size, num_states), current_time(0), usable_order(0),
+      random_seed(static_cast<unsigned>(time(0))), tracer(tracer),
+      num_solution_samples(0), solutions(NULL) {
+  stats.system_size = system_size;
+  initialize_states();
+  stamp_params.method_order = tran->get_admo_order();
+}
+
 CircuitSolver::~CircuitSolver() {
   free_array(solutions, 2, num_solution_samples);
 }
 
 void CircuitSolver::write_to_stream(std::ostream& ostream) const {
+  AMC_STATS_TIMER(output_timer, stats.output_s);
+  AMC_TRACE(output_span, tracer, "output", current_time, -1);
   ostream << get_variables_header() << std::endl;
   for (int sample = 0; sample < num_solution_samples; ++sample) {
     ostream << solutions[sample][0];
@@ -56,12 +79,22 @@ void CircuitSolver::write_to_screen() const {
   write_to_stream(std::cout);
 }
 
-inline void CircuitSolver::add_solution(int index, amc_float time){
-  solutions[index][0] = time;
+inline void CircuitSolver::add_solution(int index, amc_float abscissa){
+  solutions[index][0] = abscissa;
   memcpy(solutions[index] + 1, stamp_params.x + 1,
          (system_size - 1) * sizeof(amc_float));
 }
 
+inline long count_nonzeros(amc_float** A, const int system_size) {
+  long nonzeros = 0;
+  for (int i = 1; i < system_size; ++i) {
+    for (int j = 1; j < system_size; ++j) {
+      nonzeros += A[i][j] != 0;
+    }
+  }
+  return nonzeros;
+}
+
 inline bool converged(amc_float* last_solution, amc_float* new_solution,
                       const int system_size) {
   for (int i = 0; i < system_size; ++i) {
@@ -72,14 +105,11 @@ inline bool converged(amc_float* last_solution, amc_float* new_solution,
   return true;
 }
 
-inline void retry_initial(amc_float* last_solution, amc_float* new_solution,
-                          const int system_size) {
-  for (int i = 0; i < system_size; ++i) {
-    if (std::abs(last_solution[i] - new_solution[i]) > ACCEPTABLE_NR_ERROR) {
-      new_solution[i] = - MAX_NR_GUESS + static_cast <amc_float> (rand()) /
-                           ( static_cast <amc_float> (RAND_MAX/(2.0*RAND_MAX)));
-    }
-  }
+// Linear congruential generator, `rand` can't be used as its state is shared
+inline amc_float random_between(amc_float low, amc_float high,
+                                unsigned& seed) {
+  seed = seed * 1103515245 + 12345;
+  return low + (high - low) * ((seed >> 16) & 0x7fff) / 32767.0;
 }
 
 inline void swap_vectors(amc_float*& a, amc_float*& b) {
@@ -88,135 +118,672 @@ inline void swap_vectors(amc_float*& a, amc_float*& b) {
   b = aux;
 }
 
+// Newton-Raphson starts again from the solution it converged to, without
+// moving to the next step
+inline void restart_from_solution(StampParameters& p) {
+  swap_vectors(p.last_nr_trial, p.b);
+  p.new_nr_cycle = false;
+}
+
+// Iterates until two consecutive trials are close enough, the converged
+// solution is left on stamp_params.b. Returns false if the cycle limit is hit.
+// Unless they are fixed, switches crossing at an end of the step change as
+// soon as a trial shows it, rather than once it converges.
+template<int order>
+bool CircuitSolver::newton_raphson(amc_float time, bool fixed_switches) {
+  AMC_STATS_TIMER(newton_timer, stats.newton_s);
+  int switch_events = 0;
+  for (int iterations = 0; ; ++iterations) {
+    ++stats.num_nr_iterations;
+    AMC_TRACE(iteration_span, tracer, "newton_iteration", time, iterations);
+    {
+      AMC_STATS_TIMER(assembly_timer, stats.assembly_s);
+      AMC_TRACE(assembly_span, tracer, "assembly", time, -1);
+      stamp_params.limited = false;
+      update_circuit<order>(time);
+    }
+#ifndef AMCIRCUIT_NO_STATS
+    if (stats.num_nonzeros == 0) {
+      stats.num_nonzeros = count_nonzeros(stamp_params.A, system_size);
+    }
+#endif
+    {
+      AMC_STATS_TIMER(factorization_timer, stats.factorization_s);
+      AMC_TRACE(factorization_span, tracer, "factorization", time, -1);
+      solve_system(stamp_params.A, stamp_params.b, system_size);
+    }
+
+    if (stamp_params.limited) {
+      // Trials limited by nonlinear elements are neither converged nor used
+      // to change switches
+    } else if (!fixed_switches && switch_events < SWITCH_EVENTS_LIMIT &&
+               switching_at_ends()) {
+      ++switch_events;
+      change_switches();
+    } else if (converged(stamp_params.last_nr_trial, stamp_params.b,
+                         system_size)) {
+      return true;
+    }
+    if (iterations >= NEWTON_RAPHSON_CYCLE_LIMIT) {
+      return false;
+    }
+    swap_vectors(stamp_params.last_nr_trial, stamp_params.b);
+    stamp_params.new_nr_cycle = false;
+  }
+}
+
+template<int order>
+void CircuitSolver::converge_with_retries(amc_float time,
+                                          bool fixed_switches) {
+  AMC_TRACE(step_span, tracer, "step", time, -1);
+  AMC_STATS(const long first_iteration = stats.num_nr_iterations);
+  int ia_retries = 0;
+  while (!newton_raphson<order>(time, fixed_switches)) {
+    ++ia_retries;
+    AMC_STATS(++stats.num_retries);
+    AMC_TRACE(retry_span, tracer, "retry", time, ia_retries);
+    retry_initial();
+    if (ia_retries > NEWTON_RAPHSON_IA_RETRIES) {
+      throw NewtonRaphsonFailed(to_str(
+            "Newton-Raphson failed to converge after "
+            << NEWTON_RAPHSON_IA_RETRIES << " initialization retries."));
+    }
+    swap_vectors(stamp_params.last_nr_trial, stamp_params.b);
+    stamp_params.new_nr_cycle = false;
+  }
+  AMC_STATS(stats.add_step(stats.num_nr_iterations - first_iteration));
+}
+
+// Switches are fixed conductances for Newton-Raphson, which would otherwise
+// keep going back and forth across their references. Once it converges the
+// switches on the wrong state change, and the point is solved again starting
+// from the solution found.
+template<int order>
+void CircuitSolver::converge_with_switches(amc_float time) {
+  converge_with_retries<order>(time);
+  amc_float fraction;
+  for (int events = 0;
+       groups.find_switching(stamp_params, stamp_params.b, stamp_params.b,
+                             fraction); ++events) {
+    check_switch_events(events, time);
+    change_switches();
+    restart_from_solution(stamp_params);
+    converge_with_retries<order>(time);
+  }
+}
+
+// A step that changes switches is cut where the first of them crosses its
+// reference, and goes on from there with them changed. Cut steps are taken
+// with the first order, which needs no past values evenly spaced. Returns
+// whether the step was cut.
+template<int order>
+bool CircuitSolver::step(amc_float start, amc_float step_s) {
+  const amc_float end = start + step_s;
+  stamp_params.step_s = step_s;
+  converge_with_retries<order>(end);
+  bool cut = false;
+  amc_float fraction;
+  for (int events = 0;
+       groups.find_switching(stamp_params, stamp_params.x, stamp_params.b,
+                             fraction); ++events) {
+    check_switch_events(events, end);
+    if (fraction > SWITCH_MIN_CUT && fraction < 1 - SWITCH_MIN_CUT) {
+      const amc_float crossing = start + fraction * (end - start);
+      stamp_params.step_s = crossing - start;
+      restart_from_solution(stamp_params);
+      converge_with_retries<1>(crossing, true);
+      stamp_params.new_nr_cycle = true;
+      swap_vectors(stamp_params.x, stamp_params.b);
+      start = crossing;
+      stamp_params.step_s = end - start;
+      cut = true;
+    } else {
+      restart_from_solution(stamp_params);
+    }
+    change_switches();
+    if (cut) {
+      converge_with_retries<1>(end);
+    } else {
+      converge_with_retries<order>(end);
+    }
+  }
+  return cut;
+}
+
+// Crossings on a transient step are interpolated from the previous solution,
+// on DC and initial conditions there is nothing to interpolate from. Those
+// inside the step are left for it to be cut once converged.
+bool CircuitSolver::switching_at_ends() {
+  const amc_float* from = stamp_params.dc_analysis || stamp_params.use_ic
+                          ? stamp_params.b : stamp_params.x;
+  amc_float fraction;
+  return groups.find_switching(stamp_params, from, stamp_params.b, fraction)
+         && (fraction <= SWITCH_MIN_CUT || fraction >= 1 - SWITCH_MIN_CUT);
+}
+
+// A switch changing its own control may never find a consistent state
+void CircuitSolver::check_switch_events(int events, amc_float point) const {
+  if (events >= SWITCH_EVENTS_LIMIT) {
+    throw NewtonRaphsonFailed(to_str(
+          "Switches still changing after " << SWITCH_EVENTS_LIMIT
+          << " events at " << point));
+  }
+}
+
+void CircuitSolver::change_switches() {
+  AMC_STATS(++stats.num_switch_events);
+  groups.change_switches(stamp_params);
+}
+
+// Unknowns that didn't converge restart from a random guess
+void CircuitSolver::retry_initial() {
+  for (int i = 0; i < system_size; ++i) {
+    if (std::abs(stamp_params.last_nr_trial[i] - stamp_params.b[i])
+        > ACCEPTABLE_NR_ERROR) {
+      stamp_params.b[i] = random_between(-MAX_NR_GUESS, MAX_NR_GUESS,
+                                         random_seed);
+    }
+  }
+}
+
+// Used to find the initial conditions, the integration step is a fraction of
+// the time step so that elements settle on their initial values. Initial
+// conditions are always integrated with the first order.
 inline void CircuitSolver::calculate_till_converge(const amc_float initial_time,
                                                    const amc_float time_step,
                                                    const int steps) {
   amc_float t = initial_time;
   stamp_params.step_s = time_step/steps;
   for (int i = 0; i < steps; ++i) {
-    int iterations = 0;
-    int ia_retries = 0;
-    while (1) {
-      update_circuit(t);
-      solve_system(stamp_params.A, stamp_params.b, system_size);
+    converge_with_switches<1>(t);
+    stamp_params.new_nr_cycle = true;
+    swap_vectors(stamp_params.x, stamp_params.b);
+    t += time_step;
+  }
+}
 
-      if (converged(stamp_params.last_nr_trial, stamp_params.b, system_size)) {
-        break;
-      }
+void CircuitSolver::integrate(const amc_float step_s, const int steps) {
+  switch (stamp_params.method_order) {
+    case 1: integrate<1>(step_s, steps); break;
+    case 2: integrate<2>(step_s, steps); break;
+    case 3: integrate<3>(step_s, steps); break;
+    case 4: integrate<4>(step_s, steps); break;
+    default:
+      throw InvalidIntegrationMethod(to_str(
+            "Invalid Adams-Moulton order: " << stamp_params.method_order));
+  }
+}
 
-      ++iterations;
-      if (iterations > NEWTON_RAPHSON_CYCLE_LIMIT) {
-        iterations = 0;
-        ++ia_retries;
-        retry_initial(stamp_params.last_nr_trial, stamp_params.b, system_size);
-        if (ia_retries > NEWTON_RAPHSON_IA_RETRIES) {
-          throw NewtonRaphsonFailed(to_str(
-                "Newton-Raphson failed to converge after "
-                << NEWTON_RAPHSON_IA_RETRIES << " initialization retries."));
-        }
-      }
-      swap_vectors(stamp_params.last_nr_trial, stamp_params.b);
-      stamp_params.new_nr_cycle = false;
+// Past values are only evenly spaced since the last cut step, so the order
+// goes up again from the second one as steps are added after it
+template<int order>
+inline void CircuitSolver::integrate(const amc_float step_s, const int steps) {
+  for (int i = 0; i < steps; ++i) {
+    bool cut;
+    switch (std::min(usable_order, order)) {
+      case 1: cut = step<1>(current_time, step_s); break;
+      case 2: cut = step<2>(current_time, step_s); break;
+      case 3: cut = step<3>(current_time, step_s); break;
+      default: cut = step<order>(current_time, step_s);
     }
+    usable_order = cut ? 2 : std::min(usable_order + 1, order);
+    current_time += step_s;
     stamp_params.new_nr_cycle = true;
     swap_vectors(stamp_params.x, stamp_params.b);
-    t += time_step;
   }
 }
 
-void CircuitSolver::solve_circuit() {
-  amc_float t = 0;
-  amc_float inner_step_s = config.get_t_step_s() / config.get_internal_steps();
+amc_float CircuitSolver::get_inner_step_s() const {
+  return tran->get_t_step_s() / tran->get_internal_steps();
+}
 
+void CircuitSolver::initialize() {
+  current_time = 0;
+  usable_order = stamp_params.method_order;
   stamp_params.use_ic = true;
   stamp_params.new_nr_cycle = false;
-  calculate_till_converge(t, inner_step_s * IC_SCALING_STEP, NUM_STEPS_IC);
-  add_solution(0, t);
+  calculate_till_converge(current_time, get_inner_step_s() * IC_SCALING_STEP,
+                          NUM_STEPS_IC);
+  stamp_params.use_ic = false;
+}
+
+void CircuitSolver::advance_to(amc_float time) {
+  const amc_float inner_step_s = get_inner_step_s();
+  const int steps = static_cast<int>((time - current_time) / inner_step_s
+                                     + 0.5);
+  integrate(inner_step_s, steps);
+}
+
+amc_float CircuitSolver::get_time() const {
+  return current_time;
+}
+
+int CircuitSolver::get_system_size() const {
+  return system_size;
+}
+
+int CircuitSolver::find_unknown(const std::string& name) const {
+  std::vector<std::string> names = get_variable_names();
+  for (int i = 1; i < system_size; ++i) {
+    if (str_upper(names[i]) == str_upper(name)) {
+      return i;
+    }
+  }
+  throw IncompleteNetList("Unknown \"" + name + "\" not found on netlist");
+}
+
+long CircuitSolver::get_num_nr_iterations() const {
+  return stats.num_nr_iterations;
+}
+
+SolverStats CircuitSolver::get_stats() const {
+  SolverStats current_stats = stats;
+  AMC_STATS(current_stats.peak_memory_kb = get_peak_memory_kb());
+  return current_stats;
+}
+
+long CircuitSolver::get_allocated_bytes() const {
+  const long system_floats = static_cast<long>(system_size) * system_size
+                             + 4 * system_size + num_states;
+  const long solution_floats = static_cast<long>(num_solution_samples)
+                               * system_size;
+  return (system_floats + solution_floats) * sizeof(amc_float)
+         + (system_size + num_solution_samples) * sizeof(amc_float*);
+}
+
+amc_float CircuitSolver::get_unknown(int index) const {
+  return stamp_params.x[index];
+}
+
+void CircuitSolver::set_source_signal(const std::string& source_name,
+                                      Signal::Handler signal) {
+  replace_source_signal(find_source(source_name), signal);
+}
+
+void CircuitSolver::set_source_value(const std::string& source_name,
+                                     amc_float value) {
+  set_source_signal(source_name, Signal::Handler(new DC(value)));
+}
+
+void CircuitSolver::solve_circuit() {
+  if (dc_sweep != NULL) {
+    solve_dc_sweep();
+  } else if (pss != NULL) {
+    solve_periodic_steady_state();
+  } else {
+    solve_transient();
+  }
+}
+
+void CircuitSolver::solve_transient() {
+  initialize();
+  add_solution(0, current_time);
+
+  switch (stamp_params.method_order) {
+    case 1: integrate_samples<1>(); break;
+    case 2: integrate_samples<2>(); break;
+    case 3: integrate_samples<3>(); break;
+    case 4: integrate_samples<4>(); break;
+    default:
+      throw InvalidIntegrationMethod(to_str(
+            "Invalid Adams-Moulton order: " << stamp_params.method_order));
+  }
+}
+
+template<int order>
+void CircuitSolver::integrate_samples() {
+  for (int i = 1; i < num_solution_samples; ++i) {
+    integrate<order>(get_inner_step_s(), tran->get_internal_steps());
+    add_solution(i, current_time);
+  }
+}
 
+// The swept source is put back even if the sweep fails
+void CircuitSolver::solve_dc_sweep() {
+  const int source = find_source(dc_sweep->get_source_name());
+  const Element::Handler original_source = elements[source];
+  stamp_params.dc_analysis = true;
   stamp_params.use_ic = false;
+  try {
+    sweep_source(source);
+  } catch (...) {
+    replace_element(source, original_source);
+    stamp_params.dc_analysis = false;
+    throw;
+  }
+  replace_element(source, original_source);
+  stamp_params.dc_analysis = false;
+}
+
+// Each point is a continuation of the previous one: Newton-Raphson starts from
+// the last converged solution. When it fails the source moves only part of the
+// way and the increment is doubled back once the hard region is crossed.
+// Nothing is integrated on DC, so any order will do.
+void CircuitSolver::sweep_source(int source) {
+  const amc_float step = dc_sweep->get_step();
+  const amc_float min_increment = step / (1 << DC_SWEEP_MAX_HALVINGS);
+
+  amc_float value = dc_sweep->get_start();
+  replace_source_signal(source, Signal::Handler(new DC(value)));
+  converge_with_switches<1>(0);
+  swap_vectors(stamp_params.x, stamp_params.b);
+  add_solution(0, value);
+
+  amc_float increment = step;
   for (int i = 1; i < num_solution_samples; ++i) {
-    t += config.get_t_step_s();
-    calculate_till_converge(t, inner_step_s, config.get_internal_steps());
-    add_solution(i, t);
+    const amc_float target = dc_sweep->get_start() + i * step;
+    while (value != target) {
+      amc_float trial = value + increment;
+      if ((step > 0 && trial > target) || (step < 0 && trial < target)) {
+        trial = target;
+      }
+      replace_source_signal(source, Signal::Handler(new DC(trial)));
+      AMC_STATS(const long first_iteration = stats.num_nr_iterations);
+      bool trial_converged;
+      {
+        AMC_TRACE(step_span, tracer, "step", trial, -1);
+        trial_converged = newton_raphson<1>(0);
+        amc_float fraction;
+        for (int events = 0; trial_converged &&
+             groups.find_switching(stamp_params, stamp_params.b,
+                                   stamp_params.b, fraction); ++events) {
+          check_switch_events(events, trial);
+          change_switches();
+          restart_from_solution(stamp_params);
+          trial_converged = newton_raphson<1>(0);
+        }
+      }
+      AMC_STATS(stats.add_step(stats.num_nr_iterations - first_iteration));
+      if (trial_converged) {
+        value = trial;
+        swap_vectors(stamp_params.x, stamp_params.b);
+        increment = std::abs(2 * increment) < std::abs(step) ? 2 * increment
+                                                             : step;
+      } else {
+        increment /= 2;
+        if (std::abs(increment) < std::abs(min_increment)) {
+          throw NewtonRaphsonFailed(to_str(
+                "DC sweep failed to converge at " << dc_sweep->get_source_name()
+                << " = " << trial));
+        }
+        memcpy(stamp_params.last_nr_trial, stamp_params.x,
+               system_size * sizeof(amc_float));
+      }
+    }
+    add_solution(i, value);
+  }
+}
+
+// Shooting-Newton: the state of the reactive elements at the beginning of the
+// period is corrected until integrating over one period brings it back. The
+// sensitivity of the final state to the initial one is estimated by finite
+// differences, costing one extra period per state variable on each iteration.
+// State vectors are indexed from 1 so they can be used with solve_system.
+// Transmission lines are refused: the waves they delay are not part of the
+// state, so each period would start with the lines empty.
+void CircuitSolver::solve_periodic_steady_state() {
+  for (unsigned i = 0; i != elements.size(); ++i) {
+    if (dynamic_cast<const TransmissionLine*>(&(*elements[i])) != NULL) {
+      throw IncompleteNetList("Periodic steady state does not support "
+                              "transmission lines, found \""
+                              + elements[i]->get_name() + "\"");
+    }
+  }
+  find_state_elements();
+  const int size = 1 + state_capacitors.size() + state_inductors.size();
+  amc_float* original = allocate_vector(size);
+  amc_float* initial = allocate_vector(size);
+  amc_float* final_state = allocate_vector(size);
+  amc_float* perturbed = allocate_vector(size);
+  amc_float** sensitivity = allocate_matrix(size);
+
+  get_state(original);
+  memcpy(initial, original, size * sizeof(amc_float));
+
+  int iteration = 0;
+  try {
+    while (1) {
+      shoot(initial, final_state);
+
+      bool periodic = true;
+      for (int i = 1; i < size; ++i) {
+        const amc_float absolute_error =
+            i <= static_cast<int>(state_capacitors.size()) ? PSS_VOLTAGE_ERROR
+                                                           : PSS_CURRENT_ERROR;
+        const amc_float largest = std::max(std::abs(final_state[i]),
+                                           std::abs(initial[i]));
+        if (std::abs(final_state[i] - initial[i])
+            > PSS_RELATIVE_ERROR * largest + absolute_error) {
+          periodic = false;
+        }
+      }
+      if (periodic) {
+        break;
+      }
+      if (++iteration > PSS_ITERATIONS_LIMIT) {
+        throw NewtonRaphsonFailed(to_str(
+              "Periodic steady state failed to converge after "
+              << PSS_ITERATIONS_LIMIT << " shooting iterations."));
+      }
+
+      // (I - dfinal/dinitial) * delta = final_state - initial
+      // Marginally stable states (e.g. ideal integrators) make the system
+      // singular, the regularization keeps them close to the current guess
+      for (int j = 1; j < size; ++j) {
+        const amc_float h = PSS_PERTURBATION * (1 + std::abs(initial[j]));
+        initial[j] += h;
+        shoot(initial, perturbed);
+        initial[j] -= h;
+        for (int i = 1; i < size; ++i) {
+          sensitivity[i][j] = (i == j) * (1 + PSS_REGULARIZATION)
+                              - (perturbed[i] - final_state[i]) / h;
+        }
+      }
+      for (int i = 1; i < size; ++i) {
+        final_state[i] -= initial[i];
+      }
+      solve_system(sensitivity, final_state, size);
+      for (int i = 1; i < size; ++i) {
+        initial[i] += final_state[i];
+      }
+    }
+  } catch (...) {
+    set_initial_state(original);
+    free(original); free(initial); free(final_state); free(perturbed);
+    free_array(sensitivity, 2, size);
+    throw;
+  }
+
+  set_initial_state(original);
+  free(original); free(initial); free(final_state); free(perturbed);
+  free_array(sensitivity, 2, size);
+}
+
+// Integrates one period from the given state, the waveform is left on
+// `solutions`
+void CircuitSolver::shoot(const amc_float* initial_state,
+                          amc_float* final_state) {
+  set_initial_state(initial_state);
+  solve_transient();
+
+  for (unsigned i = 0; i < state_capacitors.size(); ++i) {
+    const DoubleTerminalElement* c = state_capacitors[i].element;
+    final_state[1 + i] = stamp_params.x[c->get_node1()]
+                         - stamp_params.x[c->get_node2()];
+  }
+  for (unsigned i = 0; i < state_inductors.size(); ++i) {
+    final_state[1 + state_capacitors.size() + i] =
+        stamp_params.x[state_inductors[i].currents_position];
+  }
+}
+
+void CircuitSolver::find_state_elements() {
+  int next_line = system_size - num_extra_lines;
+  int next_state = 0;
+
+  state_capacitors.clear();
+  state_inductors.clear();
+  for (unsigned i = 0; i != elements.size(); ++i) {
+    StateElement state_element;
+    state_element.element =
+        dynamic_cast<const DoubleTerminalElement*>(&(*elements[i]));
+    state_element.state_position = next_state;
+    state_element.currents_position = next_line;
+    if (dynamic_cast<const Capacitor*>(&(*elements[i])) != NULL) {
+      state_capacitors.push_back(state_element);
+    } else if (dynamic_cast<const Inductor*>(&(*elements[i])) != NULL) {
+      state_inductors.push_back(state_element);
+    }
+    next_line += elements[i]->get_num_of_currents();
+    next_state += elements[i]->get_num_of_states();
+  }
+}
+
+void CircuitSolver::set_initial_state(const amc_float* state) {
+  for (unsigned i = 0; i < state_capacitors.size(); ++i) {
+    stamp_params.state[state_capacitors[i].state_position
+                       + Capacitor::INITIAL_VOLTAGE] = state[1 + i];
+  }
+  for (unsigned i = 0; i < state_inductors.size(); ++i) {
+    stamp_params.state[state_inductors[i].state_position
+                       + Inductor::INITIAL_CURRENT] =
+        state[1 + state_capacitors.size() + i];
+  }
+}
+
+void CircuitSolver::get_state(amc_float* state) const {
+  state[0] = 0;
+  for (unsigned i = 0; i < state_capacitors.size(); ++i) {
+    state[1 + i] = stamp_params.state[state_capacitors[i].state_position
+                                      + Capacitor::INITIAL_VOLTAGE];
+  }
+  for (unsigned i = 0; i < state_inductors.size(); ++i) {
+    state[1 + state_capacitors.size() + i] =
+        stamp_params.state[state_inductors[i].state_position
+                           + Inductor::INITIAL_CURRENT];
   }
 }
 
-Tran& CircuitSolver::find_first_tran_statement() {
-  std::vector<Statement::Handler>& statements = netlist.get_statements();
-  std::vector<Statement::Handler>::iterator it;
-  Tran* tran;
+void CircuitSolver::find_first_analysis_statement() {
+  const std::vector<Statement::Handler>& statements = netlist.get_statements();
+  std::vector<Statement::Handler>::const_iterator it;
   for (it = statements.begin(); it != statements.end(); ++it) {
-    if ((tran = dynamic_cast<Tran*>(&(**it))) != NULL) {
-      return *tran;
+    if ((tran = pss = dynamic_cast<const PeriodicSteadyState*>(&(**it)))
+        != NULL) {
+      return;
+    }
+    if ((tran = dynamic_cast<const Tran*>(&(**it))) != NULL) {
+      return;
+    }
+    if ((dc_sweep = dynamic_cast<const DCSweep*>(&(**it))) != NULL) {
+      return;
     }
   }
   throw IncompleteNetList("No analysis statement found on netlist");
 }
 
+int CircuitSolver::find_source(const std::string& name) const {
+  for (unsigned i = 0; i != elements.size(); ++i) {
+    const ArbitrarySourceElement* source =
+        dynamic_cast<const ArbitrarySourceElement*>(&(*elements[i]));
+    if (source != NULL && str_upper(source->get_name()) == str_upper(name)) {
+      return i;
+    }
+  }
+  throw IncompleteNetList("Source \"" + name + "\" not found on netlist");
+}
+
+// The netlist element is left untouched, only this solver sees the new signal
+void CircuitSolver::replace_source_signal(int index, Signal::Handler signal) {
+  const ArbitrarySourceElement& source =
+      dynamic_cast<const ArbitrarySourceElement&>(*elements[index]);
+  replace_element(index, source.with_signal(signal));
+}
+
+void CircuitSolver::replace_element(int index,
+                                    const Element::Handler& element) {
+  elements[index] = element;
+  groups.replace(index, element);
+}
+
 int CircuitSolver::get_num_extra_lines() {
   int num_extra_lines = 0;
-  const std::vector<Element::Handler>& elements = netlist.get_elements();
   for(unsigned i = 0; i != elements.size(); ++i) {
     num_extra_lines += elements[i]->get_num_of_currents();
   }
   return num_extra_lines;
 }
 
-int CircuitSolver::get_system_size() {
-  return 1 + netlist.get_number_of_nodes() + num_extra_lines;
+int CircuitSolver::calculate_system_size() {
+  return static_cast<int>(node_names.size()) + num_extra_lines;
+}
+
+int CircuitSolver::get_num_states() {
+  int num_states = 0;
+  for(unsigned i = 0; i != elements.size(); ++i) {
+    num_states += elements[i]->get_num_of_states();
+  }
+  return num_states;
+}
+
+void CircuitSolver::initialize_states() {
+  int next_state = 0;
+  for(unsigned i = 0; i != elements.size(); ++i) {
+    elements[i]->initialize_state(stamp_params.state + next_state);
+    next_state += elements[i]->get_num_of_states();
+  }
 }
 
 void CircuitSolver::prepare_circuit() {
-  num_solution_samples =
-      static_cast<int>(config.get_t_stop_s()/config.get_t_step_s()) + 1;
+  if (dc_sweep != NULL) {
+    num_solution_samples = dc_sweep->get_num_points();
+  } else {
+    num_solution_samples =
+        static_cast<int>(tran->get_t_stop_s()/tran->get_t_step_s()) + 1;
+    stamp_params.method_order = tran->get_admo_order();
+    stamp_params.use_ic = tran->get_uic();
+  }
 
   solutions = allocate_matrix(num_solution_samples, system_size);
-
-  stamp_params.method_order = config.get_admo_order();
-  stamp_params.use_ic = config.get_uic();
 }
 
+template<int order>
 void CircuitSolver::update_circuit(amc_float time) {
   zero_matrix(stamp_params.A, system_size);
   zero_vector(stamp_params.b, system_size);
-
-  std::vector<Element::Handler>& elements = netlist.get_elements();
-  int next_line = system_size - num_extra_lines;
-
   stamp_params.time = time;
-
-  for (unsigned i = 0; i != elements.size(); ++i) {
-    int num_of_currents = elements[i]->get_num_of_currents();
-    if (num_of_currents > 0) {
-      stamp_params.currents_position = next_line;
-      next_line += num_of_currents;
-    } else {
-      stamp_params.currents_position = -1;
-    }
-    elements[i]->place_stamp(stamp_params);
-  }
+  groups.place_stamps<order>(stamp_params);
 }
 
-std::string CircuitSolver::get_variables_header() const {
-  std::stringstream header;
-  int num_nodes = system_size - num_extra_lines;
-
-  header << "t";
-  for (int i = 1; i < num_nodes; ++i) { header << " " << i; }
+// The first name is the abscissa, the others follow the unknowns on the system
+std::vector<std::string> CircuitSolver::get_variable_names() const {
+  std::vector<std::string> names;
 
-  std::vector<Element::Handler>& elements = netlist.get_elements();
+  names.push_back(dc_sweep != NULL ? dc_sweep->get_source_name() : "t");
+  names.insert(names.end(), node_names.begin() + 1, node_names.end());
 
   for (unsigned i = 0; i != elements.size(); ++i) {
-    Element::Handler element = elements[i];
+    const Element::Handler& element = elements[i];
     int currents = element->get_num_of_currents();
     if (currents >= 1) {
-      header << " j" << (currents > 1 ? "1" : "") << element->get_name();
+      names.push_back("j" + std::string(currents > 1 ? "1" : "")
+                      + element->get_name());
     }
     for (int j = 2; j <= currents; ++j) {
-      header << " j" << j << element->get_name();
+      names.push_back("j" + to_str(j) + element->get_name());
     }
   }
 
+  return names;
+}
+
+std::string CircuitSolver::get_variables_header() const {
+  std::stringstream header;
+  std::vector<std::string> names = get_variable_names();
+
+  header << names[0];
+  for (unsigned i = 1; i < names.size(); ++i) { header << " " << names[i]; }
+
   return header.str();
 }
 
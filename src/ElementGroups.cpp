@@ -0,0 +1,995 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "ElementGroups.h"
+#include "AdamsMoulton.h"
+#include "DeviceModels.h"
+#include "AMCircuitException.h"
+#include "helpers.h"
+
+namespace amcircuit {
+
+template<typename T>
+inline T* data(std::vector<T>& values) {
+  return values.empty() ? NULL : &values[0];
+}
+
+template<typename T>
+inline const T* data(const std::vector<T>& values) {
+  return values.empty() ? NULL : &values[0];
+}
+
+// Position of `value` on `values`, -1 if it is not there
+inline int find_index(const std::vector<int>& values, int value) {
+  std::vector<int>::const_iterator found =
+      std::find(values.begin(), values.end(), value);
+  return found == values.end() ? -1 : found - values.begin();
+}
+
+template<typename T>
+inline void erase_at(std::vector<T>& values, int index) {
+  values.erase(values.begin() + index);
+}
+
+ElementGroups::ElementGroups(const std::vector<Element::Handler>& elements,
+                             int first_current_line) {
+  int next_line = first_current_line;
+  int next_state = 0;
+  group_positions.reserve(elements.size());
+  capacitors.newest = 0;
+  inductors.newest = 0;
+  lines.last_time = 0;
+  lines.stepped = false;
+
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    const Element* element = &(*elements[i]);
+    const int num_of_currents = element->get_num_of_currents();
+    const int currents_position = num_of_currents > 0 ? next_line : -1;
+    const int state_position = next_state;
+    next_line += num_of_currents;
+    next_state += element->get_num_of_states();
+
+    if (const Resistor* r = dynamic_cast<const Resistor*>(element)) {
+      group_positions.push_back(resistors.G.size());
+      resistors.node1.push_back(r->get_node1());
+      resistors.node2.push_back(r->get_node2());
+      resistors.G.push_back(1/r->get_R());
+    } else if (const Capacitor* c = dynamic_cast<const Capacitor*>(element)) {
+      group_positions.push_back(capacitors.C.size());
+      capacitors.node1.push_back(c->get_node1());
+      capacitors.node2.push_back(c->get_node2());
+      capacitors.C.push_back(c->get_C());
+      capacitors.state_position.push_back(state_position);
+      capacitors.last_voltage.push_back(0);
+      capacitors.G.push_back(0);
+      capacitors.I.push_back(0);
+      for (int k = 0; k < 3; ++k) {
+        capacitors.past[k].push_back(0);
+      }
+    } else if (const Inductor* l = dynamic_cast<const Inductor*>(element)) {
+      group_positions.push_back(inductors.L.size());
+      inductors.node1.push_back(l->get_node1());
+      inductors.node2.push_back(l->get_node2());
+      inductors.L.push_back(l->get_L());
+      inductors.currents_position.push_back(currents_position);
+      inductors.state_position.push_back(state_position);
+      inductors.last_current.push_back(0);
+      inductors.R.push_back(0);
+      inductors.V.push_back(0);
+      for (int k = 0; k < 3; ++k) {
+        inductors.past[k].push_back(0);
+      }
+      inductors.name.push_back(str_upper(l->get_name()));
+    } else if (dynamic_cast<const MutualInductance*>(element) != NULL) {
+      group_positions.push_back(couplings.mutuals.size());
+      couplings.mutuals.push_back(elements[i]);
+    } else if (const TransmissionLine* t =
+                   dynamic_cast<const TransmissionLine*>(element)) {
+      group_positions.push_back(lines.Z0.size());
+      lines.port1_p.push_back(t->get_port1_p());
+      lines.port1_n.push_back(t->get_port1_n());
+      lines.port2_p.push_back(t->get_port2_p());
+      lines.port2_n.push_back(t->get_port2_n());
+      lines.Z0.push_back(t->get_Z0());
+      lines.TD.push_back(t->get_TD());
+      lines.currents_position.push_back(currents_position);
+      lines.state_position.push_back(state_position);
+      LineHistory history;
+      history.oldest = 0;
+      history.count = 0;
+      lines.history.push_back(history);
+    } else if (const Diode* d = dynamic_cast<const Diode*>(element)) {
+      group_positions.push_back(diodes.Is.size());
+      diodes.node1.push_back(d->get_node1());
+      diodes.node2.push_back(d->get_node2());
+      diodes.Is.push_back(d->get_Is());
+      diodes.nVt.push_back(d->get_n() * THERMAL_VOLTAGE);
+      diodes.critical_voltage.push_back(d->get_critical_voltage());
+      diodes.state_position.push_back(state_position);
+      diodes.voltage.push_back(0);
+      diodes.G.push_back(0);
+      diodes.I.push_back(0);
+    } else if (const Mosfet* m = dynamic_cast<const Mosfet*>(element)) {
+      group_positions.push_back(mosfets.K.size());
+      mosfets.drain.push_back(m->get_drain());
+      mosfets.gate.push_back(m->get_gate());
+      mosfets.source.push_back(m->get_source());
+      mosfets.sign.push_back(m->is_p_channel() ? -1 : 1);
+      mosfets.K.push_back(m->get_K());
+      mosfets.Vt.push_back(mosfets.sign.back() * m->get_Vt());
+      mosfets.lambda.push_back(m->get_lambda());
+      mosfets.state_position.push_back(state_position);
+      mosfets.effective_drain.push_back(0);
+      mosfets.effective_source.push_back(0);
+      mosfets.vgs.push_back(0);
+      mosfets.vds.push_back(0);
+      mosfets.Id.push_back(0);
+      mosfets.gm.push_back(0);
+      mosfets.gds.push_back(0);
+    } else if (const VoltageControlledSwitch* w =
+                   dynamic_cast<const VoltageControlledSwitch*>(element)) {
+      group_positions.push_back(switches.v_ref.size());
+      switches.node_p.push_back(w->get_node_p());
+      switches.node_n.push_back(w->get_node_n());
+      switches.node_ctrl_p.push_back(w->get_node_ctrl_p());
+      switches.node_ctrl_n.push_back(w->get_node_ctrl_n());
+      switches.g_on.push_back(w->get_g_on());
+      switches.g_off.push_back(w->get_g_off());
+      switches.v_ref.push_back(w->get_v_ref());
+      switches.state_position.push_back(state_position);
+      switches.fraction.push_back(0);
+    } else if (const VoltageSource* v =
+                   dynamic_cast<const VoltageSource*>(element)) {
+      group_positions.push_back(voltage_sources.signal.size());
+      voltage_sources.node_p.push_back(v->get_node_p());
+      voltage_sources.node_n.push_back(v->get_node_n());
+      voltage_sources.currents_position.push_back(currents_position);
+      voltage_sources.signal.push_back(v->get_signal());
+    } else if (const CurrentSource* s =
+                   dynamic_cast<const CurrentSource*>(element)) {
+      group_positions.push_back(current_sources.signal.size());
+      current_sources.node_p.push_back(s->get_node_p());
+      current_sources.node_n.push_back(s->get_node_n());
+      current_sources.signal.push_back(s->get_signal());
+    } else {
+      group_positions.push_back(others.element.size());
+      others.element.push_back(elements[i]);
+      others.currents_position.push_back(currents_position);
+      others.state_position.push_back(state_position);
+    }
+  }
+  group_signals();
+  couple_inductors();
+}
+
+void ElementGroups::group_signals() {
+  const int num_sources =
+      voltage_sources.signal.size() + current_sources.signal.size();
+  signals = SignalValues();
+  signals.value.assign(num_sources, 0);
+  signals.time = 0;
+  signals.valid = false;
+  for (int i = 0; i < num_sources; ++i) {
+    add_signal(i);
+  }
+}
+
+// Sources are numbered with the voltage ones first, each added at the end of
+// the arrays of its type
+void ElementGroups::add_signal(int source) {
+  const int num_voltage_sources = voltage_sources.signal.size();
+  const Signal* signal = source < num_voltage_sources
+      ? &(*voltage_sources.signal[source])
+      : &(*current_sources.signal[source - num_voltage_sources]);
+  if (const Sin* sin = dynamic_cast<const Sin*>(signal)) {
+    signals.sin_source.push_back(source);
+    signals.offset.push_back(sin->get_offset());
+    signals.amplitude.push_back(sin->get_amplitude());
+    signals.freq_hz.push_back(sin->get_freq_hz());
+    signals.time_delay.push_back(sin->get_time_delay());
+    signals.damping_factor.push_back(sin->get_damping_factor());
+    signals.phase_cycles.push_back(sin->get_phase_deg() / 360);
+    signals.cycles.push_back(sin->get_cycles());
+    signals.sin_value.push_back(0);
+  } else if (const Pulse* pulse = dynamic_cast<const Pulse*>(signal)) {
+    signals.pulse_source.push_back(source);
+    signals.initial.push_back(pulse->get_initial());
+    signals.pulsed.push_back(pulse->get_pulsed());
+    signals.delay_time.push_back(pulse->get_delay_time());
+    signals.rise_time.push_back(pulse->get_rise_time());
+    signals.fall_time.push_back(pulse->get_fall_time());
+    signals.pulse_width.push_back(pulse->get_pulse_width());
+    signals.period.push_back(pulse->get_period());
+    signals.pulse_cycles.push_back(pulse->get_cycles());
+    signals.pulse_value.push_back(0);
+  } else if (dynamic_cast<const DC*>(signal) != NULL) {
+    signals.value[source] = signal->get_value(0);
+  } else {
+    signals.other_source.push_back(source);
+    signals.cursor.push_back(0);
+  }
+}
+
+// Only the replaced source leaves the arrays, the others keep their place and
+// their cursors
+void ElementGroups::remove_signal(int source) {
+  const int sin = find_index(signals.sin_source, source);
+  if (sin >= 0) {
+    erase_at(signals.sin_source, sin);
+    erase_at(signals.offset, sin);
+    erase_at(signals.amplitude, sin);
+    erase_at(signals.freq_hz, sin);
+    erase_at(signals.time_delay, sin);
+    erase_at(signals.damping_factor, sin);
+    erase_at(signals.phase_cycles, sin);
+    erase_at(signals.cycles, sin);
+    erase_at(signals.sin_value, sin);
+  }
+  const int pulse = find_index(signals.pulse_source, source);
+  if (pulse >= 0) {
+    erase_at(signals.pulse_source, pulse);
+    erase_at(signals.initial, pulse);
+    erase_at(signals.pulsed, pulse);
+    erase_at(signals.delay_time, pulse);
+    erase_at(signals.rise_time, pulse);
+    erase_at(signals.fall_time, pulse);
+    erase_at(signals.pulse_width, pulse);
+    erase_at(signals.period, pulse);
+    erase_at(signals.pulse_cycles, pulse);
+    erase_at(signals.pulse_value, pulse);
+  }
+  const int other = find_index(signals.other_source, source);
+  if (other >= 0) {
+    erase_at(signals.other_source, other);
+    erase_at(signals.cursor, other);
+  }
+  signals.value[source] = 0;
+}
+
+void ElementGroups::replace_signal(int source) {
+  remove_signal(source);
+  add_signal(source);
+  signals.valid = false;
+}
+
+// Each loop writes the values of its type contiguously, they are only then
+// scattered to their sources
+void ElementGroups::update_signal_values(amc_float time) {
+  if (signals.valid && signals.time == time) {
+    return;
+  }
+  signals.time = time;
+  signals.valid = true;
+  amc_float* value = data(signals.value);
+
+  const int num_sin = signals.sin_source.size();
+  const amc_float* offset = data(signals.offset);
+  const amc_float* amplitude = data(signals.amplitude);
+  const amc_float* freq_hz = data(signals.freq_hz);
+  const amc_float* time_delay = data(signals.time_delay);
+  const amc_float* damping_factor = data(signals.damping_factor);
+  const amc_float* phase_cycles = data(signals.phase_cycles);
+  const amc_float* cycles = data(signals.cycles);
+  amc_float* sin_value = data(signals.sin_value);
+  for (int i = 0; i < num_sin; ++i) {
+    sin_value[i] = Sin::value_at(offset[i], amplitude[i], freq_hz[i],
+                                 time_delay[i], damping_factor[i],
+                                 phase_cycles[i], cycles[i], time);
+  }
+  for (int i = 0; i < num_sin; ++i) {
+    value[signals.sin_source[i]] = sin_value[i];
+  }
+
+  const int num_pulses = signals.pulse_source.size();
+  for (int i = 0; i < num_pulses; ++i) {
+    signals.pulse_value[i] = Pulse::value_at(
+        signals.initial[i], signals.pulsed[i], signals.delay_time[i],
+        signals.rise_time[i], signals.fall_time[i], signals.pulse_width[i],
+        signals.period[i], signals.pulse_cycles[i], time);
+  }
+  for (int i = 0; i < num_pulses; ++i) {
+    value[signals.pulse_source[i]] = signals.pulse_value[i];
+  }
+
+  const int num_voltage_sources = voltage_sources.signal.size();
+  for (unsigned i = 0; i < signals.other_source.size(); ++i) {
+    const int source = signals.other_source[i];
+    const Signal& signal = source < num_voltage_sources
+        ? *voltage_sources.signal[source]
+        : *current_sources.signal[source - num_voltage_sources];
+    value[source] = signal.get_value_from(time, signals.cursor[i]);
+  }
+}
+
+// Inductors coupled by any element, directly or through others, are joined
+// on the same block
+void ElementGroups::couple_inductors() {
+  const int num_inductors = inductors.L.size();
+  std::map<std::string, int> positions;
+  for (int i = 0; i < num_inductors; ++i) {
+    positions[inductors.name[i]] = i;
+  }
+
+  // Sets of coupled inductors are joined as each element is found, every
+  // inductor pointing to another one on its set, or to itself if it is the last
+  std::vector<int> joined(num_inductors);
+  std::vector<bool> coupled(num_inductors, false);
+  for (int i = 0; i < num_inductors; ++i) {
+    joined[i] = i;
+  }
+  std::vector<std::vector<int> > windings(couplings.mutuals.size());
+  for (unsigned m = 0; m < couplings.mutuals.size(); ++m) {
+    const MutualInductance& mutual =
+        dynamic_cast<const MutualInductance&>(*couplings.mutuals[m]);
+    const std::vector<std::string>& names = mutual.get_inductors();
+    for (unsigned i = 0; i < names.size(); ++i) {
+      std::map<std::string, int>::const_iterator position =
+          positions.find(str_upper(names[i]));
+      if (position == positions.end()) {
+        throw IncompleteNetList("Inductor \"" + names[i] + "\" coupled by \""
+                                + mutual.get_name() + "\" not found");
+      }
+      windings[m].push_back(position->second);
+      coupled[position->second] = true;
+      int a = position->second;
+      int b = windings[m][0];
+      while (joined[a] != a) {
+        a = joined[a];
+      }
+      while (joined[b] != b) {
+        b = joined[b];
+      }
+      joined[a] = b;
+    }
+  }
+
+  // Blocks are numbered as their first inductor is found
+  std::vector<int> block_of_set(num_inductors, -1);
+  std::vector<std::vector<int> > blocks;
+  for (int i = 0; i < num_inductors; ++i) {
+    if (!coupled[i]) {
+      continue;
+    }
+    int set = i;
+    while (joined[set] != set) {
+      set = joined[set];
+    }
+    if (block_of_set[set] < 0) {
+      block_of_set[set] = blocks.size();
+      blocks.push_back(std::vector<int>());
+    }
+    blocks[block_of_set[set]].push_back(i);
+  }
+
+  couplings.first_member.assign(1, 0);
+  couplings.first_entry.assign(1, 0);
+  couplings.member.clear();
+  couplings.line.clear();
+  std::vector<int> block_of(num_inductors, -1);
+  std::vector<int> index_on_block(num_inductors, -1);
+  for (unsigned b = 0; b < blocks.size(); ++b) {
+    const int size = blocks[b].size();
+    for (int i = 0; i < size; ++i) {
+      const int inductor = blocks[b][i];
+      block_of[inductor] = b;
+      index_on_block[inductor] = i;
+      couplings.member.push_back(inductor);
+      couplings.line.push_back(inductors.currents_position[inductor]);
+    }
+    couplings.first_member.push_back(couplings.member.size());
+    couplings.first_entry.push_back(couplings.first_entry.back()
+                                    + size * size);
+  }
+
+  couplings.k.assign(couplings.first_entry.back(), 0);
+  for (unsigned m = 0; m < windings.size(); ++m) {
+    const amc_float k =
+        dynamic_cast<const MutualInductance&>(*couplings.mutuals[m]).get_k();
+    for (unsigned i = 0; i < windings[m].size(); ++i) {
+      for (unsigned j = 0; j < windings[m].size(); ++j) {
+        const int row = windings[m][i];
+        const int column = windings[m][j];
+        if (row == column) {
+          continue;
+        }
+        const int b = block_of[row];
+        const int size = couplings.first_member[b + 1]
+                         - couplings.first_member[b];
+        couplings.k[couplings.first_entry[b] + index_on_block[row] * size
+                    + index_on_block[column]] += k;
+      }
+    }
+  }
+  couplings.M.resize(couplings.k.size());
+  couplings.gain.assign(couplings.k.size(), 0);
+  update_mutual_inductances();
+}
+
+void ElementGroups::update_mutual_inductances() {
+  const int num_blocks = couplings.first_member.size() - 1;
+  for (int b = 0; b < num_blocks; ++b) {
+    const int* member = &couplings.member[couplings.first_member[b]];
+    const int size = couplings.first_member[b + 1] - couplings.first_member[b];
+    const int first_entry = couplings.first_entry[b];
+    for (int i = 0; i < size; ++i) {
+      for (int j = 0; j < size; ++j) {
+        const int entry = first_entry + i * size + j;
+        couplings.M[entry] = couplings.k[entry]
+            * std::sqrt(inductors.L[member[i]] * inductors.L[member[j]]);
+      }
+    }
+  }
+}
+
+void ElementGroups::place_stamps(StampParameters& p) {
+  switch (p.use_ic ? 1 : p.method_order) {
+    case 1: place_stamps<1>(p); break;
+    case 2: place_stamps<2>(p); break;
+    case 3: place_stamps<3>(p); break;
+    case 4: place_stamps<4>(p); break;
+    default:
+      throw InvalidIntegrationMethod(
+          to_str("Invalid Adams-Moulton order: " << p.method_order));
+  }
+}
+
+template<int order>
+void ElementGroups::place_stamps(StampParameters& p) {
+  amc_float** A = p.A;
+  amc_float* b = p.b;
+
+  const int num_resistors = resistors.G.size();
+  const int* r_node1 = data(resistors.node1);
+  const int* r_node2 = data(resistors.node2);
+  const amc_float* r_G = data(resistors.G);
+  for (int i = 0; i < num_resistors; ++i) {
+    const int node1 = r_node1[i];
+    const int node2 = r_node2[i];
+    const amc_float G = r_G[i];
+    A[node1][node1] += G;
+    A[node2][node2] += G;
+    A[node1][node2] -= G;
+    A[node2][node1] -= G;
+  }
+
+  // Capacitors are open circuits on DC and inductors short circuits, their
+  // branch current still being part of the system
+  if (!p.dc_analysis) {
+    update_histories(p);
+    update_companions<order>(p.step_s);
+    for (unsigned i = 0; i < capacitors.C.size(); ++i) {
+      const int node1 = capacitors.node1[i];
+      const int node2 = capacitors.node2[i];
+      const amc_float G = capacitors.G[i];
+      const amc_float I = capacitors.I[i];
+      A[node1][node1] += G;
+      A[node2][node2] += G;
+      A[node1][node2] -= G;
+      A[node2][node1] -= G;
+      b[node1] += I;
+      b[node2] -= I;
+    }
+  }
+
+  for (unsigned i = 0; i < inductors.L.size(); ++i) {
+    const int node1 = inductors.node1[i];
+    const int node2 = inductors.node2[i];
+    const int line = inductors.currents_position[i];
+    A[node1][line] += 1;
+    A[node2][line] -= 1;
+    A[line][node1] -= 1;
+    A[line][node2] += 1;
+    if (!p.dc_analysis) {
+      A[line][line] += inductors.R[i];
+      b[line] += inductors.V[i];
+    }
+  }
+  if (!p.dc_analysis) {
+    const int num_blocks = couplings.first_member.size() - 1;
+    for (int k = 0; k < num_blocks; ++k) {
+      const int* line = data(couplings.line) + couplings.first_member[k];
+      const int size = couplings.first_member[k + 1]
+                       - couplings.first_member[k];
+      const amc_float* gain = data(couplings.gain) + couplings.first_entry[k];
+      for (int i = 0; i < size; ++i) {
+        amc_float* row = A[line[i]];
+        for (int j = 0; j < size; ++j) {
+          row[line[j]] += gain[i * size + j];
+        }
+      }
+    }
+  }
+
+  stamp_lines(p);
+  stamp_diodes(p);
+  stamp_mosfets(p);
+
+  update_signal_values(p.time);
+  const int num_voltage_sources = voltage_sources.signal.size();
+  for (int i = 0; i < num_voltage_sources; ++i) {
+    const int node_p = voltage_sources.node_p[i];
+    const int node_n = voltage_sources.node_n[i];
+    const int line = voltage_sources.currents_position[i];
+    A[node_p][line] += 1;
+    A[node_n][line] -= 1;
+    A[line][node_p] -= 1;
+    A[line][node_n] += 1;
+    b[line] -= signals.value[i];
+  }
+
+  for (unsigned i = 0; i < current_sources.signal.size(); ++i) {
+    const amc_float I = signals.value[num_voltage_sources + i];
+    b[current_sources.node_p[i]] -= I;
+    b[current_sources.node_n[i]] += I;
+  }
+
+  for (unsigned i = 0; i < switches.v_ref.size(); ++i) {
+    const int node_p = switches.node_p[i];
+    const int node_n = switches.node_n[i];
+    const bool on = p.state[switches.state_position[i]
+                            + VoltageControlledSwitch::ON] != 0;
+    const amc_float G = on ? switches.g_on[i] : switches.g_off[i];
+    A[node_p][node_p] += G;
+    A[node_n][node_n] += G;
+    A[node_p][node_n] -= G;
+    A[node_n][node_p] -= G;
+  }
+
+  for (unsigned i = 0; i < others.element.size(); ++i) {
+    p.currents_position = others.currents_position[i];
+    p.state_position = others.state_position[i];
+    others.element[i]->place_stamp(p);
+  }
+}
+
+// Initial conditions replace the last values, which on the first iteration of
+// each step are taken from the solution of the previous one. Past values are
+// moved a step back by moving the newest position on the ring buffers.
+void ElementGroups::update_histories(const StampParameters& p) {
+  const int num_capacitors = capacitors.C.size();
+  const int num_inductors = inductors.L.size();
+  const amc_float* x = p.x;
+
+  if (p.use_ic) {
+    for (int i = 0; i < num_capacitors; ++i) {
+      capacitors.last_voltage[i] = p.state[capacitors.state_position[i]
+                                           + Capacitor::INITIAL_VOLTAGE];
+    }
+    for (int i = 0; i < num_inductors; ++i) {
+      inductors.last_current[i] = p.state[inductors.state_position[i]
+                                          + Inductor::INITIAL_CURRENT];
+    }
+  }
+  if (!p.new_nr_cycle) {
+    return;
+  }
+
+  capacitors.newest = (capacitors.newest + 2) % 3;
+  const int* c_node1 = data(capacitors.node1);
+  const int* c_node2 = data(capacitors.node2);
+  const amc_float* c_G = data(capacitors.G);
+  const amc_float* c_I = data(capacitors.I);
+  amc_float* last_voltage = data(capacitors.last_voltage);
+  amc_float* past_current = data(capacitors.past[capacitors.newest]);
+  for (int i = 0; i < num_capacitors; ++i) {
+    const amc_float voltage = x[c_node1[i]] - x[c_node2[i]];
+    last_voltage[i] = voltage;
+    past_current[i] = c_G[i] * voltage - c_I[i];
+  }
+
+  inductors.newest = (inductors.newest + 2) % 3;
+  const int* l_node1 = data(inductors.node1);
+  const int* l_node2 = data(inductors.node2);
+  const int* l_line = data(inductors.currents_position);
+  amc_float* last_current = data(inductors.last_current);
+  amc_float* past_voltage = data(inductors.past[inductors.newest]);
+  for (int i = 0; i < num_inductors; ++i) {
+    past_voltage[i] = x[l_node1[i]] - x[l_node2[i]];
+    last_current[i] = x[l_line[i]];
+  }
+}
+
+// Only arrays are touched, so the compiler is free to vectorize both loops
+template<int order>
+void ElementGroups::update_companions(amc_float step_s) {
+  typedef AdamsMoulton<order> Method;
+
+  const int num_capacitors = capacitors.C.size();
+  const amc_float* C = data(capacitors.C);
+  const amc_float* last_voltage = data(capacitors.last_voltage);
+  const amc_float* c_past0 = data(capacitors.past[capacitors.newest]);
+  const amc_float* c_past1 =
+      data(capacitors.past[(capacitors.newest + 1) % 3]);
+  const amc_float* c_past2 =
+      data(capacitors.past[(capacitors.newest + 2) % 3]);
+  amc_float* G = data(capacitors.G);
+  amc_float* I = data(capacitors.I);
+  for (int i = 0; i < num_capacitors; ++i) {
+    const amc_float conductance = Method::gain(C[i], step_s);
+    G[i] = conductance;
+    I[i] = Method::source(conductance * last_voltage[i], c_past0[i],
+                          c_past1[i], c_past2[i]);
+  }
+
+  const int num_inductors = inductors.L.size();
+  const amc_float* L = data(inductors.L);
+  const amc_float* last_current = data(inductors.last_current);
+  const amc_float* l_past0 = data(inductors.past[inductors.newest]);
+  const amc_float* l_past1 = data(inductors.past[(inductors.newest + 1) % 3]);
+  const amc_float* l_past2 = data(inductors.past[(inductors.newest + 2) % 3]);
+  amc_float* R = data(inductors.R);
+  amc_float* V = data(inductors.V);
+  for (int i = 0; i < num_inductors; ++i) {
+    const amc_float resistance = Method::gain(L[i], step_s);
+    R[i] = resistance;
+    V[i] = Method::source(resistance * last_current[i], l_past0[i],
+                          l_past1[i], l_past2[i]);
+  }
+
+  // The sources are linear on the last currents, those of the other windings
+  // are added through the mutual inductances
+  const int num_blocks = couplings.first_member.size() - 1;
+  const amc_float* M = data(couplings.M);
+  amc_float* gain = data(couplings.gain);
+  for (int k = 0; k < num_blocks; ++k) {
+    const int* member = data(couplings.member) + couplings.first_member[k];
+    const int size = couplings.first_member[k + 1] - couplings.first_member[k];
+    const int first_entry = couplings.first_entry[k];
+    for (int i = 0; i < size; ++i) {
+      amc_float coupled = 0;
+      for (int j = 0; j < size; ++j) {
+        const int entry = first_entry + i * size + j;
+        gain[entry] = Method::gain(M[entry], step_s);
+        coupled += gain[entry] * last_current[member[j]];
+      }
+      V[member[i]] += coupled;
+    }
+  }
+}
+
+// Steps done again, as when a simulation restarts, replace the later ones
+void ElementGroups::send_waves(LineHistory& history, amc_float time,
+                               amc_float sent1, amc_float sent2) {
+  int capacity = history.time.size();
+  while (history.count > 0 &&
+         history.time[(history.oldest + history.count - 1) % capacity]
+             >= time) {
+    --history.count;
+  }
+  if (history.count == capacity) {
+    const int new_capacity = capacity > 0 ? 2 * capacity : 8;
+    std::vector<amc_float> times(new_capacity);
+    std::vector<amc_float> waves1(new_capacity);
+    std::vector<amc_float> waves2(new_capacity);
+    for (int k = 0; k < history.count; ++k) {
+      const int position = (history.oldest + k) % capacity;
+      times[k] = history.time[position];
+      waves1[k] = history.sent1[position];
+      waves2[k] = history.sent2[position];
+    }
+    history.time.swap(times);
+    history.sent1.swap(waves1);
+    history.sent2.swap(waves2);
+    history.oldest = 0;
+    capacity = new_capacity;
+  }
+  const int newest = (history.oldest + history.count) % capacity;
+  history.time[newest] = time;
+  history.sent1[newest] = sent1;
+  history.sent2[newest] = sent2;
+  ++history.count;
+}
+
+// Waves sent at `time`, interpolated between the steps around it. Nothing was
+// sent before the first step and delays shorter than a step take the last wave
+// sent.
+void ElementGroups::sent_at(const LineHistory& history, amc_float time,
+                            amc_float& sent1, amc_float& sent2) {
+  const int capacity = history.time.size();
+  if (history.count == 0 || time < history.time[history.oldest]) {
+    sent1 = sent2 = 0;
+    return;
+  }
+  int k = 0;
+  while (k + 1 < history.count &&
+         time >= history.time[(history.oldest + k + 1) % capacity]) {
+    ++k;
+  }
+  const int before = (history.oldest + k) % capacity;
+  if (k + 1 == history.count) {
+    sent1 = history.sent1[before];
+    sent2 = history.sent2[before];
+    return;
+  }
+  const int after = (before + 1) % capacity;
+  const amc_float fraction = (time - history.time[before])
+                             / (history.time[after] - history.time[before]);
+  sent1 = history.sent1[before]
+          + fraction * (history.sent1[after] - history.sent1[before]);
+  sent2 = history.sent2[before]
+          + fraction * (history.sent2[after] - history.sent2[before]);
+}
+
+// Once a step is taken, later points are never before it, so the waves sent
+// before the last step preceding `time` are no longer needed. They are kept
+// until then, as a step may be tried up to its end before being cut.
+void ElementGroups::drop_sent_before(LineHistory& history, amc_float time) {
+  const int capacity = history.time.size();
+  while (history.count > 1 &&
+         time >= history.time[(history.oldest + 1) % capacity]) {
+    history.oldest = (history.oldest + 1) % capacity;
+    --history.count;
+  }
+}
+
+// The solution of the last step is only known once the next one starts
+void ElementGroups::update_incident_waves(const StampParameters& p) {
+  const int num_lines = lines.Z0.size();
+  const amc_float* x = p.x;
+  if (p.new_nr_cycle && lines.stepped) {
+    for (int i = 0; i < num_lines; ++i) {
+      const int line = lines.currents_position[i];
+      const amc_float Z0 = lines.Z0[i];
+      send_waves(lines.history[i], lines.last_time,
+                 x[lines.port1_p[i]] - x[lines.port1_n[i]] + Z0 * x[line],
+                 x[lines.port2_p[i]] - x[lines.port2_n[i]] + Z0 * x[line + 1]);
+      drop_sent_before(lines.history[i], lines.last_time - lines.TD[i]);
+    }
+  }
+  lines.last_time = p.time;
+  lines.stepped = true;
+
+  for (int i = 0; i < num_lines; ++i) {
+    amc_float* state = p.state + lines.state_position[i];
+    amc_float sent1, sent2;
+    sent_at(lines.history[i], p.time - lines.TD[i], sent1, sent2);
+    state[TransmissionLine::INCIDENT1] = sent2;
+    state[TransmissionLine::INCIDENT2] = sent1;
+  }
+}
+
+void ElementGroups::stamp_lines(StampParameters& p) {
+  if (!p.dc_analysis) {
+    update_incident_waves(p);
+  }
+  for (unsigned i = 0; i < lines.Z0.size(); ++i) {
+    p.currents_position = lines.currents_position[i];
+    TransmissionLine::stamp(p, lines.port1_p[i], lines.port1_n[i],
+                            lines.port2_p[i], lines.port2_n[i], lines.Z0[i],
+                            p.state + lines.state_position[i]);
+  }
+}
+
+void ElementGroups::stamp_diodes(const StampParameters& p) {
+  const int num_diodes = diodes.Is.size();
+  const int* node1 = data(diodes.node1);
+  const int* node2 = data(diodes.node2);
+  const amc_float* Is = data(diodes.Is);
+  const amc_float* nVt = data(diodes.nVt);
+  amc_float* voltage = data(diodes.voltage);
+  amc_float* G = data(diodes.G);
+  amc_float* I = data(diodes.I);
+
+  for (int i = 0; i < num_diodes; ++i) {
+    amc_float& last_voltage = p.state[diodes.state_position[i]
+                                      + Diode::LAST_VOLTAGE];
+    const amc_float trial = p.last_nr_trial[node1[i]]
+                            - p.last_nr_trial[node2[i]];
+    last_voltage = limit_junction_voltage(trial, last_voltage, nVt[i],
+                                          diodes.critical_voltage[i]);
+    p.limited = p.limited || last_voltage != trial;
+    voltage[i] = last_voltage;
+  }
+
+  for (int i = 0; i < num_diodes; ++i) {
+    linearize_diode(voltage[i], Is[i], nVt[i], G[i], I[i]);
+  }
+
+  amc_float** A = p.A;
+  amc_float* b = p.b;
+  for (int i = 0; i < num_diodes; ++i) {
+    A[node1[i]][node1[i]] += G[i];
+    A[node2[i]][node2[i]] += G[i];
+    A[node1[i]][node2[i]] -= G[i];
+    A[node2[i]][node1[i]] -= G[i];
+    b[node1[i]] -= I[i];
+    b[node2[i]] += I[i];
+  }
+}
+
+// Same as `Mosfet::place_stamp`, split in passes
+void ElementGroups::stamp_mosfets(const StampParameters& p) {
+  const int num_mosfets = mosfets.K.size();
+  const amc_float* x = p.last_nr_trial;
+  const int* gate = data(mosfets.gate);
+  const amc_float* sign = data(mosfets.sign);
+  const amc_float* K = data(mosfets.K);
+  const amc_float* Vt = data(mosfets.Vt);
+  const amc_float* lambda = data(mosfets.lambda);
+  int* drain = data(mosfets.effective_drain);
+  int* source = data(mosfets.effective_source);
+  amc_float* vgs = data(mosfets.vgs);
+  amc_float* vds = data(mosfets.vds);
+  amc_float* Id = data(mosfets.Id);
+  amc_float* gm = data(mosfets.gm);
+  amc_float* gds = data(mosfets.gds);
+
+  for (int i = 0; i < num_mosfets; ++i) {
+    int d = mosfets.drain[i];
+    int s = mosfets.source[i];
+    const amc_float trial_vgs = sign[i] * (x[gate[i]] - x[s]);
+    const amc_float trial_vds = sign[i] * (x[d] - x[s]);
+    amc_float gate_source = trial_vgs;
+    amc_float drain_source = trial_vds;
+    amc_float* state = p.state + mosfets.state_position[i];
+    limit_mosfet_voltages(gate_source, drain_source, state[Mosfet::LAST_VGS],
+                          state[Mosfet::LAST_VDS], Vt[i]);
+    p.limited = p.limited || gate_source != trial_vgs
+                || drain_source != trial_vds;
+    state[Mosfet::LAST_VGS] = gate_source;
+    state[Mosfet::LAST_VDS] = drain_source;
+    if (drain_source < 0) {
+      std::swap(d, s);
+      gate_source -= drain_source;
+      drain_source = -drain_source;
+    }
+    drain[i] = d;
+    source[i] = s;
+    vgs[i] = gate_source;
+    vds[i] = drain_source;
+  }
+
+  // Too many arrays for the compiler to check them for overlaps when running
+#pragma GCC ivdep
+  for (int i = 0; i < num_mosfets; ++i) {
+    mosfet_current(vgs[i], vds[i], K[i], Vt[i], lambda[i], Id[i], gm[i],
+                   gds[i]);
+  }
+
+  amc_float** A = p.A;
+  amc_float* b = p.b;
+  for (int i = 0; i < num_mosfets; ++i) {
+    const int d = drain[i];
+    const int s = source[i];
+    const int g = gate[i];
+    const amc_float I = sign[i] * (Id[i] - gm[i] * vgs[i] - gds[i] * vds[i]);
+    const amc_float G = gds[i] + SEMICONDUCTOR_GMIN;
+    A[d][d] += G;
+    A[s][s] += G;
+    A[d][s] -= G;
+    A[s][d] -= G;
+    A[d][g] += gm[i];
+    A[d][s] -= gm[i];
+    A[s][g] -= gm[i];
+    A[s][s] += gm[i];
+    b[d] -= I;
+    b[s] += I;
+  }
+}
+
+// Positions on the system and on the state are kept, as they only depend on
+// the type
+bool ElementGroups::find_switching(const StampParameters& p,
+                                   const amc_float* from, const amc_float* to,
+                                   amc_float& fraction) {
+  const int num_switches = switches.v_ref.size();
+  fraction = 1;
+  switches.changing.clear();
+  for (int i = 0; i < num_switches; ++i) {
+    const int ctrl_p = switches.node_ctrl_p[i];
+    const int ctrl_n = switches.node_ctrl_n[i];
+    const amc_float v_ref = switches.v_ref[i];
+    const amc_float control_to = to[ctrl_p] - to[ctrl_n];
+    const bool on = p.state[switches.state_position[i]
+                            + VoltageControlledSwitch::ON] != 0;
+    if ((control_to >= v_ref) == on) {
+      continue;
+    }
+    const amc_float control_from = from[ctrl_p] - from[ctrl_n];
+    amc_float crossing = 0;
+    if (control_to != control_from) {
+      crossing = (v_ref - control_from) / (control_to - control_from);
+      crossing = std::min(std::max(crossing, amc_float(0)), amc_float(1));
+    }
+    switches.fraction[i] = crossing;
+    switches.changing.push_back(i);
+    fraction = std::min(fraction, crossing);
+  }
+
+  // Only the first crossings are kept, the others may not happen once the
+  // first switches change
+  unsigned kept = 0;
+  for (unsigned k = 0; k < switches.changing.size(); ++k) {
+    const int i = switches.changing[k];
+    if (switches.fraction[i] <= fraction + SWITCH_MIN_CUT) {
+      switches.changing[kept++] = i;
+    }
+  }
+  switches.changing.resize(kept);
+  return kept > 0;
+}
+
+void ElementGroups::change_switches(const StampParameters& p) {
+  for (unsigned k = 0; k < switches.changing.size(); ++k) {
+    const int i = switches.changing[k];
+    amc_float& on = p.state[switches.state_position[i]
+                            + VoltageControlledSwitch::ON];
+    on = on == 0;
+  }
+  switches.changing.clear();
+}
+
+void ElementGroups::replace(int index, const Element::Handler& element) {
+  const int position = group_positions[index];
+  const Element* replaced = &(*element);
+  if (const Resistor* r = dynamic_cast<const Resistor*>(replaced)) {
+    resistors.node1[position] = r->get_node1();
+    resistors.node2[position] = r->get_node2();
+    resistors.G[position] = 1/r->get_R();
+  } else if (const Capacitor* c = dynamic_cast<const Capacitor*>(replaced)) {
+    capacitors.node1[position] = c->get_node1();
+    capacitors.node2[position] = c->get_node2();
+    capacitors.C[position] = c->get_C();
+  } else if (const Inductor* l = dynamic_cast<const Inductor*>(replaced)) {
+    inductors.node1[position] = l->get_node1();
+    inductors.node2[position] = l->get_node2();
+    inductors.L[position] = l->get_L();
+    update_mutual_inductances();
+  } else if (dynamic_cast<const MutualInductance*>(replaced) != NULL) {
+    couplings.mutuals[position] = element;
+    couple_inductors();
+  } else if (const TransmissionLine* t =
+                 dynamic_cast<const TransmissionLine*>(replaced)) {
+    lines.port1_p[position] = t->get_port1_p();
+    lines.port1_n[position] = t->get_port1_n();
+    lines.port2_p[position] = t->get_port2_p();
+    lines.port2_n[position] = t->get_port2_n();
+    lines.Z0[position] = t->get_Z0();
+    lines.TD[position] = t->get_TD();
+  } else if (const Diode* d = dynamic_cast<const Diode*>(replaced)) {
+    diodes.node1[position] = d->get_node1();
+    diodes.node2[position] = d->get_node2();
+    diodes.Is[position] = d->get_Is();
+    diodes.nVt[position] = d->get_n() * THERMAL_VOLTAGE;
+    diodes.critical_voltage[position] = d->get_critical_voltage();
+  } else if (const Mosfet* m = dynamic_cast<const Mosfet*>(replaced)) {
+    mosfets.drain[position] = m->get_drain();
+    mosfets.gate[position] = m->get_gate();
+    mosfets.source[position] = m->get_source();
+    mosfets.sign[position] = m->is_p_channel() ? -1 : 1;
+    mosfets.K[position] = m->get_K();
+    mosfets.Vt[position] = mosfets.sign[position] * m->get_Vt();
+    mosfets.lambda[position] = m->get_lambda();
+  } else if (const VoltageControlledSwitch* w =
+                 dynamic_cast<const VoltageControlledSwitch*>(replaced)) {
+    switches.node_p[position] = w->get_node_p();
+    switches.node_n[position] = w->get_node_n();
+    switches.node_ctrl_p[position] = w->get_node_ctrl_p();
+    switches.node_ctrl_n[position] = w->get_node_ctrl_n();
+    switches.g_on[position] = w->get_g_on();
+    switches.g_off[position] = w->get_g_off();
+    switches.v_ref[position] = w->get_v_ref();
+  } else if (const VoltageSource* v =
+                 dynamic_cast<const VoltageSource*>(replaced)) {
+    voltage_sources.node_p[position] = v->get_node_p();
+    voltage_sources.node_n[position] = v->get_node_n();
+    voltage_sources.signal[position] = v->get_signal();
+    replace_signal(position);
+  } else if (const CurrentSource* s =
+                 dynamic_cast<const CurrentSource*>(replaced)) {
+    current_sources.node_p[position] = s->get_node_p();
+    current_sources.node_n[position] = s->get_node_n();
+    current_sources.signal[position] = s->get_signal();
+    replace_signal(voltage_sources.signal.size() + position);
+  } else {
+    others.element[position] = element;
+  }
+}
+
+template void ElementGroups::place_stamps<1>(StampParameters& p);
+template void ElementGroups::place_stamps<2>(StampParameters& p);
+template void ElementGroups::place_stamps<3>(StampParameters& p);
+template void ElementGroups::place_stamps<4>(StampParameters& p);
+
+}  // namespace amcircuit
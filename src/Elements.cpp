@@ -5,26 +5,38 @@
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <cctype>
+#include <cmath>
 
 #include "Elements.h"
 #include "helpers.h"
 #include "AMCircuitException.h"
+#include "Subcircuit.h"
+#include "AdamsMoulton.h"
+#include "DeviceModels.h"
 
 namespace amcircuit {
 
-StampParameters::StampParameters(int system_size) : system_size(system_size) {
+StampParameters::StampParameters(int system_size, int num_states)
+    : system_size(system_size) {
   A = allocate_matrix(system_size);
   b = allocate_vector(system_size);
   x = allocate_vector(system_size);
   last_nr_trial = allocate_vector(system_size);
+  state = allocate_vector(num_states);
 
   zero_vector(x, system_size);
   zero_vector(last_nr_trial, system_size);
+  zero_vector(state, num_states);
 
   method_order = 0;
   use_ic = false;
+  dc_analysis = false;
   new_nr_cycle = true;
+  limited = false;
   time = 0;
+  currents_position = -1;
+  state_position = -1;
 }
 
 StampParameters::~StampParameters() {
@@ -32,10 +44,13 @@ StampParameters::~StampParameters() {
   free(b);
   free(x);
   free(last_nr_trial);
+  free(state);
 }
 
-Element::Element(const std::string& params) : line_stream(params) {
-  line_stream >> name;
+Element::Element(const std::string& name) : name(name) { }
+
+Element::Element(Tokenizer& params) {
+  params >> name;
 }
 
 inline Element::~Element() { } //  not to be implemented by Element
@@ -43,37 +58,49 @@ inline Element::~Element() { } //  not to be implemented by Element
 // TODO There are ways of making this better, none of which I'm wishing to
 //      implement right now. (use a map that can be modified from outside and
 //      even allowing subclasses to include themselves)
-Element::Handler Element::get_element(const std::string& element_string) {
-  switch (::toupper(element_string[0])) {
+Element::Handler Element::get_element(Tokenizer element_string) {
+  switch (::toupper(element_string.first())) {
     case 'R': return Handler(new Resistor(element_string));
     case 'N': return Handler(new NonLinearResistor(element_string));
     case '$': return Handler(new VoltageControlledSwitch(element_string));
     case 'L': return Handler(new Inductor(element_string));
+    case 'K': return Handler(new MutualInductance(element_string));
     case 'C': return Handler(new Capacitor(element_string));
+    case 'D': return Handler(new Diode(element_string));
+    case 'M': return Handler(new Mosfet(element_string));
+    case 'T': return Handler(new TransmissionLine(element_string));
     case 'E': return Handler(new VoltageControlledVoltageSource(element_string));
     case 'F': return Handler(new CurrentControlledCurrentSource(element_string));
     case 'G': return Handler(new VoltageControlledCurrentSource(element_string));
     case 'H': return Handler(new CurrentControlledVoltageSource(element_string));
+    case 'B': return Handler(new BehavioralSource(element_string));
     case 'I': return Handler(new CurrentSource(element_string));
     case 'V': return Handler(new VoltageSource(element_string));
     case 'O': return Handler(new IdealOpAmp(element_string));
+    case 'X': return Handler(new SubcircuitInstance(element_string));
     default:break;
   }
-  throw BadElementString("Invalid string \"" + element_string + "\"");
+  throw BadElementString("Invalid string \"" + element_string.str() + "\"");
 }
 
 std::string Element::get_name() const {
   return name;
 }
 
+int Element::get_num_of_states() const {
+  return 0;
+}
+
+void Element::initialize_state(amc_float*) const { }
+
 
 DoubleTerminalElement::DoubleTerminalElement(const std::string& name, int node1,
                                              int node2)
     : Element(name), node1(node1), node2(node2) { }
 
-DoubleTerminalElement::DoubleTerminalElement(const std::string& params)
+DoubleTerminalElement::DoubleTerminalElement(Tokenizer& params)
     : Element(params) {
-  line_stream >> node1 >> node2;
+  params >> as_node(node1) >> as_node(node2);
 }
 
 int DoubleTerminalElement::get_node1() const {
@@ -84,13 +111,18 @@ int DoubleTerminalElement::get_node2() const {
   return node2;
 }
 
+void DoubleTerminalElement::append_nodes(std::vector<int>& nodes) const {
+  nodes.push_back(node1);
+  nodes.push_back(node2);
+}
+
 SimpleSourceElement::SimpleSourceElement(const std::string& name, int node_p,
                                          int node_n)
     : Element(name), node_p(node_p), node_n(node_n) { }
 
-SimpleSourceElement::SimpleSourceElement(const std::string& params)
+SimpleSourceElement::SimpleSourceElement(Tokenizer& params)
     : Element(params) {
-  line_stream >> node_p >> node_n;
+  params >> as_node(node_p) >> as_node(node_n);
 }
 
 int SimpleSourceElement::get_node_p() const {
@@ -101,13 +133,18 @@ int SimpleSourceElement::get_node_n() const {
   return node_n;
 }
 
+void SimpleSourceElement::append_nodes(std::vector<int>& nodes) const {
+  nodes.push_back(node_p);
+  nodes.push_back(node_n);
+}
+
 ArbitrarySourceElement::ArbitrarySourceElement(const std::string& name,
                                                int node_p, int node_n,
                                                Signal::Handler signal)
     : SimpleSourceElement(name, node_p, node_n), signal(signal) { }
 
-ArbitrarySourceElement::ArbitrarySourceElement(const std::string& params)
-    : SimpleSourceElement(params), signal(Signal::get_signal(line_stream)) { }
+ArbitrarySourceElement::ArbitrarySourceElement(Tokenizer& params)
+    : SimpleSourceElement(params), signal(Signal::get_signal(params)) { }
 
 const Signal::Handler& ArbitrarySourceElement::get_signal() const {
   return signal;
@@ -119,9 +156,10 @@ ControlledElement::ControlledElement(const std::string& name, int node_p,
     : Element(name), node_p(node_p), node_n(node_n),
       node_ctrl_p(node_ctrl_p), node_ctrl_n(node_ctrl_n) { }
 
-ControlledElement::ControlledElement(const std::string& params)
+ControlledElement::ControlledElement(Tokenizer& params)
     : Element(params) {
-  line_stream >> node_p >> node_n >> node_ctrl_p >> node_ctrl_n;
+  params >> as_node(node_p) >> as_node(node_n) >> as_node(node_ctrl_p)
+         >> as_node(node_ctrl_n);
 }
 
 int ControlledElement::get_node_p() const {
@@ -140,22 +178,36 @@ int ControlledElement::get_node_ctrl_n() const {
   return node_ctrl_n;
 }
 
+void ControlledElement::append_nodes(std::vector<int>& nodes) const {
+  nodes.push_back(node_p);
+  nodes.push_back(node_n);
+  nodes.push_back(node_ctrl_p);
+  nodes.push_back(node_ctrl_n);
+}
+
 Resistor::Resistor(const std::string& name, int node1, int node2, amc_float R)
     : DoubleTerminalElement(name, node1, node2), R(R) { }
 
-Resistor::Resistor(const std::string& params) : DoubleTerminalElement(params) {
-  line_stream >> R;
+Resistor::Resistor(Tokenizer params) : DoubleTerminalElement(params) {
+  params >> R;
 }
 
 amc_float Resistor::get_R() const {
   return R;
 }
 
+Element::Handler Resistor::instantiate(const std::string& prefix,
+                                     NodeMap& nodes) const {
+  const int node1 = nodes.map(get_node1());
+  const int node2 = nodes.map(get_node2());
+  return Handler(new Resistor(prefix + get_name(), node1, node2, R));
+}
+
 int Resistor::get_num_of_currents() const {
   return 0;
 }
 
-void Resistor::place_stamp(const StampParameters& p) {
+void Resistor::place_stamp(const StampParameters& p) const {
   p.A[get_node1()][get_node1()] += 1/R;
   p.A[get_node2()][get_node2()] += 1/R;
   p.A[get_node1()][get_node2()] -= 1/R;
@@ -167,21 +219,92 @@ NonLinearResistor::NonLinearResistor(const std::string& name, int node1,
                                      const std::vector<coordinate>& coordinates)
     : DoubleTerminalElement(name, node1, node2), coordinates(coordinates) {
   std::sort(this->coordinates.begin(), this->coordinates.end());
+  build_grid();
 }
 
-NonLinearResistor::NonLinearResistor(const std::string& params)
+NonLinearResistor::NonLinearResistor(Tokenizer params)
     : DoubleTerminalElement(params) {
-  while(line_stream) {
+  while(params) {
     coordinate c;
-    if (!(line_stream >> c.first)) {
+    if (!(params >> c.first)) {
       break;
     }
-    if (!(line_stream >> c.second)) {
+    if (!(params >> c.second)) {
       break;
     }
     coordinates.push_back(c);
   }
   std::sort(coordinates.begin(), coordinates.end());
+  build_grid();
+}
+
+// Each bin keeps where the search for its first voltage ends, so any voltage
+// on it is just a few points away
+void NonLinearResistor::build_grid() {
+  grid.clear();
+  grid_origin = 0;
+  grid_scale = 0;
+  const int num_points = coordinates.size();
+  if (num_points < NONLINEAR_RESISTOR_GRID_MIN_POINTS) {
+    return;
+  }
+  const amc_float first = coordinates[1].first;
+  const amc_float span = coordinates[num_points - 1].first - first;
+  if (!(span > 0)) {
+    return;
+  }
+  grid_origin = first;
+  grid_scale = num_points / span;
+  grid.resize(num_points);
+  for (int bin = 0; bin < num_points; ++bin) {
+    const coordinate start(grid_origin + bin / grid_scale, 0);
+    grid[bin] = std::lower_bound(coordinates.begin() + 1, coordinates.end(),
+                                 start) - coordinates.begin();
+  }
+}
+
+// Segment k holds the voltage when the points before it are below the voltage
+// and point k is not (but for the first and last segments, which extend past
+// the table). The result is always the same as a binary search's.
+int NonLinearResistor::find_segment(amc_float voltage, int hint) const {
+  const int num_points = coordinates.size();
+  const int last = num_points - 1;
+  const coordinate point(voltage, 0);
+
+  int k = hint >= 1 && hint <= last ? hint : 1;
+  for (int moves = 0; ; ++moves) {
+    const bool below = k > 1 && !(coordinates[k - 1] < point);
+    const bool above = k < last && coordinates[k] < point;
+    if (!below && !above) {
+      return k;
+    }
+    if (moves == NONLINEAR_RESISTOR_CURSOR_MOVES) {
+      break;
+    }
+    k += above ? 1 : -1;
+  }
+
+  if (grid.empty()) {
+    k = std::lower_bound(coordinates.begin() + 1, coordinates.end(), point)
+        - coordinates.begin();
+  } else {
+    const amc_float position = (voltage - grid_origin) * grid_scale;
+    int bin = 0;
+    if (position >= num_points) {
+      bin = num_points - 1;
+    } else if (position >= 0) {
+      bin = static_cast<int>(position);
+    }
+    // Rounding may leave the voltage slightly off its bin
+    k = grid[bin];
+    while (k > 1 && !(coordinates[k - 1] < point)) {
+      --k;
+    }
+    while (k < num_points && coordinates[k] < point) {
+      ++k;
+    }
+  }
+  return k < last ? k : last;
 }
 
 const std::vector<NonLinearResistor::coordinate>&
@@ -189,22 +312,38 @@ NonLinearResistor::get_coordinates() const {
   return coordinates;
 }
 
+Element::Handler NonLinearResistor::instantiate(const std::string& prefix,
+                                              NodeMap& nodes) const {
+  const int node1 = nodes.map(get_node1());
+  const int node2 = nodes.map(get_node2());
+  return Handler(new NonLinearResistor(prefix + get_name(), node1, node2,
+                                       coordinates));
+}
+
 int NonLinearResistor::get_num_of_currents() const {
   return 0;
 }
 
-void NonLinearResistor::place_stamp(const StampParameters& p) {
+int NonLinearResistor::get_num_of_states() const {
+  return NUM_OF_STATES;
+}
+
+void NonLinearResistor::initialize_state(amc_float* state) const {
+  state[SEGMENT] = 1;
+}
+
+// Successive Newton-Raphson trials usually fall on the same segment, or on a
+// neighbour, so the search starts from the last one
+void NonLinearResistor::place_stamp(const StampParameters& p) const {
   amc_float voltage = p.last_nr_trial[get_node1()]-p.last_nr_trial[get_node2()];
-  std::vector<coordinate>::iterator resistance_range =
-      std::lower_bound(coordinates.begin() + 1, coordinates.end(),
-                       coordinate(voltage, 0));
-  if (resistance_range == coordinates.end()) {
-    resistance_range = coordinates.end() - 1;
-  }
-  amc_float j1 = (resistance_range-1)->second;
-  amc_float j2 = resistance_range->second;
-  amc_float v1 = (resistance_range-1)->first;
-  amc_float v2 = resistance_range->first;
+  amc_float& last_segment = p.state[p.state_position + SEGMENT];
+  const int segment = find_segment(voltage,
+                                   static_cast<int>(last_segment));
+  last_segment = segment;
+  amc_float j1 = coordinates[segment - 1].second;
+  amc_float j2 = coordinates[segment].second;
+  amc_float v1 = coordinates[segment - 1].first;
+  amc_float v2 = coordinates[segment].first;
   amc_float G = (j2 - j1)/(v2 - v1);
   amc_float I = j2 - G * v2;
 
@@ -222,9 +361,9 @@ VoltageControlledSwitch::VoltageControlledSwitch(
     : ControlledElement(name, node_p, node_n, node_ctrl_p, node_ctrl_n),
       g_on(g_on), g_off(g_off), v_ref(v_ref) { }
 
-VoltageControlledSwitch::VoltageControlledSwitch(const std::string& params)
+VoltageControlledSwitch::VoltageControlledSwitch(Tokenizer params)
     : ControlledElement(params), g_on(0.0), g_off(0.0), v_ref(0.0) {
-  line_stream >> g_on >> g_off >> v_ref;
+  params >> g_on >> g_off >> v_ref;
 }
 
 amc_float VoltageControlledSwitch::get_g_on() const {
@@ -239,14 +378,35 @@ amc_float VoltageControlledSwitch::get_v_ref() const {
   return v_ref;
 }
 
+Element::Handler VoltageControlledSwitch::instantiate(
+    const std::string& prefix, NodeMap& nodes) const {
+  const int node_p = nodes.map(get_node_p());
+  const int node_n = nodes.map(get_node_n());
+  const int node_ctrl_p = nodes.map(get_node_ctrl_p());
+  const int node_ctrl_n = nodes.map(get_node_ctrl_n());
+  return Handler(new VoltageControlledSwitch(
+      prefix + get_name(), node_p, node_n, node_ctrl_p, node_ctrl_n, g_on,
+      g_off, v_ref));
+}
+
+bool VoltageControlledSwitch::is_on_at(amc_float control) const {
+  return control >= v_ref;
+}
+
 int VoltageControlledSwitch::get_num_of_currents() const {
   return 0;
 }
 
-void VoltageControlledSwitch::place_stamp(const StampParameters& p) {
-  amc_float v_ctrl = p.last_nr_trial[get_node_ctrl_p()]
-                           - p.last_nr_trial[get_node_ctrl_n()];
-  amc_float G = v_ctrl < v_ref ? g_off : g_on;
+int VoltageControlledSwitch::get_num_of_states() const {
+  return NUM_OF_STATES;
+}
+
+void VoltageControlledSwitch::initialize_state(amc_float* state) const {
+  state[ON] = is_on_at(0);
+}
+
+void VoltageControlledSwitch::place_stamp(const StampParameters& p) const {
+  amc_float G = p.state[p.state_position + ON] != 0 ? g_on : g_off;
 
   p.A[get_node_p()][get_node_p()] += G;
   p.A[get_node_n()][get_node_n()] += G;
@@ -254,28 +414,203 @@ void VoltageControlledSwitch::place_stamp(const StampParameters& p) {
   p.A[get_node_n()][get_node_p()] -= G;
 }
 
+Diode::Diode(const std::string& name, int anode, int cathode, amc_float Is,
+             amc_float n)
+    : DoubleTerminalElement(name, anode, cathode), Is(Is), n(n),
+      critical_voltage(junction_critical_voltage(Is, n * THERMAL_VOLTAGE)) { }
+
+Diode::Diode(Tokenizer params)
+    : DoubleTerminalElement(params), Is(1E-14), n(1) {
+  amc_float value;
+  if (params >> value) {
+    Is = value;
+    if (params >> value) {
+      n = value;
+    }
+  }
+  if (!(Is > 0) || !(n > 0)) {
+    throw BadElementString("Invalid diode \"" + params.str() + "\"");
+  }
+  critical_voltage = junction_critical_voltage(Is, n * THERMAL_VOLTAGE);
+}
+
+amc_float Diode::get_Is() const {
+  return Is;
+}
+
+amc_float Diode::get_n() const {
+  return n;
+}
+
+amc_float Diode::get_critical_voltage() const {
+  return critical_voltage;
+}
+
+Element::Handler Diode::instantiate(const std::string& prefix,
+                                    NodeMap& nodes) const {
+  const int anode = nodes.map(get_node1());
+  const int cathode = nodes.map(get_node2());
+  return Handler(new Diode(prefix + get_name(), anode, cathode, Is, n));
+}
+
+int Diode::get_num_of_currents() const {
+  return 0;
+}
+
+int Diode::get_num_of_states() const {
+  return NUM_OF_STATES;
+}
+
+void Diode::place_stamp(const StampParameters& p) const {
+  const amc_float nVt = n * THERMAL_VOLTAGE;
+  amc_float& last_voltage = p.state[p.state_position + LAST_VOLTAGE];
+  const amc_float trial = p.last_nr_trial[get_node1()]
+                          - p.last_nr_trial[get_node2()];
+  const amc_float voltage = limit_junction_voltage(trial, last_voltage, nVt,
+                                                   critical_voltage);
+  p.limited = p.limited || voltage != trial;
+  last_voltage = voltage;
+  amc_float G, I;
+  linearize_diode(voltage, Is, nVt, G, I);
+
+  p.A[get_node1()][get_node1()] += G;
+  p.A[get_node2()][get_node2()] += G;
+  p.A[get_node1()][get_node2()] -= G;
+  p.A[get_node2()][get_node1()] -= G;
+  p.b[get_node1()] -= I;
+  p.b[get_node2()] += I;
+}
+
+Mosfet::Mosfet(const std::string& name, int drain, int gate, int source,
+               bool p_channel, amc_float K, amc_float Vt, amc_float lambda)
+    : Element(name), drain(drain), gate(gate), source(source),
+      p_channel(p_channel), K(K), Vt(Vt), lambda(lambda) { }
+
+Mosfet::Mosfet(Tokenizer params) : Element(params), lambda(0) {
+  std::string type;
+  params >> as_node(drain) >> as_node(gate) >> as_node(source) >> type >> K
+         >> Vt;
+  for (unsigned i = 0; i < type.size(); ++i) {
+    type[i] = ::toupper(type[i]);
+  }
+  if (!params || (type != "NMOS" && type != "PMOS")) {
+    throw BadElementString("Invalid MOSFET \"" + params.str() + "\"");
+  }
+  p_channel = type == "PMOS";
+  amc_float value;
+  if (params >> value) {
+    lambda = value;
+  }
+}
+
+int Mosfet::get_drain() const {
+  return drain;
+}
+
+int Mosfet::get_gate() const {
+  return gate;
+}
+
+int Mosfet::get_source() const {
+  return source;
+}
+
+bool Mosfet::is_p_channel() const {
+  return p_channel;
+}
+
+amc_float Mosfet::get_K() const {
+  return K;
+}
+
+amc_float Mosfet::get_Vt() const {
+  return Vt;
+}
+
+amc_float Mosfet::get_lambda() const {
+  return lambda;
+}
+
+void Mosfet::append_nodes(std::vector<int>& nodes) const {
+  nodes.push_back(drain);
+  nodes.push_back(gate);
+  nodes.push_back(source);
+}
+
+Element::Handler Mosfet::instantiate(const std::string& prefix,
+                                     NodeMap& nodes) const {
+  const int mapped_drain = nodes.map(drain);
+  const int mapped_gate = nodes.map(gate);
+  const int mapped_source = nodes.map(source);
+  return Handler(new Mosfet(prefix + get_name(), mapped_drain, mapped_gate,
+                            mapped_source, p_channel, K, Vt, lambda));
+}
+
+int Mosfet::get_num_of_currents() const {
+  return 0;
+}
+
+int Mosfet::get_num_of_states() const {
+  return NUM_OF_STATES;
+}
+
+// P channel transistors are taken as n channel ones with every voltage and
+// current negated. The current is linearized as a conductance `gds` from drain
+// to source, a transconductance `gm` from the gate and a current source.
+void Mosfet::place_stamp(const StampParameters& p) const {
+  const amc_float sign = p_channel ? -1 : 1;
+  const amc_float* x = p.last_nr_trial;
+  const amc_float trial_vgs = sign * (x[gate] - x[source]);
+  const amc_float trial_vds = sign * (x[drain] - x[source]);
+  amc_float vgs = trial_vgs;
+  amc_float vds = trial_vds;
+  amc_float* state = p.state + p.state_position;
+  limit_mosfet_voltages(vgs, vds, state[LAST_VGS], state[LAST_VDS],
+                        sign * Vt);
+  p.limited = p.limited || vgs != trial_vgs || vds != trial_vds;
+  state[LAST_VGS] = vgs;
+  state[LAST_VDS] = vds;
+
+  int d = drain;
+  int s = source;
+  if (vds < 0) {
+    std::swap(d, s);
+    vgs -= vds;
+    vds = -vds;
+  }
+  amc_float Id, gm, gds;
+  mosfet_current(vgs, vds, K, sign * Vt, lambda, Id, gm, gds);
+  const amc_float I = sign * (Id - gm * vgs - gds * vds);
+  const amc_float G = gds + SEMICONDUCTOR_GMIN;
+
+  p.A[d][d] += G;
+  p.A[s][s] += G;
+  p.A[d][s] -= G;
+  p.A[s][d] -= G;
+  p.A[d][gate] += gm;
+  p.A[d][s] -= gm;
+  p.A[s][gate] -= gm;
+  p.A[s][s] += gm;
+  p.b[d] -= I;
+  p.b[s] += I;
+}
+
 Inductor::Inductor(const std::string& name, int node1, int node2, amc_float L,
                    amc_float initial_current)
     : DoubleTerminalElement(name, node1, node2), L(L),
-      initial_current(initial_current) {
-  initialize();
-}
+      initial_current(initial_current) { }
 
-Inductor::Inductor(const std::string& params) : DoubleTerminalElement(params),
+Inductor::Inductor(Tokenizer params) : DoubleTerminalElement(params),
                                                 initial_current(0) {
   std::string ic_string = "";
-  line_stream >> L >> ic_string;
+  params >> L >> ic_string;
   if (ic_string.size() > 0) {
     if (ic_string.substr(0,3) != "IC=") {
-      throw BadElementString("Invalid string \"" + params + "\"");
+      throw BadElementString("Invalid string \"" + params.str() + "\"");
     }
-    std::stringstream(ic_string.substr(3,std::string::npos)) >> initial_current;
+    Tokenizer(ic_string.data() + 3, ic_string.data() + ic_string.size())
+        >> initial_current;
   }
-  initialize();
-}
-
-void Inductor::initialize() {
-  past_voltages[2] = past_voltages[1] = past_voltages[0] = 0;
 }
 
 amc_float Inductor::get_L() const {
@@ -286,86 +621,143 @@ amc_float Inductor::get_initial_current() const {
   return initial_current;
 }
 
+Element::Handler Inductor::instantiate(const std::string& prefix,
+                                     NodeMap& nodes) const {
+  const int node1 = nodes.map(get_node1());
+  const int node2 = nodes.map(get_node2());
+  return Handler(new Inductor(prefix + get_name(), node1, node2, L,
+                              initial_current));
+}
+
 int Inductor::get_num_of_currents() const {
   return 1;
 }
 
-void Inductor::place_stamp(const StampParameters& p) {
+int Inductor::get_num_of_states() const {
+  return NUM_OF_STATES;
+}
+
+void Inductor::initialize_state(amc_float* state) const {
+  state[INITIAL_CURRENT] = initial_current;
+  state[LAST_CURRENT] = 0;
+  state[PAST_VOLTAGES + 2] = state[PAST_VOLTAGES + 1] = state[PAST_VOLTAGES] = 0;
+}
+
+void Inductor::place_stamp(const StampParameters& p) const {
+  stamp(p, get_node1(), get_node2(), p.currents_position, L,
+        p.state + p.state_position);
+}
+
+void Inductor::stamp(const StampParameters& p, int node1, int node2,
+                     int currents_position, amc_float L, amc_float* state) {
+  // Short circuit on DC, the branch current is still part of the system
+  if (p.dc_analysis) {
+    p.A[node1][currents_position] += 1;
+    p.A[node2][currents_position] -= 1;
+    p.A[currents_position][node1] -= 1;
+    p.A[currents_position][node2] += 1;
+    return;
+  }
+
+  amc_float* past_voltages = state + PAST_VOLTAGES;
+  amc_float& last_current = state[LAST_CURRENT];
+
   int method_order = p.method_order;
   if (p.use_ic) {
     method_order = 1;
-    last_current = initial_current;
+    last_current = state[INITIAL_CURRENT];
   }
   if(p.new_nr_cycle) {
     past_voltages[2] = past_voltages[1];
     past_voltages[1] = past_voltages[0];
-    past_voltages[0] = p.x[get_node1()] - p.x[get_node2()];
-    last_current = p.x[p.currents_position];
+    past_voltages[0] = p.x[node1] - p.x[node2];
+    last_current = p.x[currents_position];
   }
 
   // Modelled using a resistor in series with a voltage source
   amc_float R;
   amc_float V;
+  adams_moulton(method_order, L, p.step_s, last_current, past_voltages, R, V);
+
+  p.A[node1][currents_position] += 1;
+  p.A[node2][currents_position] -= 1;
+  p.A[currents_position][node1] -= 1;
+  p.A[currents_position][node2] += 1;
+  p.A[currents_position][currents_position] += R;
+  p.b[currents_position] += V;
+}
+
+MutualInductance::MutualInductance(const std::string& name,
+                                   const std::vector<std::string>& inductors,
+                                   amc_float k)
+    : Element(name), inductors(inductors), k(k) { }
+
+// The coefficient is the last field, after the inductors
+MutualInductance::MutualInductance(Tokenizer params)
+    : Element(params), k(0) {
+  std::string field;
+  while (params >> field) {
+    inductors.push_back(field);
+  }
+  if (inductors.size() < 3) {
+    throw BadElementString("Invalid mutual inductance \"" + params.str()
+                           + "\"");
+  }
+  const std::string coefficient = inductors.back();
+  inductors.pop_back();
+  Tokenizer fields(coefficient.data(), coefficient.data() + coefficient.size());
+  if (!(fields >> k) || !(std::abs(k) <= 1)) {
+    throw BadElementString("Invalid mutual inductance \"" + params.str()
+                           + "\"");
+  }
+}
 
-  switch (method_order) {
-    case 1: {
-      R = L/p.step_s;
-      V = R * last_current;
-      break;
-    }
-    case 2: {
-      R = 2 * L/p.step_s;
-      V = R * last_current + past_voltages[0];
-      break;
-    }
-    case 3: {
-      R = 12.0/5.0 * L/p.step_s;
-      V = R*last_current - 1.0/5.0 * past_voltages[1]
-          + 8.0/5.0 * past_voltages[0];
-      break;
-    }
-    case 4: {
-      R = 8.0/3.0 * L/p.step_s;
-      V = R * last_current + 1.0/9.0 * past_voltages[2]
-          - 5.0/9.0 * past_voltages[1] + 19.0/9.0 * past_voltages[0];
-      break;
-    }
-    default: {
-      throw InvalidIntegrationMethod(
-          to_str("Invalid Adams-Moulton order: " << p.method_order));
-    }
+const std::vector<std::string>& MutualInductance::get_inductors() const {
+  return inductors;
+}
+
+amc_float MutualInductance::get_k() const {
+  return k;
+}
+
+void MutualInductance::append_nodes(std::vector<int>&) const { }
+
+// Inductors on a subcircuit are named after the instance, as this element
+Element::Handler MutualInductance::instantiate(const std::string& prefix,
+                                               NodeMap&) const {
+  std::vector<std::string> instance_inductors;
+  for (unsigned i = 0; i < inductors.size(); ++i) {
+    instance_inductors.push_back(prefix + inductors[i]);
   }
+  return Handler(new MutualInductance(prefix + get_name(), instance_inductors,
+                                      k));
+}
+
+int MutualInductance::get_num_of_currents() const {
+  return 0;
+}
 
-  p.A[get_node1()][p.currents_position] += 1;
-  p.A[get_node2()][p.currents_position] -= 1;
-  p.A[p.currents_position][get_node1()] -= 1;
-  p.A[p.currents_position][get_node2()] += 1;
-  p.A[p.currents_position][p.currents_position] += R;
-  p.b[p.currents_position] += V;
+void MutualInductance::place_stamp(const StampParameters&) const {
+  throw IncompleteNetList("Mutual inductance \"" + get_name()
+                          + "\" is only stamped along with its inductors");
 }
 
 Capacitor::Capacitor(const std::string& name, int node1, int node2, amc_float C,
                      amc_float initial_voltage)
     : DoubleTerminalElement(name, node1, node2), C(C),
-      initial_voltage(initial_voltage) {
-  initialize();
-}
+      initial_voltage(initial_voltage) { }
 
-Capacitor::Capacitor(const std::string& params)
+Capacitor::Capacitor(Tokenizer params)
     : DoubleTerminalElement(params), initial_voltage(0) {
   std::string iv_string;
-  line_stream >> C >> iv_string;
+  params >> C >> iv_string;
   if (iv_string.size() > 0) {
     if (iv_string.substr(0,3) != "IC=") {
-      throw BadElementString("Invalid string \"" + params + "\"");
+      throw BadElementString("Invalid string \"" + params.str() + "\"");
     }
-    std::stringstream(iv_string.substr(3,std::string::npos)) >> initial_voltage;
+    Tokenizer(iv_string.data() + 3, iv_string.data() + iv_string.size())
+        >> initial_voltage;
   }
-  initialize();
-}
-
-void Capacitor::initialize() {
-  past_currents[2] = past_currents[1] = past_currents[0] = 0;
 }
 
 amc_float Capacitor::get_C() const {
@@ -376,65 +768,170 @@ amc_float Capacitor::get_initial_voltage() const {
   return initial_voltage;
 }
 
+Element::Handler Capacitor::instantiate(const std::string& prefix,
+                                      NodeMap& nodes) const {
+  const int node1 = nodes.map(get_node1());
+  const int node2 = nodes.map(get_node2());
+  return Handler(new Capacitor(prefix + get_name(), node1, node2, C,
+                               initial_voltage));
+}
+
 int Capacitor::get_num_of_currents() const {
   return 0;
 }
 
-void Capacitor::place_stamp(const StampParameters& p) {
+int Capacitor::get_num_of_states() const {
+  return NUM_OF_STATES;
+}
+
+void Capacitor::initialize_state(amc_float* state) const {
+  state[INITIAL_VOLTAGE] = initial_voltage;
+  state[LAST_VOLTAGE] = state[LAST_G] = state[LAST_I] = 0;
+  state[PAST_CURRENTS + 2] = state[PAST_CURRENTS + 1] = state[PAST_CURRENTS] = 0;
+}
+
+void Capacitor::place_stamp(const StampParameters& p) const {
+  stamp(p, get_node1(), get_node2(), C, p.state + p.state_position);
+}
+
+void Capacitor::stamp(const StampParameters& p, int node1, int node2,
+                      amc_float C, amc_float* state) {
+  if (p.dc_analysis) { // open circuit
+    return;
+  }
+
+  amc_float* past_currents = state + PAST_CURRENTS;
+  amc_float& last_voltage = state[LAST_VOLTAGE];
+
   int method_order = p.method_order;
   if (p.use_ic) {
     method_order = 1;
-    last_voltage = initial_voltage;
+    last_voltage = state[INITIAL_VOLTAGE];
   }
   if (p.new_nr_cycle) {
-    last_voltage = p.x[get_node1()] - p.x[get_node2()];
+    last_voltage = p.x[node1] - p.x[node2];
     past_currents[2] = past_currents[1];
     past_currents[1] = past_currents[0];
-    past_currents[0] = last_G * last_voltage - last_I;
+    past_currents[0] = state[LAST_G] * last_voltage - state[LAST_I];
   }
 
   //  Modeled using a conductance G in parallel with a current source I
   amc_float G;
   amc_float I;
-
-  switch (method_order) {
-    case 1: {
-      G = C/p.step_s;
-      I = G * last_voltage;
-      break;
-    }
-    case 2: {
-      G = 2 * C/p.step_s;
-      I = G * last_voltage + past_currents[0];
-      break;
-    }
-    case 3: {
-      G =  12.0/5.0*C/p.step_s;
-      I = G * last_voltage - 1.0/5.0 * past_currents[1]
-          + 8.0/5.0 * past_currents[0];
-      break;
-    }
-    case 4: {
-      G = 8.0/3.0*C/p.step_s;
-      I = G * last_voltage + 1.0/9.0 * past_currents[2]
-          - 5.0/9.0 * past_currents[1] + 19.0/9.0 * past_currents[0];
-      break;
-    }
-    default: {
-      throw InvalidIntegrationMethod(
-          to_str("Invalid Adams-Moulton order: " << p.method_order));
-    }
+  adams_moulton(method_order, C, p.step_s, last_voltage, past_currents, G, I);
+
+  p.A[node1][node1] += G;
+  p.A[node2][node2] += G;
+  p.A[node1][node2] -= G;
+  p.A[node2][node1] -= G;
+  p.b[node1] += I;
+  p.b[node2] -= I;
+
+  state[LAST_G] = G;
+  state[LAST_I] = I;
+}
+
+TransmissionLine::TransmissionLine(const std::string& name, int port1_p,
+                                   int port1_n, int port2_p, int port2_n,
+                                   amc_float Z0, amc_float TD)
+    : Element(name), port1_p(port1_p), port1_n(port1_n), port2_p(port2_p),
+      port2_n(port2_n), Z0(Z0), TD(TD) { }
+
+TransmissionLine::TransmissionLine(Tokenizer params)
+    : Element(params), Z0(0), TD(-1) {
+  params >> as_node(port1_p) >> as_node(port1_n) >> as_node(port2_p)
+         >> as_node(port2_n) >> Z0 >> TD;
+  if (!params || !(Z0 > 0) || !(TD >= 0)) {
+    throw BadElementString("Invalid transmission line \"" + params.str()
+                           + "\"");
   }
+}
 
-  p.A[get_node1()][get_node1()] += G;
-  p.A[get_node2()][get_node2()] += G;
-  p.A[get_node1()][get_node2()] -= G;
-  p.A[get_node2()][get_node1()] -= G;
-  p.b[get_node1()] += I;
-  p.b[get_node2()] -= I;
+int TransmissionLine::get_port1_p() const {
+  return port1_p;
+}
+
+int TransmissionLine::get_port1_n() const {
+  return port1_n;
+}
+
+int TransmissionLine::get_port2_p() const {
+  return port2_p;
+}
+
+int TransmissionLine::get_port2_n() const {
+  return port2_n;
+}
+
+amc_float TransmissionLine::get_Z0() const {
+  return Z0;
+}
+
+amc_float TransmissionLine::get_TD() const {
+  return TD;
+}
+
+void TransmissionLine::append_nodes(std::vector<int>& nodes) const {
+  nodes.push_back(port1_p);
+  nodes.push_back(port1_n);
+  nodes.push_back(port2_p);
+  nodes.push_back(port2_n);
+}
 
-  last_G = G;
-  last_I = I;
+Element::Handler TransmissionLine::instantiate(const std::string& prefix,
+                                               NodeMap& nodes) const {
+  const int mapped_port1_p = nodes.map(port1_p);
+  const int mapped_port1_n = nodes.map(port1_n);
+  const int mapped_port2_p = nodes.map(port2_p);
+  const int mapped_port2_n = nodes.map(port2_n);
+  return Handler(new TransmissionLine(prefix + get_name(), mapped_port1_p,
+                                      mapped_port1_n, mapped_port2_p,
+                                      mapped_port2_n, Z0, TD));
+}
+
+int TransmissionLine::get_num_of_currents() const {
+  return 2;
+}
+
+int TransmissionLine::get_num_of_states() const {
+  return NUM_OF_STATES;
+}
+
+// The currents enter the line through the positive node of each port. On DC
+// the incident waves are those the other port is sending, with no delay,
+// which leaves both ports at the same voltage and with opposite currents.
+void TransmissionLine::stamp(const StampParameters& p, int port1_p,
+                             int port1_n, int port2_p, int port2_n,
+                             amc_float Z0, const amc_float* state) {
+  const int line1 = p.currents_position;
+  const int line2 = p.currents_position + 1;
+  p.A[port1_p][line1] += 1;
+  p.A[port1_n][line1] -= 1;
+  p.A[port2_p][line2] += 1;
+  p.A[port2_n][line2] -= 1;
+
+  p.A[line1][port1_p] -= 1;
+  p.A[line1][port1_n] += 1;
+  p.A[line1][line1] += Z0;
+  p.A[line2][port2_p] -= 1;
+  p.A[line2][port2_n] += 1;
+  p.A[line2][line2] += Z0;
+  if (p.dc_analysis) {
+    p.A[line1][port2_p] += 1;
+    p.A[line1][port2_n] -= 1;
+    p.A[line1][line2] += Z0;
+    p.A[line2][port1_p] += 1;
+    p.A[line2][port1_n] -= 1;
+    p.A[line2][line1] += Z0;
+  } else {
+    p.b[line1] -= state[INCIDENT1];
+    p.b[line2] -= state[INCIDENT2];
+  }
+}
+
+void TransmissionLine::place_stamp(const StampParameters& p) const {
+  stamp(p, port1_p, port1_n, port2_p, port2_n, Z0,
+        p.state + p.state_position);
 }
 
 VoltageControlledVoltageSource::VoltageControlledVoltageSource(
@@ -444,19 +941,29 @@ VoltageControlledVoltageSource::VoltageControlledVoltageSource(
       Av(Av) { }
 
 VoltageControlledVoltageSource::VoltageControlledVoltageSource(
-    const std::string& params) : ControlledElement(params) {
-  line_stream >> Av;
+    Tokenizer params) : ControlledElement(params) {
+  params >> Av;
 }
 
 amc_float VoltageControlledVoltageSource::get_Av() const {
   return Av;
 }
 
+Element::Handler VoltageControlledVoltageSource::instantiate(
+    const std::string& prefix, NodeMap& nodes) const {
+  const int node_p = nodes.map(get_node_p());
+  const int node_n = nodes.map(get_node_n());
+  const int node_ctrl_p = nodes.map(get_node_ctrl_p());
+  const int node_ctrl_n = nodes.map(get_node_ctrl_n());
+  return Handler(new VoltageControlledVoltageSource(
+      prefix + get_name(), node_p, node_n, node_ctrl_p, node_ctrl_n, Av));
+}
+
 int VoltageControlledVoltageSource::get_num_of_currents() const {
   return 1;
 }
 
-void VoltageControlledVoltageSource::place_stamp(const StampParameters& p) {
+void VoltageControlledVoltageSource::place_stamp(const StampParameters& p) const {
   p.A[p.currents_position][get_node_p()] -= 1;
   p.A[p.currents_position][get_node_n()] += 1;
   p.A[p.currents_position][get_node_ctrl_p()] += Av;
@@ -472,19 +979,29 @@ CurrentControlledCurrentSource::CurrentControlledCurrentSource(
       Ai(Ai) { }
 
 CurrentControlledCurrentSource::CurrentControlledCurrentSource(
-    const std::string& params) : ControlledElement(params) {
-  line_stream >> Ai;
+    Tokenizer params) : ControlledElement(params) {
+  params >> Ai;
 }
 
 amc_float CurrentControlledCurrentSource::get_Ai() const {
   return Ai;
 }
 
+Element::Handler CurrentControlledCurrentSource::instantiate(
+    const std::string& prefix, NodeMap& nodes) const {
+  const int node_p = nodes.map(get_node_p());
+  const int node_n = nodes.map(get_node_n());
+  const int node_ctrl_p = nodes.map(get_node_ctrl_p());
+  const int node_ctrl_n = nodes.map(get_node_ctrl_n());
+  return Handler(new CurrentControlledCurrentSource(
+      prefix + get_name(), node_p, node_n, node_ctrl_p, node_ctrl_n, Ai));
+}
+
 int CurrentControlledCurrentSource::get_num_of_currents() const {
   return 1;
 }
 
-void CurrentControlledCurrentSource::place_stamp(const StampParameters& p) {
+void CurrentControlledCurrentSource::place_stamp(const StampParameters& p) const {
   p.A[p.currents_position][get_node_ctrl_p()] -= 1;
   p.A[p.currents_position][get_node_ctrl_n()] += 1;
   p.A[get_node_p()][p.currents_position] += Ai;
@@ -500,8 +1017,8 @@ VoltageControlledCurrentSource::VoltageControlledCurrentSource(
       Gm(Gm) { }
 
 VoltageControlledCurrentSource::VoltageControlledCurrentSource(
-    const std::string& params) : ControlledElement(params) {
-  line_stream >> Gm;
+    Tokenizer params) : ControlledElement(params) {
+  params >> Gm;
 }
 
 amc_float VoltageControlledCurrentSource::get_Gm() const {
@@ -509,11 +1026,21 @@ amc_float VoltageControlledCurrentSource::get_Gm() const {
 }
 
 
+Element::Handler VoltageControlledCurrentSource::instantiate(
+    const std::string& prefix, NodeMap& nodes) const {
+  const int node_p = nodes.map(get_node_p());
+  const int node_n = nodes.map(get_node_n());
+  const int node_ctrl_p = nodes.map(get_node_ctrl_p());
+  const int node_ctrl_n = nodes.map(get_node_ctrl_n());
+  return Handler(new VoltageControlledCurrentSource(
+      prefix + get_name(), node_p, node_n, node_ctrl_p, node_ctrl_n, Gm));
+}
+
 int VoltageControlledCurrentSource::get_num_of_currents() const {
   return 0;
 }
 
-void VoltageControlledCurrentSource::place_stamp(const StampParameters& p) {
+void VoltageControlledCurrentSource::place_stamp(const StampParameters& p) const {
   p.A[get_node_p()][get_node_ctrl_p()] += Gm;
   p.A[get_node_p()][get_node_ctrl_n()] -= Gm;
   p.A[get_node_n()][get_node_ctrl_p()] -= Gm;
@@ -527,19 +1054,29 @@ CurrentControlledVoltageSource::CurrentControlledVoltageSource(
       Rm(Rm) { }
 
 CurrentControlledVoltageSource::CurrentControlledVoltageSource(
-    const std::string& params) : ControlledElement(params) {
-  line_stream >> Rm;
+    Tokenizer params) : ControlledElement(params) {
+  params >> Rm;
 }
 
 amc_float CurrentControlledVoltageSource::get_Rm() const {
   return Rm;
 }
 
+Element::Handler CurrentControlledVoltageSource::instantiate(
+    const std::string& prefix, NodeMap& nodes) const {
+  const int node_p = nodes.map(get_node_p());
+  const int node_n = nodes.map(get_node_n());
+  const int node_ctrl_p = nodes.map(get_node_ctrl_p());
+  const int node_ctrl_n = nodes.map(get_node_ctrl_n());
+  return Handler(new CurrentControlledVoltageSource(
+      prefix + get_name(), node_p, node_n, node_ctrl_p, node_ctrl_n, Rm));
+}
+
 int CurrentControlledVoltageSource::get_num_of_currents() const {
   return 2;
 }
 
-void CurrentControlledVoltageSource::place_stamp(const StampParameters& p) {
+void CurrentControlledVoltageSource::place_stamp(const StampParameters& p) const {
   p.A[p.currents_position][get_node_ctrl_p()] -= 1;
   p.A[p.currents_position][get_node_ctrl_n()] += 1;
   p.A[p.currents_position+1][get_node_p()] -= 1;
@@ -551,34 +1088,191 @@ void CurrentControlledVoltageSource::place_stamp(const StampParameters& p) {
   p.A[get_node_n()][p.currents_position+1] -= 1;
 }
 
+BehavioralSource::BehavioralSource(const std::string& name, int node_p,
+                                   int node_n, bool voltage_output,
+                                   const Expression& expression)
+    : SimpleSourceElement(name, node_p, node_n),
+      voltage_output(voltage_output), expression(expression) { }
+
+// The rest of the line, after `V=` or `I=`
+static std::string read_expression(Tokenizer& params, bool& voltage_output) {
+  const std::string text = params.rest();
+  const char output = text.empty() ? '\0' : ::toupper(text[0]);
+  if (!params || text.size() < 3 || (output != 'V' && output != 'I') ||
+      text[1] != '=') {
+    throw BadElementString("Invalid behavioral source \"" + params.str()
+                           + "\"");
+  }
+  voltage_output = output == 'V';
+  return text.substr(2);
+}
+
+BehavioralSource::BehavioralSource(Tokenizer params)
+    : SimpleSourceElement(params), voltage_output(false),
+      expression(read_expression(params, voltage_output), params) { }
+
+bool BehavioralSource::is_voltage_output() const {
+  return voltage_output;
+}
+
+const Expression& BehavioralSource::get_expression() const {
+  return expression;
+}
+
+void BehavioralSource::append_nodes(std::vector<int>& nodes) const {
+  SimpleSourceElement::append_nodes(nodes);
+  const std::vector<Expression::Control>& controls = expression.get_controls();
+  for (unsigned i = 0; i < controls.size(); ++i) {
+    nodes.push_back(controls[i].node_p);
+    nodes.push_back(controls[i].node_n);
+  }
+}
+
+Element::Handler BehavioralSource::instantiate(const std::string& prefix,
+                                               NodeMap& nodes) const {
+  const int node_p = nodes.map(get_node_p());
+  const int node_n = nodes.map(get_node_n());
+  std::vector<Expression::Control> controls = expression.get_controls();
+  for (unsigned i = 0; i < controls.size(); ++i) {
+    controls[i].node_p = nodes.map(controls[i].node_p);
+    controls[i].node_n = nodes.map(controls[i].node_n);
+  }
+  return Handler(new BehavioralSource(prefix + get_name(), node_p, node_n,
+                                      voltage_output,
+                                      expression.with_controls(controls)));
+}
+
+int BehavioralSource::get_num_of_currents() const {
+  const std::vector<Expression::Control>& controls = expression.get_controls();
+  int num_currents = voltage_output ? 1 : 0;
+  for (unsigned i = 0; i < controls.size(); ++i) {
+    num_currents += controls[i].type == Expression::CURRENT;
+  }
+  return num_currents;
+}
+
+int BehavioralSource::get_num_of_states() const {
+  return expression.get_num_of_registers();
+}
+
+void BehavioralSource::initialize_state(amc_float* state) const {
+  expression.initialize_registers(state);
+}
+
+// The output depends on the system unknown at `column`
+void BehavioralSource::stamp_dependence(const StampParameters& p, int column,
+                                        amc_float derivative) const {
+  if (voltage_output) {
+    p.A[p.currents_position][column] += derivative;
+  } else {
+    p.A[get_node_p()][column] += derivative;
+    p.A[get_node_n()][column] -= derivative;
+  }
+}
+
+// The output is its value on the last trial plus the derivative on each control
+// times how far it moved from there
+void BehavioralSource::place_stamp(const StampParameters& p) const {
+  const std::vector<Expression::Control>& controls = expression.get_controls();
+  amc_float* registers = p.state + p.state_position;
+  const int first_sensor = p.currents_position + (voltage_output ? 1 : 0);
+  int sensor = first_sensor;
+  for (unsigned i = 0; i < controls.size(); ++i) {
+    if (controls[i].type == Expression::VOLTAGE) {
+      registers[i] = p.last_nr_trial[controls[i].node_p]
+                     - p.last_nr_trial[controls[i].node_n];
+    } else {
+      registers[i] = p.last_nr_trial[sensor++];
+    }
+  }
+  const amc_float* derivatives;
+  amc_float value = expression.evaluate(p.time, registers, derivatives);
+
+  sensor = first_sensor;
+  for (unsigned i = 0; i < controls.size(); ++i) {
+    const int node_ctrl_p = controls[i].node_p;
+    const int node_ctrl_n = controls[i].node_n;
+    value -= derivatives[i] * registers[i];
+    if (controls[i].type == Expression::VOLTAGE) {
+      stamp_dependence(p, node_ctrl_p, derivatives[i]);
+      stamp_dependence(p, node_ctrl_n, -derivatives[i]);
+      continue;
+    }
+    p.A[sensor][node_ctrl_p] -= 1;
+    p.A[sensor][node_ctrl_n] += 1;
+    p.A[node_ctrl_p][sensor] += 1;
+    p.A[node_ctrl_n][sensor] -= 1;
+    stamp_dependence(p, sensor, derivatives[i]);
+    ++sensor;
+  }
+
+  if (voltage_output) {
+    p.A[get_node_p()][p.currents_position] += 1;
+    p.A[get_node_n()][p.currents_position] -= 1;
+    p.A[p.currents_position][get_node_p()] -= 1;
+    p.A[p.currents_position][get_node_n()] += 1;
+    p.b[p.currents_position] -= value;
+  } else {
+    p.b[get_node_p()] -= value;
+    p.b[get_node_n()] += value;
+  }
+}
+
 CurrentSource::CurrentSource(const std::string& name, int node_p, int node_n,
                              Signal::Handler signal)
     : ArbitrarySourceElement(name, node_p, node_n, signal) { }
 
-CurrentSource::CurrentSource(const std::string& params)
+CurrentSource::CurrentSource(Tokenizer params)
     : ArbitrarySourceElement(params) { }
 
+Element::Handler CurrentSource::with_signal(Signal::Handler signal) const {
+  return Handler(new CurrentSource(get_name(), get_node_p(), get_node_n(),
+                                   signal));
+}
+
+Element::Handler CurrentSource::instantiate(const std::string& prefix,
+                                          NodeMap& nodes) const {
+  const int node_p = nodes.map(get_node_p());
+  const int node_n = nodes.map(get_node_n());
+  return Handler(new CurrentSource(prefix + get_name(), node_p, node_n,
+                                   signal));
+}
+
 int CurrentSource::get_num_of_currents() const {
   return 0;
 }
 
-void CurrentSource::place_stamp(const StampParameters& p) {
-  p.b[get_node_p()] -= signal->get_value(p.time);
-  p.b[get_node_n()] += signal->get_value(p.time);
+void CurrentSource::place_stamp(const StampParameters& p) const {
+  const amc_float value = signal->get_value(p.time);
+  p.b[get_node_p()] -= value;
+  p.b[get_node_n()] += value;
 }
 
 VoltageSource::VoltageSource(const std::string& name, int node_p, int node_n,
                              Signal::Handler signal)
     : ArbitrarySourceElement(name, node_p, node_n, signal) { }
 
-VoltageSource::VoltageSource(const std::string& params)
+VoltageSource::VoltageSource(Tokenizer params)
     : ArbitrarySourceElement(params) {}
 
+Element::Handler VoltageSource::with_signal(Signal::Handler signal) const {
+  return Handler(new VoltageSource(get_name(), get_node_p(), get_node_n(),
+                                   signal));
+}
+
+Element::Handler VoltageSource::instantiate(const std::string& prefix,
+                                          NodeMap& nodes) const {
+  const int node_p = nodes.map(get_node_p());
+  const int node_n = nodes.map(get_node_n());
+  return Handler(new VoltageSource(prefix + get_name(), node_p, node_n,
+                                   signal));
+}
+
 int VoltageSource::get_num_of_currents() const {
   return 1;
 }
 
-void VoltageSource::place_stamp(const StampParameters& p) {
+void VoltageSource::place_stamp(const StampParameters& p) const {
   p.A[get_node_p()][p.currents_position] += 1;
   p.A[get_node_n()][p.currents_position] -= 1;
   p.A[p.currents_position][get_node_p()] -= 1;
@@ -590,8 +1284,9 @@ IdealOpAmp::IdealOpAmp(const std::string& name, int out_p, int out_n, int in_p,
                        int in_n)
     : Element(name), out_p(out_p), out_n(out_n), in_p(in_p), in_n(in_n) { }
 
-IdealOpAmp::IdealOpAmp(const std::string& params) :  Element(params) {
-  line_stream >> out_p >> out_n >> in_p >> in_n;
+IdealOpAmp::IdealOpAmp(Tokenizer params) :  Element(params) {
+  params >> as_node(out_p) >> as_node(out_n) >> as_node(in_p)
+         >> as_node(in_n);
 }
 
 int IdealOpAmp::get_out_p() const {
@@ -610,15 +1305,87 @@ int IdealOpAmp::get_in_n() const {
   return in_n;
 }
 
+void IdealOpAmp::append_nodes(std::vector<int>& nodes) const {
+  nodes.push_back(out_p);
+  nodes.push_back(out_n);
+  nodes.push_back(in_p);
+  nodes.push_back(in_n);
+}
+
+Element::Handler IdealOpAmp::instantiate(const std::string& prefix,
+                                         NodeMap& nodes) const {
+  const int mapped_out_p = nodes.map(out_p);
+  const int mapped_out_n = nodes.map(out_n);
+  const int mapped_in_p = nodes.map(in_p);
+  const int mapped_in_n = nodes.map(in_n);
+  return Handler(new IdealOpAmp(prefix + get_name(), mapped_out_p,
+                                mapped_out_n, mapped_in_p, mapped_in_n));
+}
+
 int IdealOpAmp::get_num_of_currents() const {
   return 1;
 }
 
-void IdealOpAmp::place_stamp(const StampParameters& p) {
+void IdealOpAmp::place_stamp(const StampParameters& p) const {
   p.A[p.currents_position][in_p] += 1;
   p.A[p.currents_position][in_n] -= 1;
   p.A[out_p][p.currents_position] += 1;
   p.A[out_n][p.currents_position] -= 1;
 }
 
+SubcircuitInstance::SubcircuitInstance(const std::string& name,
+                                       const std::vector<int>& nodes,
+                                       const std::string& subcircuit_name)
+    : Element(name), nodes(nodes), subcircuit_name(subcircuit_name) { }
+
+// Nodes come before the subcircuit name, which is the last field
+SubcircuitInstance::SubcircuitInstance(Tokenizer params) : Element(params) {
+  Tokenizer fields = params;
+  std::string field;
+  int num_nodes = -1;
+  while (fields >> field) {
+    ++num_nodes;
+  }
+  for (int i = 0; i < num_nodes; ++i) {
+    int node;
+    params >> as_node(node);
+    nodes.push_back(node);
+  }
+  if (!(params >> subcircuit_name)) {
+    throw BadElementString("Invalid subcircuit instance \"" + params.str()
+                           + "\"");
+  }
+}
+
+const std::vector<int>& SubcircuitInstance::get_nodes() const {
+  return nodes;
+}
+
+const std::string& SubcircuitInstance::get_subcircuit_name() const {
+  return subcircuit_name;
+}
+
+void SubcircuitInstance::append_nodes(std::vector<int>& nodes) const {
+  nodes.insert(nodes.end(), this->nodes.begin(), this->nodes.end());
+}
+
+Element::Handler SubcircuitInstance::instantiate(const std::string& prefix,
+                                                 NodeMap& node_map) const {
+  std::vector<int> mapped_nodes;
+  for (unsigned i = 0; i < nodes.size(); ++i) {
+    mapped_nodes.push_back(node_map.map(nodes[i]));
+  }
+  return Handler(new SubcircuitInstance(prefix + get_name(), mapped_nodes,
+                                        subcircuit_name));
+}
+
+int SubcircuitInstance::get_num_of_currents() const {
+  return 0;
+}
+
+void SubcircuitInstance::place_stamp(const StampParameters&) const {
+  throw IncompleteNetList("Subcircuit instance \"" + get_name()
+                          + "\" was not flattened");
+}
+
 }  // namespace amcircuit
@@ -0,0 +1,443 @@
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+#include "Expression.h"
+#include "AMCircuitException.h"
+#include "helpers.h"
+
+namespace amcircuit {
+
+// Value of `op` on `a` and `b` (ignored by unary operations), along with its
+// derivatives on each
+static inline amc_float operate(Expression::Opcode op, amc_float a,
+                                amc_float b, amc_float& da, amc_float& db) {
+  amc_float value = 0;
+  db = 0;
+  switch (op) {
+    case Expression::ADD: da = 1; db = 1; return a + b;
+    case Expression::SUB: da = 1; db = -1; return a - b;
+    case Expression::MUL: da = b; db = a; return a * b;
+    case Expression::DIV:
+      value = a / b;
+      da = 1 / b;
+      db = -value / b;
+      return value;
+    case Expression::POW:
+      value = std::pow(a, b);
+      da = b * std::pow(a, b - 1);
+      db = a > 0 ? value * std::log(a) : 0;
+      return value;
+    case Expression::MIN: da = a <= b; db = a > b; return a <= b ? a : b;
+    case Expression::MAX: da = a >= b; db = a < b; return a >= b ? a : b;
+    case Expression::NEG: da = -1; return -a;
+    case Expression::EXP: value = std::exp(a); da = value; return value;
+    case Expression::LOG: da = 1 / a; return std::log(a);
+    case Expression::SQRT: value = std::sqrt(a); da = 0.5 / value; return value;
+    case Expression::SIN: da = std::cos(a); return std::sin(a);
+    case Expression::COS: da = -std::sin(a); return std::cos(a);
+    case Expression::TAN: value = std::tan(a); da = 1 + value * value;
+      return value;
+    case Expression::TANH: value = std::tanh(a); da = 1 - value * value;
+      return value;
+    case Expression::ATAN: da = 1 / (1 + a * a); return std::atan(a);
+    case Expression::ABS: da = (a > 0) - (a < 0); return std::abs(a);
+    default: break;
+  }
+  da = 0;
+  return 0;
+}
+
+// Netlists are parsed by many threads, so the table is never written
+static const struct {
+  const char* name;
+  Expression::Opcode op;
+} functions[] = {
+  {"MIN", Expression::MIN}, {"MAX", Expression::MAX},
+  {"POW", Expression::POW}, {"EXP", Expression::EXP},
+  {"LOG", Expression::LOG}, {"LN", Expression::LOG},
+  {"SQRT", Expression::SQRT}, {"SIN", Expression::SIN},
+  {"COS", Expression::COS}, {"TAN", Expression::TAN},
+  {"TANH", Expression::TANH}, {"ATAN", Expression::ATAN},
+  {"ABS", Expression::ABS}
+};
+static const int num_functions = sizeof(functions) / sizeof(functions[0]);
+
+// Recursive descent over
+//   sum     := product (('+' | '-') product)*
+//   product := unary (('*' | '/') unary)*
+//   unary   := ('-' | '+') unary | power
+//   power   := primary (('^' | '**') unary)?
+//   primary := number | '(' sum ')' | name | name '(' sum (',' sum)* ')'
+// Operands only get their registers once the whole expression is read, as
+// those of instructions come after every control and constant.
+class Expression::Parser {
+ public:
+  Parser(Expression& expression, const Tokenizer& line)
+      : expression(expression), line(line),
+        position(expression.text.c_str()) {
+    const Operand value = sum();
+    skip_whitespace();
+    if (*position != '\0') {
+      fail();
+    }
+    assign_registers(value);
+  }
+
+ private:
+  enum Kind { CONTROL, TIME, CONSTANT, INSTRUCTION };
+  struct Operand {
+    Operand(Kind kind, int index, amc_float value = 0)
+        : kind(kind), index(index), value(value) { }
+    Kind kind;
+    int index;
+    amc_float value; // constants only
+  };
+  struct PendingInstruction {
+    PendingInstruction(Opcode op, const Operand& a, const Operand& b)
+        : op(op), a(a), b(b) { }
+    Opcode op;
+    Operand a;
+    Operand b;
+  };
+
+  Expression& expression;
+  const Tokenizer& line;
+  const char* position;
+  std::vector<PendingInstruction> pending;
+
+  void fail() const {
+    throw BadElementString("Invalid expression \"" + expression.text + "\"");
+  }
+
+  void skip_whitespace() {
+    while (isspace(static_cast<unsigned char>(*position))) {
+      ++position;
+    }
+  }
+
+  bool accept(char c) {
+    skip_whitespace();
+    if (*position != c) {
+      return false;
+    }
+    ++position;
+    return true;
+  }
+
+  void expect(char c) {
+    if (!accept(c)) {
+      fail();
+    }
+  }
+
+  Operand emit(Opcode op, const Operand& a, const Operand& b) {
+    if (a.kind == CONSTANT && b.kind == CONSTANT) {
+      amc_float da, db;
+      return Operand(CONSTANT, 0, operate(op, a.value, b.value, da, db));
+    }
+    pending.push_back(PendingInstruction(op, a, b));
+    return Operand(INSTRUCTION, pending.size() - 1);
+  }
+
+  Operand emit(Opcode op, const Operand& a) {
+    return emit(op, a, a);
+  }
+
+  Operand sum() {
+    Operand value = product();
+    while (true) {
+      if (accept('+')) {
+        value = emit(ADD, value, product());
+      } else if (accept('-')) {
+        value = emit(SUB, value, product());
+      } else {
+        return value;
+      }
+    }
+  }
+
+  Operand product() {
+    Operand value = unary();
+    while (true) {
+      skip_whitespace();
+      if (position[0] == '*' && position[1] == '*') {
+        return value;
+      }
+      if (accept('*')) {
+        value = emit(MUL, value, unary());
+      } else if (accept('/')) {
+        value = emit(DIV, value, unary());
+      } else {
+        return value;
+      }
+    }
+  }
+
+  Operand unary() {
+    if (accept('-')) {
+      return emit(NEG, unary());
+    }
+    if (accept('+')) {
+      return unary();
+    }
+    return power();
+  }
+
+  Operand power() {
+    const Operand base = primary();
+    skip_whitespace();
+    if (position[0] == '*' && position[1] == '*') {
+      position += 2;
+      return emit(POW, base, unary());
+    }
+    if (accept('^')) {
+      return emit(POW, base, unary());
+    }
+    return base;
+  }
+
+  Operand primary() {
+    skip_whitespace();
+    if (isdigit(static_cast<unsigned char>(*position)) || *position == '.') {
+      char* number_end;
+      const amc_float value = strtod(position, &number_end);
+      if (number_end == position) {
+        fail();
+      }
+      position = number_end;
+      return Operand(CONSTANT, 0, value);
+    }
+    if (accept('(')) {
+      const Operand value = sum();
+      expect(')');
+      return value;
+    }
+
+    const char* name_begin = position;
+    while (isalnum(static_cast<unsigned char>(*position)) ||
+           *position == '_') {
+      ++position;
+    }
+    const std::string name = str_upper(std::string(name_begin, position));
+    if (name.empty()) {
+      fail();
+    }
+    if (name == "TIME") {
+      return Operand(TIME, 0);
+    }
+    if (name == "PI") {
+      return Operand(CONSTANT, 0, 3.14159265358979323846);
+    }
+    expect('(');
+    if (name == "V" || name == "I") {
+      return control(name == "V" ? VOLTAGE : CURRENT);
+    }
+
+    int function = 0;
+    while (function < num_functions && name != functions[function].name) {
+      ++function;
+    }
+    if (function == num_functions) {
+      fail();
+    }
+    const Opcode op = functions[function].op;
+    const Operand a = sum();
+    if (op == MIN || op == MAX || op == POW) {
+      expect(',');
+      const Operand b = sum();
+      expect(')');
+      return emit(op, a, b);
+    }
+    expect(')');
+    return emit(op, a);
+  }
+
+  // One or two nodes, the second being the ground if missing. Controls used
+  // more than once share the same register.
+  Operand control(ControlType type) {
+    Control found;
+    found.type = type;
+    found.node_p = node();
+    found.node_n = accept(',') ? node() : 0;
+    expect(')');
+
+    std::vector<Control>& controls = expression.controls;
+    for (unsigned i = 0; i < controls.size(); ++i) {
+      if (controls[i].type == type && controls[i].node_p == found.node_p &&
+          controls[i].node_n == found.node_n) {
+        return Operand(CONTROL, i);
+      }
+    }
+    controls.push_back(found);
+    return Operand(CONTROL, controls.size() - 1);
+  }
+
+  int node() {
+    skip_whitespace();
+    const char* node_begin = position;
+    while (*position != '\0' && *position != ',' && *position != ')' &&
+           !isspace(static_cast<unsigned char>(*position))) {
+      ++position;
+    }
+    int id = 0;
+    Tokenizer field = line.part(node_begin, position);
+    if (!(field >> as_node(id))) {
+      fail();
+    }
+    return id;
+  }
+
+  int constant_register(amc_float value) {
+    std::vector<amc_float>& constants = expression.constants;
+    for (unsigned i = 0; i < constants.size(); ++i) {
+      if (constants[i] == value) {
+        return i;
+      }
+    }
+    constants.push_back(value);
+    return constants.size() - 1;
+  }
+
+  void assign_registers(const Operand& value) {
+    // Constants are only known once every instruction is
+    std::vector<int> constant_index(2 * pending.size() + 1);
+    for (unsigned i = 0; i < pending.size(); ++i) {
+      if (pending[i].a.kind == CONSTANT) {
+        constant_index[2 * i] = constant_register(pending[i].a.value);
+      }
+      if (pending[i].b.kind == CONSTANT) {
+        constant_index[2 * i + 1] = constant_register(pending[i].b.value);
+      }
+    }
+    if (value.kind == CONSTANT) {
+      constant_index.back() = constant_register(value.value);
+    }
+
+    const int num_controls = expression.controls.size();
+    const int first_instruction = num_controls + 1
+                                  + expression.constants.size();
+    for (unsigned i = 0; i < pending.size(); ++i) {
+      Instruction instruction;
+      instruction.op = pending[i].op;
+      instruction.a = register_of(pending[i].a, constant_index[2 * i],
+                                  first_instruction);
+      instruction.b = register_of(pending[i].b, constant_index[2 * i + 1],
+                                  first_instruction);
+      expression.program.push_back(instruction);
+    }
+    expression.result = register_of(value, constant_index.back(),
+                                    first_instruction);
+  }
+
+  int register_of(const Operand& operand, int constant,
+                  int first_instruction) const {
+    const int num_controls = expression.controls.size();
+    switch (operand.kind) {
+      case CONTROL: return operand.index;
+      case TIME: return num_controls;
+      case CONSTANT: return num_controls + 1 + constant;
+      default: return first_instruction + operand.index;
+    }
+  }
+};
+
+Expression::Expression(const std::string& text, const Tokenizer& line)
+    : text(text), result(0) {
+  Parser parser(*this, line);
+}
+
+Expression::Expression(const std::string& text,
+                       const std::vector<Control>& controls,
+                       const std::vector<amc_float>& constants,
+                       const std::vector<Instruction>& program, int result)
+    : text(text), controls(controls), constants(constants), program(program),
+      result(result) {
+  const int first_instruction = controls.size() + 1 + constants.size();
+  for (unsigned i = 0; i < program.size(); ++i) {
+    const int last_register = first_instruction + i;
+    if (program[i].op < 0 || program[i].op >= NUM_OF_OPCODES ||
+        program[i].a < 0 || program[i].a >= last_register ||
+        program[i].b < 0 || program[i].b >= last_register) {
+      throw BadElementString("Invalid program for \"" + text + "\"");
+    }
+  }
+  if (result < 0 ||
+      result >= first_instruction + static_cast<int>(program.size())) {
+    throw BadElementString("Invalid program for \"" + text + "\"");
+  }
+}
+
+const std::string& Expression::str() const {
+  return text;
+}
+
+const std::vector<Expression::Control>& Expression::get_controls() const {
+  return controls;
+}
+
+const std::vector<amc_float>& Expression::get_constants() const {
+  return constants;
+}
+
+const std::vector<Expression::Instruction>& Expression::get_program() const {
+  return program;
+}
+
+int Expression::get_result() const {
+  return result;
+}
+
+Expression Expression::with_controls(
+    const std::vector<Control>& new_controls) const {
+  return Expression(text, new_controls, constants, program, result);
+}
+
+int Expression::get_num_of_registers() const {
+  const int num_registers = controls.size() + 1 + constants.size()
+                            + program.size();
+  return num_registers * (1 + controls.size());
+}
+
+void Expression::initialize_registers(amc_float* registers) const {
+  const int num_controls = controls.size();
+  const int num_registers = get_num_of_registers() / (1 + num_controls);
+  amc_float* derivatives = registers + num_registers;
+  for (int i = 0; i < num_registers * num_controls; ++i) {
+    derivatives[i] = 0;
+  }
+  for (int i = 0; i < num_controls; ++i) {
+    registers[i] = 0;
+    derivatives[i * num_controls + i] = 1;
+  }
+  registers[num_controls] = 0;
+  for (unsigned i = 0; i < constants.size(); ++i) {
+    registers[num_controls + 1 + i] = constants[i];
+  }
+}
+
+amc_float Expression::evaluate(amc_float time, amc_float* registers,
+                               const amc_float*& derivatives) const {
+  const int num_controls = controls.size();
+  const int first_instruction = num_controls + 1 + constants.size();
+  const int num_instructions = program.size();
+  amc_float* gradients = registers + first_instruction + num_instructions;
+  registers[num_controls] = time;
+  for (int i = 0; i < num_instructions; ++i) {
+    const Instruction& instruction = program[i];
+    const int output = first_instruction + i;
+    amc_float da, db;
+    registers[output] = operate(instruction.op, registers[instruction.a],
+                                registers[instruction.b], da, db);
+    const amc_float* ga = gradients + instruction.a * num_controls;
+    const amc_float* gb = gradients + instruction.b * num_controls;
+    amc_float* g = gradients + output * num_controls;
+    for (int k = 0; k < num_controls; ++k) {
+      g[k] = da * ga[k] + db * gb[k];
+    }
+  }
+  derivatives = gradients + result * num_controls;
+  return registers[result];
+}
+
+}  // namespace amcircuit
@@ -0,0 +1,97 @@
+#include <algorithm>
+
+#include "JobScheduler.h"
+
+namespace amcircuit {
+
+Job::~Job() { }
+
+double Job::get_cost_estimate() const {
+  return 0;
+}
+
+inline bool larger_job(const Job* a, const Job* b) {
+  return a->get_cost_estimate() > b->get_cost_estimate();
+}
+
+JobScheduler::JobScheduler(int num_workers)
+    : workers(num_workers > 0 ? num_workers : 1) {
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    workers[i].scheduler = this;
+    workers[i].id = i;
+    workers[i].started = false;
+    pthread_mutex_init(&workers[i].lock, NULL);
+  }
+}
+
+JobScheduler::~JobScheduler() {
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    pthread_mutex_destroy(&workers[i].lock);
+  }
+}
+
+void JobScheduler::add_job(Job* job) {
+  pending_jobs.push_back(job);
+}
+
+int JobScheduler::get_num_workers() const {
+  return workers.size();
+}
+
+void JobScheduler::run() {
+  std::stable_sort(pending_jobs.begin(), pending_jobs.end(), larger_job);
+  for (unsigned i = 0; i < pending_jobs.size(); ++i) {
+    workers[i % workers.size()].jobs.push_back(pending_jobs[i]);
+  }
+  pending_jobs.clear();
+
+  // The calling thread works as the first worker. Jobs of workers whose
+  // thread could not be started are taken from their queues by the others.
+  for (unsigned i = 1; i < workers.size(); ++i) {
+    workers[i].started = pthread_create(&workers[i].thread, NULL, worker_main,
+                                        &workers[i]) == 0;
+  }
+  worker_main(&workers[0]);
+  for (unsigned i = 1; i < workers.size(); ++i) {
+    if (workers[i].started) {
+      pthread_join(workers[i].thread, NULL);
+    }
+  }
+}
+
+void* JobScheduler::worker_main(void* worker_ptr) {
+  Worker* worker = static_cast<Worker*>(worker_ptr);
+  Job* job;
+  while ((job = worker->scheduler->take_job(worker->id)) != NULL) {
+    job->run();
+  }
+  return NULL;
+}
+
+// No job is added while running, so once every queue is empty the worker is
+// done
+Job* JobScheduler::take_job(int worker_id) {
+  Job* job = NULL;
+  Worker& own = workers[worker_id];
+
+  pthread_mutex_lock(&own.lock);
+  if (!own.jobs.empty()) {
+    job = own.jobs.front();
+    own.jobs.pop_front();
+  }
+  pthread_mutex_unlock(&own.lock);
+
+  for (unsigned i = 1; job == NULL && i < workers.size(); ++i) {
+    Worker& victim = workers[(worker_id + i) % workers.size()];
+    pthread_mutex_lock(&victim.lock);
+    if (!victim.jobs.empty()) {
+      job = victim.jobs.back();
+      victim.jobs.pop_back();
+    }
+    pthread_mutex_unlock(&victim.lock);
+  }
+
+  return job;
+}
+
+}  // namespace amcircuit
@@ -0,0 +1,83 @@
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+#include "AMCircuitException.h"
+
+namespace amcircuit {
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& file_name)
+    : data(NULL), length(0), mapped(false) {
+  std::ifstream file(file_name.c_str(), std::ios::binary);
+  if (!file) {
+    throw FileNotFound("Cannot open file \"" + file_name + "\"");
+  }
+  std::stringstream contents;
+  contents << file.rdbuf();
+  buffer = contents.str();
+  data = buffer.data();
+  length = buffer.size();
+}
+
+MappedFile::~MappedFile() { }
+#else
+MappedFile::MappedFile(const std::string& file_name)
+    : data(NULL), length(0), mapped(false) {
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0 || S_ISDIR(info.st_mode)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    throw FileNotFound("Cannot open file \"" + file_name + "\"");
+  }
+  length = static_cast<size_t>(info.st_size);
+  if (length > 0) {
+    void* address = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address != MAP_FAILED) {
+      madvise(address, length, MADV_SEQUENTIAL);
+      data = static_cast<const char*>(address);
+      mapped = true;
+    }
+  }
+  close(fd);
+
+  // Not every file can be mapped (e.g. pipes), those are just read
+  if (!mapped) {
+    std::ifstream file(file_name.c_str(), std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    buffer = contents.str();
+    data = buffer.data();
+    length = buffer.size();
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (mapped) {
+    munmap(const_cast<char*>(data), length);
+  }
+}
+#endif
+
+const char* MappedFile::begin() const {
+  return data;
+}
+
+const char* MappedFile::end() const {
+  return data + length;
+}
+
+size_t MappedFile::size() const {
+  return length;
+}
+
+}  // namespace amcircuit
@@ -2,18 +2,37 @@
 // Created by Hugo Sadok on 2/6/16.
 //
 
-#include <fstream>
-#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <string>
 
 #include "Netlist.h"
 #include "AMCircuitException.h"
+#include "MappedFile.h"
+#include "Tokenizer.h"
+#include "JobScheduler.h"
+#include "NodeTable.h"
 #include "helpers.h"
 
 namespace amcircuit {
 
-Netlist::Netlist(const std::string& file_name) :
-    file_name(file_name), current_line(1) {
+Netlist::Netlist(const std::string& file_name, int num_workers,
+                 bool use_cache) :
+    file_name(file_name),
+    num_workers(num_workers > 0 ? num_workers : get_num_processors()) {
+  const std::string cache_file_name = file_name + NETLIST_CACHE_EXTENSION;
+  if (use_cache && read_cache(cache_file_name)) {
+    return;
+  }
   process_file();
+  if (use_cache) {
+    try {
+      write_cache(cache_file_name);
+    } catch (const AMCircuitException&) {
+      // Not being able to cache only means the netlist is parsed next time
+    }
+  }
 }
 
 //Netlist::Netlist(const Netlist& other) {
@@ -45,41 +64,359 @@ std::vector<Statement::Handler>& Netlist::get_statements() {
 }
 
 int Netlist::get_number_of_nodes() const {
-  return number_of_nodes;
+  return static_cast<int>(node_names.size()) - 1;
 }
 
-void Netlist::process_file() {
-  std::ifstream data(file_name.c_str());
-  if (!data) throw FileNotFound("Cannot open file \"" + file_name + "\"");
-  std::string line;
-  std::getline(data, title);
-  number_of_nodes = atoi(title.c_str());
-  while (std::getline(data, line)) {
-    handle_line(line);
+const std::vector<std::string>& Netlist::get_node_names() const {
+  return node_names;
+}
+
+const Subcircuit& Netlist::get_subcircuit(const std::string& name) const {
+  std::map<std::string, Subcircuit>::const_iterator it =
+      subcircuits.find(str_upper(name));
+  if (it == subcircuits.end()) {
+    throw IncompleteNetList("Subcircuit \"" + name + "\" not found on netlist");
   }
+  return it->second;
 }
 
-void Netlist::handle_line(const std::string& line) {
+// Instances are replaced in place, so the flattened circuit keeps the netlist
+// order and netlists without subcircuits are left as they are
+std::vector<Element::Handler> Netlist::get_flat_elements(
+    std::vector<std::string>& node_names) const {
+  node_names = this->node_names;
+  std::vector<Element::Handler> flat_elements;
+  flat_elements.reserve(elements.size());
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    flatten(elements[i], flat_elements, node_names, 0);
+  }
+  return flat_elements;
+}
+
+void Netlist::flatten(const Element::Handler& element,
+                      std::vector<Element::Handler>& flat_elements,
+                      std::vector<std::string>& node_names, int depth) const {
+  const SubcircuitInstance* instance =
+      dynamic_cast<const SubcircuitInstance*>(&(*element));
+  if (instance == NULL) {
+    flat_elements.push_back(element);
+    return;
+  }
+  if (depth >= SUBCIRCUIT_MAX_DEPTH) {
+    throw IncompleteNetList("Subcircuit instance \"" + instance->get_name()
+                            + "\" is nested too deep, is it recursive?");
+  }
+  const Subcircuit& subcircuit =
+      get_subcircuit(instance->get_subcircuit_name());
+  if (subcircuit.get_ports().size() != instance->get_nodes().size()) {
+    throw IncompleteNetList(to_str(
+        "Subcircuit instance \"" << instance->get_name() << "\" has "
+        << instance->get_nodes().size() << " nodes, \""
+        << subcircuit.get_name() << "\" has "
+        << subcircuit.get_ports().size() << " ports"));
+  }
+
+  const std::string prefix = instance->get_name() + ".";
+  NodeMap nodes(node_names, prefix, named_nodes);
+  for (unsigned i = 0; i < instance->get_nodes().size(); ++i) {
+    nodes.add(subcircuit.get_ports()[i], instance->get_nodes()[i]);
+  }
+  const std::vector<Element::Handler>& subcircuit_elements =
+      subcircuit.get_elements();
+  for (unsigned i = 0; i < subcircuit_elements.size(); ++i) {
+    flatten(subcircuit_elements[i]->instantiate(prefix, nodes), flat_elements,
+            node_names, depth + 1);
+  }
+}
+
+// End of the line starting at `begin`, the line break is not included
+inline const char* find_line_end(const char* begin, const char* end) {
+  const char* line_end = static_cast<const char*>(
+      memchr(begin, '\n', end - begin));
+  return line_end == NULL ? end : line_end;
+}
+
+// Parses the lines on [begin, end), which must start at the beginning of a
+// line. Stops at the first bad line, keeping where it is and what it raised
+// (jobs must not throw). Statements are kept along with the number of elements
+// before them, as subcircuit definitions may span many chunks and can only be
+// put together once all of them are parsed.
+class ParseChunkJob : public Job {
+ public:
+  ParseChunkJob(const char* begin, const char* end, NodeTable* shared_nodes)
+      : begin(begin), end(end), num_lines(0), bad_line_begin(NULL),
+        bad_line_end(NULL), nodes(shared_nodes) { }
+
+  virtual void run() {
+    const char* position = begin;
+    while (position != end) {
+      const char* line_end = find_line_end(position, end);
+      try {
+        parse_line(position, line_end);
+      } catch (const std::exception& e) {
+        fail(position, line_end, e.what());
+        return;
+      } catch (...) {
+        fail(position, line_end, "Unknown error");
+        return;
+      }
+      ++num_lines;
+      position = line_end == end ? end : line_end + 1;
+    }
+  }
+
+  virtual double get_cost_estimate() const {
+    return end - begin;
+  }
+
+  void fail(const char* line_begin, const char* line_end,
+            const std::string& what) {
+    bad_line_begin = line_begin;
+    bad_line_end = line_end;
+    error = what;
+  }
+
   // The first character defines if the line describes an element, a comment or
   // the simulation parameters
-  try {
-    switch (line[0]) {
+  void parse_line(const char* line_begin, const char* line_end) {
+    switch (line_begin != line_end ? *line_begin : '\0') {
       case '.': { // simulation parameters
-        statements.push_back(Statement::get_statement(line));
+        statements.push_back(std::make_pair(
+            elements.size(), Statement::get_statement(
+                Tokenizer(line_begin, line_end, &nodes))));
         break;
       }
       case '*': { // comment, do nothing
         break;
       }
       default: { // regular elements
-        elements.push_back(Element::get_element(line));
+        elements.push_back(Element::get_element(
+            Tokenizer(line_begin, line_end, &nodes)));
       }
     }
-  } catch (const BadElementString& e) {
-    throw BadFileException(to_str("Line: " << current_line <<
-                                      " \"" << line << "\""));
   }
-  current_line++;
+
+  const char* begin;
+  const char* end;
+  // Lines parsed successfully, if a line is bad it is the one right after
+  int num_lines;
+  const char* bad_line_begin;
+  const char* bad_line_end;
+  std::string error;
+  std::vector<Element::Handler> elements;
+  std::vector<std::pair<size_t, Statement::Handler> > statements;
+  NodeTable nodes;
+};
+
+// The file is mapped and lines are parsed in place, without being copied
+void Netlist::process_file() {
+  const MappedFile file(file_name);
+  const char* const end = file.end();
+  node_names.assign(1, "0");
+  if (file.begin() == end) {
+    title = "";
+    return;
+  }
+  const char* title_end = find_line_end(file.begin(), end);
+  title.assign(file.begin(), title_end);
+  if (title_end != end) {
+    parse_lines(title_end + 1, end);
+  }
+}
+
+// Chunks are parsed independently and then appended in file order. The first
+// bad line on the file is reported, with its line number and error, however
+// many workers there are.
+void Netlist::parse_lines(const char* begin, const char* end) {
+  long num_chunks = (end - begin) / PARALLEL_PARSE_MIN_CHUNK_BYTES;
+  if (num_chunks > num_workers * PARALLEL_PARSE_CHUNKS_PER_WORKER) {
+    num_chunks = num_workers * PARALLEL_PARSE_CHUNKS_PER_WORKER;
+  }
+  if (num_workers == 1 || num_chunks < 1) {
+    num_chunks = 1;
+  }
+
+  NodeTable shared_nodes;
+  std::vector<ParseChunkJob*> chunks;
+  const char* chunk_begin = begin;
+  for (long i = 1; i <= num_chunks && chunk_begin != end; ++i) {
+    const char* chunk_end = end;
+    if (i < num_chunks) {
+      chunk_end = find_line_end(begin + (end - begin) * i / num_chunks, end);
+      chunk_end = chunk_end == end ? end : chunk_end + 1;
+    }
+    if (chunk_end > chunk_begin) {
+      chunks.push_back(new ParseChunkJob(chunk_begin, chunk_end,
+                                         &shared_nodes));
+      chunk_begin = chunk_end;
+    }
+  }
+
+  if (chunks.size() == 1) {
+    chunks[0]->run();
+  } else {
+    JobScheduler scheduler(num_workers);
+    for (unsigned i = 0; i < chunks.size(); ++i) {
+      scheduler.add_job(chunks[i]);
+    }
+    scheduler.run();
+  }
+
+  int current_line = 1;
+  size_t num_elements = 0;
+  for (unsigned i = 0; i < chunks.size(); ++i) {
+    num_elements += chunks[i]->elements.size();
+  }
+  elements.reserve(num_elements);
+  Subcircuit* subcircuit = NULL; // being defined
+  try {
+    for (unsigned i = 0; i < chunks.size(); ++i) {
+      ParseChunkJob& chunk = *chunks[i];
+      if (chunk.bad_line_begin != NULL) {
+        throw BadFileException(to_str(
+            "Line: " << current_line + chunk.num_lines << " \""
+            << std::string(chunk.bad_line_begin, chunk.bad_line_end) << "\": "
+            << chunk.error));
+      }
+      size_t next_element = 0;
+      for (unsigned j = 0; j <= chunk.statements.size(); ++j) {
+        const size_t statements_element = j < chunk.statements.size()
+            ? chunk.statements[j].first : chunk.elements.size();
+        if (subcircuit == NULL) {
+          elements.insert(elements.end(),
+                          chunk.elements.begin() + next_element,
+                          chunk.elements.begin() + statements_element);
+        } else {
+          for (; next_element < statements_element; ++next_element) {
+            subcircuit->add_element(chunk.elements[next_element]);
+          }
+        }
+        next_element = statements_element;
+        if (j < chunk.statements.size()) {
+          subcircuit = add_statement(chunk.statements[j].second, subcircuit);
+        }
+      }
+      current_line += chunk.num_lines;
+      delete chunks[i];
+      chunks[i] = NULL;
+    }
+    if (subcircuit != NULL) {
+      throw BadFileException("Missing .ENDS for subcircuit \""
+                             + subcircuit->get_name() + "\"");
+    }
+  } catch (...) {
+    for (unsigned i = 0; i < chunks.size(); ++i) {
+      delete chunks[i];
+    }
+    throw;
+  }
+  named_nodes = shared_nodes.get_names();
+  renumber_nodes();
+}
+
+// Same as `to_str`, without the cost of a stream for every node
+inline std::string number_name(int number) {
+  char digits[16];
+  char* begin = digits + sizeof(digits);
+  do {
+    *--begin = static_cast<char>('0' + number % 10);
+    number /= 10;
+  } while (number > 0);
+  return std::string(begin, digits + sizeof(digits));
+}
+
+// Nodes actually used are numbered from 1: numbered nodes first, in order, and
+// then named nodes, sorted by name. Elements are only replaced if this changes
+// their nodes, which never happens for netlists numbered from 1 without gaps.
+// Nodes inside subcircuits are local, they are only numbered when flattening.
+void Netlist::renumber_nodes() {
+  std::vector<bool> numbered_used;
+  std::vector<bool> named_used(named_nodes.size(), false);
+  std::vector<int> nodes;
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    nodes.clear();
+    elements[i]->append_nodes(nodes);
+    for (unsigned j = 0; j < nodes.size(); ++j) {
+      const int node = nodes[j];
+      if (node < 0) {
+        named_used[-node - 1] = true;
+      } else {
+        if (node >= static_cast<int>(numbered_used.size())) {
+          numbered_used.resize(std::max<size_t>(node + 1,
+                                                2 * numbered_used.size()));
+        }
+        numbered_used[node] = true;
+      }
+    }
+  }
+
+  std::vector<std::pair<std::string, int> > named;
+  for (unsigned i = 0; i < named_used.size(); ++i) {
+    if (named_used[i]) {
+      named.push_back(std::make_pair(named_nodes[i], -static_cast<int>(i) - 1));
+    }
+  }
+  std::sort(named.begin(), named.end());
+
+  std::vector<int> numbered;
+  for (unsigned node = 1; node < numbered_used.size(); ++node) {
+    if (numbered_used[node]) {
+      numbered.push_back(node);
+    }
+  }
+  node_names.reserve(1 + numbered.size() + named.size());
+  for (unsigned i = 0; i < numbered.size(); ++i) {
+    node_names.push_back(number_name(numbered[i]));
+  }
+  for (unsigned i = 0; i < named.size(); ++i) {
+    node_names.push_back(named[i].first);
+  }
+  if (named.empty() && (numbered.empty() ||
+                        numbered.back() == static_cast<int>(numbered.size()))) {
+    return;
+  }
+
+  std::vector<std::string> ignored_names;
+  NodeMap renumbered(ignored_names, "", named_nodes);
+  for (unsigned i = 0; i < numbered.size(); ++i) {
+    renumbered.add(numbered[i], i + 1);
+  }
+  for (unsigned i = 0; i < named.size(); ++i) {
+    renumbered.add(named[i].second, numbered.size() + i + 1);
+  }
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    elements[i] = elements[i]->instantiate("", renumbered);
+  }
+}
+
+// Subcircuit definitions are opened and closed here, any other statement is
+// kept. Returns the subcircuit being defined after the statement, if any.
+Subcircuit* Netlist::add_statement(const Statement::Handler& statement,
+                                   Subcircuit* subcircuit) {
+  const SubcircuitBegin* begin =
+      dynamic_cast<const SubcircuitBegin*>(&(*statement));
+  if (begin != NULL) {
+    if (subcircuit != NULL) {
+      throw BadFileException("Subcircuit \"" + begin->get_name()
+                             + "\" defined inside \"" + subcircuit->get_name()
+                             + "\"");
+    }
+    const std::string key = str_upper(begin->get_name());
+    if (subcircuits.count(key) > 0) {
+      throw BadFileException("Subcircuit \"" + begin->get_name()
+                             + "\" defined twice");
+    }
+    return &subcircuits.insert(std::make_pair(
+        key, Subcircuit(begin->get_name(), begin->get_ports()))).first->second;
+  }
+  if (dynamic_cast<const SubcircuitEnd*>(&(*statement)) != NULL) {
+    if (subcircuit == NULL) {
+      throw BadFileException(".ENDS without a subcircuit being defined");
+    }
+    return NULL;
+  }
+  statements.push_back(statement);
+  return subcircuit;
 }
 
 }  // namespace amcircuit
@@ -0,0 +1,662 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "Netlist.h"
+#include "AMCircuitException.h"
+#include "MappedFile.h"
+#include "helpers.h"
+
+namespace amcircuit {
+
+// Netlists are cached after being parsed and renumbered, so loading the cache
+// just copies values into the elements. Caches are only read by the version
+// that wrote them and only while the source netlist is left unchanged, so the
+// layout is whatever this machine uses. Besides its stamp, the source is told
+// apart by a hash of its text, as edits may keep both the size and the
+// modification time (which may be as coarse as a second).
+static const char cache_magic[8] = {'A', 'M', 'C', 'N', 'E', 'T', 'C', '\0'};
+static const unsigned cache_version = 2;
+
+struct CacheHeader {
+  char magic[8];
+  unsigned version;
+  unsigned float_size;
+  FileStamp source;
+  unsigned long long source_hash;
+  unsigned long long payload_size;
+};
+
+// 64-bit FNV-1a of the whole file
+inline unsigned long long hash_file(const std::string& file_name) {
+  const MappedFile file(file_name);
+  unsigned long long hash = 14695981039346656037ULL;
+  for (const char* c = file.begin(); c != file.end(); ++c) {
+    hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+class CacheWriter {
+ public:
+  template<typename T>
+  void write(const T& value) {
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+  void write(const std::string& value) {
+    write(static_cast<unsigned>(value.size()));
+    data.append(value);
+  }
+  void write(const std::vector<int>& values) {
+    write(static_cast<unsigned>(values.size()));
+    for (unsigned i = 0; i < values.size(); ++i) {
+      write(values[i]);
+    }
+  }
+  void write(const std::vector<std::string>& values) {
+    write(static_cast<unsigned>(values.size()));
+    for (unsigned i = 0; i < values.size(); ++i) {
+      write(values[i]);
+    }
+  }
+
+  std::string data;
+};
+
+// Every read is checked against the end of the cache, a cache cut short or
+// corrupted throws BadFileException instead of reading past it
+class CacheReader {
+ public:
+  CacheReader(const char* begin, const char* end)
+      : position(begin), end(end) { }
+
+  template<typename T>
+  T read() {
+    T value;
+    memcpy(&value, take(sizeof(value)), sizeof(value));
+    return value;
+  }
+  std::string read_string() {
+    const unsigned size = read<unsigned>();
+    return std::string(take(size), size);
+  }
+  std::vector<int> read_ints() {
+    std::vector<int> values(read_count(sizeof(int)));
+    for (unsigned i = 0; i < values.size(); ++i) {
+      values[i] = read<int>();
+    }
+    return values;
+  }
+  std::vector<std::string> read_strings() {
+    std::vector<std::string> values(read_count(sizeof(unsigned)));
+    for (unsigned i = 0; i < values.size(); ++i) {
+      values[i] = read_string();
+    }
+    return values;
+  }
+  // Number of items to come, each taking at least `item_size` bytes
+  unsigned read_count(size_t item_size) {
+    const unsigned count = read<unsigned>();
+    if (count > static_cast<size_t>(end - position) / item_size) {
+      throw BadFileException("Netlist cache is corrupted");
+    }
+    return count;
+  }
+  bool at_end() const {
+    return position == end;
+  }
+
+ private:
+  const char* position;
+  const char* end;
+
+  const char* take(size_t size) {
+    if (size > static_cast<size_t>(end - position)) {
+      throw BadFileException("Netlist cache is corrupted");
+    }
+    const char* taken = position;
+    position += size;
+    return taken;
+  }
+};
+
+static void write_signal(CacheWriter& cache, const Signal& signal) {
+  if (const Sin* sin = dynamic_cast<const Sin*>(&signal)) {
+    cache.write('S');
+    cache.write(sin->get_offset());
+    cache.write(sin->get_amplitude());
+    cache.write(sin->get_freq_hz());
+    cache.write(sin->get_time_delay());
+    cache.write(sin->get_damping_factor());
+    cache.write(sin->get_phase_deg());
+    cache.write(sin->get_cycles());
+  } else if (const Pulse* pulse = dynamic_cast<const Pulse*>(&signal)) {
+    cache.write('P');
+    cache.write(pulse->get_initial());
+    cache.write(pulse->get_pulsed());
+    cache.write(pulse->get_delay_time());
+    cache.write(pulse->get_rise_time());
+    cache.write(pulse->get_fall_time());
+    cache.write(pulse->get_pulse_width());
+    cache.write(pulse->get_period());
+    cache.write(pulse->get_cycles());
+  } else if (const Pwl* pwl = dynamic_cast<const Pwl*>(&signal)) {
+    // Waveform files are read again, as they may change on their own
+    cache.write('W');
+    cache.write(pwl->get_file_name());
+    if (pwl->get_file_name().empty()) {
+      cache.write(pwl->get_num_of_points());
+      for (unsigned i = 0; i < pwl->get_num_of_points(); ++i) {
+        cache.write(pwl->get_time(i));
+        cache.write(pwl->get_point_value(i));
+      }
+    }
+  } else if (dynamic_cast<const DC*>(&signal) != NULL) {
+    cache.write('D');
+    cache.write(signal.get_value(0));
+  } else {
+    throw BadFileException("Signal cannot be cached");
+  }
+}
+
+static Signal::Handler read_signal(CacheReader& cache) {
+  switch (cache.read<char>()) {
+    case 'S': {
+      const amc_float offset = cache.read<amc_float>();
+      const amc_float amplitude = cache.read<amc_float>();
+      const amc_float freq_hz = cache.read<amc_float>();
+      const amc_float time_delay = cache.read<amc_float>();
+      const amc_float damping_factor = cache.read<amc_float>();
+      const amc_float phase_deg = cache.read<amc_float>();
+      const int cycles = cache.read<int>();
+      return Signal::Handler(new Sin(offset, amplitude, freq_hz, time_delay,
+                                     damping_factor, phase_deg, cycles));
+    }
+    case 'P': {
+      const amc_float initial = cache.read<amc_float>();
+      const amc_float pulsed = cache.read<amc_float>();
+      const amc_float delay_time = cache.read<amc_float>();
+      const amc_float rise_time = cache.read<amc_float>();
+      const amc_float fall_time = cache.read<amc_float>();
+      const amc_float pulse_width = cache.read<amc_float>();
+      const amc_float period = cache.read<amc_float>();
+      const int cycles = cache.read<int>();
+      return Signal::Handler(new Pulse(initial, pulsed, delay_time, rise_time,
+                                       fall_time, pulse_width, period,
+                                       cycles));
+    }
+    case 'W': {
+      const std::string file_name = cache.read_string();
+      if (!file_name.empty()) {
+        return Signal::Handler(new Pwl(file_name));
+      }
+      std::vector<amc_float> points(
+          2 * cache.read_count(2 * sizeof(amc_float)));
+      for (unsigned i = 0; i < points.size(); ++i) {
+        points[i] = cache.read<amc_float>();
+      }
+      try {
+        return Signal::Handler(new Pwl(points));
+      } catch (const BadElementString&) {
+        throw BadFileException("Netlist cache is corrupted");
+      }
+    }
+    case 'D': return Signal::Handler(new DC(cache.read<amc_float>()));
+    default: break;
+  }
+  throw BadFileException("Netlist cache is corrupted");
+}
+
+// The compiled program is kept, its control nodes being those of the element
+static void write_expression(CacheWriter& cache,
+                             const Expression& expression) {
+  cache.write(expression.str());
+  const std::vector<Expression::Control>& controls =
+      expression.get_controls();
+  cache.write(static_cast<unsigned>(controls.size()));
+  for (unsigned i = 0; i < controls.size(); ++i) {
+    cache.write(static_cast<int>(controls[i].type));
+  }
+  const std::vector<amc_float>& constants = expression.get_constants();
+  cache.write(static_cast<unsigned>(constants.size()));
+  for (unsigned i = 0; i < constants.size(); ++i) {
+    cache.write(constants[i]);
+  }
+  const std::vector<Expression::Instruction>& program =
+      expression.get_program();
+  cache.write(static_cast<unsigned>(program.size()));
+  for (unsigned i = 0; i < program.size(); ++i) {
+    cache.write(static_cast<int>(program[i].op));
+    cache.write(program[i].a);
+    cache.write(program[i].b);
+  }
+  cache.write(expression.get_result());
+}
+
+static Expression read_expression(CacheReader& cache,
+                                  const std::vector<int>& nodes) {
+  const std::string text = cache.read_string();
+  std::vector<Expression::Control> controls(cache.read_count(sizeof(int)));
+  if (nodes.size() != 2 * controls.size()) {
+    throw BadFileException("Netlist cache is corrupted");
+  }
+  for (unsigned i = 0; i < controls.size(); ++i) {
+    const int type = cache.read<int>();
+    if (type != Expression::VOLTAGE && type != Expression::CURRENT) {
+      throw BadFileException("Netlist cache is corrupted");
+    }
+    controls[i].type = static_cast<Expression::ControlType>(type);
+    controls[i].node_p = nodes[2 * i];
+    controls[i].node_n = nodes[2 * i + 1];
+  }
+  std::vector<amc_float> constants(cache.read_count(sizeof(amc_float)));
+  for (unsigned i = 0; i < constants.size(); ++i) {
+    constants[i] = cache.read<amc_float>();
+  }
+  std::vector<Expression::Instruction> program(
+      cache.read_count(3 * sizeof(int)));
+  for (unsigned i = 0; i < program.size(); ++i) {
+    program[i].op = static_cast<Expression::Opcode>(cache.read<int>());
+    program[i].a = cache.read<int>();
+    program[i].b = cache.read<int>();
+  }
+  const int result = cache.read<int>();
+  try {
+    return Expression(text, controls, constants, program, result);
+  } catch (const BadElementString&) {
+    throw BadFileException("Netlist cache is corrupted");
+  }
+}
+
+// Elements are tagged with the letter that starts them on a netlist, nodes
+// are written before the other parameters
+static void write_element(CacheWriter& cache, const Element& element) {
+  std::vector<int> nodes;
+  element.append_nodes(nodes);
+  if (dynamic_cast<const Resistor*>(&element) != NULL) {
+    cache.write('R');
+  } else if (dynamic_cast<const NonLinearResistor*>(&element) != NULL) {
+    cache.write('N');
+  } else if (dynamic_cast<const VoltageControlledSwitch*>(&element) != NULL) {
+    cache.write('$');
+  } else if (dynamic_cast<const TransmissionLine*>(&element) != NULL) {
+    cache.write('T');
+  } else if (dynamic_cast<const Diode*>(&element) != NULL) {
+    cache.write('D');
+  } else if (dynamic_cast<const Mosfet*>(&element) != NULL) {
+    cache.write('M');
+  } else if (dynamic_cast<const MutualInductance*>(&element) != NULL) {
+    cache.write('K');
+  } else if (dynamic_cast<const Inductor*>(&element) != NULL) {
+    cache.write('L');
+  } else if (dynamic_cast<const Capacitor*>(&element) != NULL) {
+    cache.write('C');
+  } else if (dynamic_cast<const VoltageControlledVoltageSource*>(&element)) {
+    cache.write('E');
+  } else if (dynamic_cast<const CurrentControlledCurrentSource*>(&element)) {
+    cache.write('F');
+  } else if (dynamic_cast<const VoltageControlledCurrentSource*>(&element)) {
+    cache.write('G');
+  } else if (dynamic_cast<const CurrentControlledVoltageSource*>(&element)) {
+    cache.write('H');
+  } else if (dynamic_cast<const CurrentSource*>(&element) != NULL) {
+    cache.write('I');
+  } else if (dynamic_cast<const VoltageSource*>(&element) != NULL) {
+    cache.write('V');
+  } else if (dynamic_cast<const IdealOpAmp*>(&element) != NULL) {
+    cache.write('O');
+  } else if (dynamic_cast<const BehavioralSource*>(&element) != NULL) {
+    cache.write('B');
+  } else if (dynamic_cast<const SubcircuitInstance*>(&element) != NULL) {
+    cache.write('X');
+  } else {
+    throw BadFileException("Element \"" + element.get_name()
+                           + "\" cannot be cached");
+  }
+  cache.write(element.get_name());
+  cache.write(nodes);
+
+  if (const Resistor* r = dynamic_cast<const Resistor*>(&element)) {
+    cache.write(r->get_R());
+  } else if (const NonLinearResistor* n =
+                 dynamic_cast<const NonLinearResistor*>(&element)) {
+    const std::vector<NonLinearResistor::coordinate>& coordinates =
+        n->get_coordinates();
+    cache.write(static_cast<unsigned>(coordinates.size()));
+    for (unsigned i = 0; i < coordinates.size(); ++i) {
+      cache.write(coordinates[i].first);
+      cache.write(coordinates[i].second);
+    }
+  } else if (const VoltageControlledSwitch* s =
+                 dynamic_cast<const VoltageControlledSwitch*>(&element)) {
+    cache.write(s->get_g_on());
+    cache.write(s->get_g_off());
+    cache.write(s->get_v_ref());
+  } else if (const TransmissionLine* t =
+                 dynamic_cast<const TransmissionLine*>(&element)) {
+    cache.write(t->get_Z0());
+    cache.write(t->get_TD());
+  } else if (const Diode* d = dynamic_cast<const Diode*>(&element)) {
+    cache.write(d->get_Is());
+    cache.write(d->get_n());
+  } else if (const Mosfet* m = dynamic_cast<const Mosfet*>(&element)) {
+    cache.write(m->is_p_channel());
+    cache.write(m->get_K());
+    cache.write(m->get_Vt());
+    cache.write(m->get_lambda());
+  } else if (const MutualInductance* k =
+                 dynamic_cast<const MutualInductance*>(&element)) {
+    cache.write(k->get_inductors());
+    cache.write(k->get_k());
+  } else if (const Inductor* l = dynamic_cast<const Inductor*>(&element)) {
+    cache.write(l->get_L());
+    cache.write(l->get_initial_current());
+  } else if (const Capacitor* c = dynamic_cast<const Capacitor*>(&element)) {
+    cache.write(c->get_C());
+    cache.write(c->get_initial_voltage());
+  } else if (const VoltageControlledVoltageSource* e =
+                 dynamic_cast<const VoltageControlledVoltageSource*>(&element)) {
+    cache.write(e->get_Av());
+  } else if (const CurrentControlledCurrentSource* f =
+                 dynamic_cast<const CurrentControlledCurrentSource*>(&element)) {
+    cache.write(f->get_Ai());
+  } else if (const VoltageControlledCurrentSource* g =
+                 dynamic_cast<const VoltageControlledCurrentSource*>(&element)) {
+    cache.write(g->get_Gm());
+  } else if (const CurrentControlledVoltageSource* h =
+                 dynamic_cast<const CurrentControlledVoltageSource*>(&element)) {
+    cache.write(h->get_Rm());
+  } else if (const ArbitrarySourceElement* source =
+                 dynamic_cast<const ArbitrarySourceElement*>(&element)) {
+    write_signal(cache, *source->get_signal());
+  } else if (const SubcircuitInstance* x =
+                 dynamic_cast<const SubcircuitInstance*>(&element)) {
+    cache.write(x->get_subcircuit_name());
+  } else if (const BehavioralSource* source =
+                 dynamic_cast<const BehavioralSource*>(&element)) {
+    write_expression(cache, source->get_expression());
+    cache.write(source->is_voltage_output());
+  }
+}
+
+static Element::Handler read_element(CacheReader& cache) {
+  const char type = cache.read<char>();
+  const std::string name = cache.read_string();
+  if (type == 'X') {
+    const std::vector<int> nodes = cache.read_ints();
+    return Element::Handler(new SubcircuitInstance(name, nodes,
+                                                   cache.read_string()));
+  }
+  if (type == 'B') {
+    std::vector<int> nodes = cache.read_ints();
+    if (nodes.size() < 2) {
+      throw BadFileException("Netlist cache is corrupted");
+    }
+    const int node_p = nodes[0];
+    const int node_n = nodes[1];
+    nodes.erase(nodes.begin(), nodes.begin() + 2);
+    const Expression expression = read_expression(cache, nodes);
+    return Element::Handler(new BehavioralSource(name, node_p, node_n,
+                                                 cache.read<bool>(),
+                                                 expression));
+  }
+  if (type == 'K') {
+    if (cache.read<unsigned>() != 0) {
+      throw BadFileException("Netlist cache is corrupted");
+    }
+    const std::vector<std::string> inductors = cache.read_strings();
+    return Element::Handler(new MutualInductance(name, inductors,
+                                                 cache.read<amc_float>()));
+  }
+  // Every other element has a few nodes, which are kept off the heap
+  int nodes[4];
+  const unsigned num_nodes = cache.read<unsigned>();
+  unsigned expected_nodes = 2;
+  if (strchr("EFGH$OT", type) != NULL) {
+    expected_nodes = 4;
+  } else if (type == 'M') {
+    expected_nodes = 3;
+  }
+  if (num_nodes != expected_nodes) {
+    throw BadFileException("Netlist cache is corrupted");
+  }
+  for (unsigned i = 0; i < num_nodes; ++i) {
+    nodes[i] = cache.read<int>();
+  }
+
+  switch (type) {
+    case 'R': return Element::Handler(new Resistor(
+        name, nodes[0], nodes[1], cache.read<amc_float>()));
+    case 'N': {
+      std::vector<NonLinearResistor::coordinate> coordinates(
+          cache.read_count(2 * sizeof(amc_float)));
+      for (unsigned i = 0; i < coordinates.size(); ++i) {
+        coordinates[i].first = cache.read<amc_float>();
+        coordinates[i].second = cache.read<amc_float>();
+      }
+      return Element::Handler(new NonLinearResistor(name, nodes[0], nodes[1],
+                                                    coordinates));
+    }
+    case '$': {
+      const amc_float g_on = cache.read<amc_float>();
+      const amc_float g_off = cache.read<amc_float>();
+      const amc_float v_ref = cache.read<amc_float>();
+      return Element::Handler(new VoltageControlledSwitch(
+          name, nodes[0], nodes[1], nodes[2], nodes[3], g_on, g_off, v_ref));
+    }
+    case 'T': {
+      const amc_float Z0 = cache.read<amc_float>();
+      const amc_float TD = cache.read<amc_float>();
+      return Element::Handler(new TransmissionLine(
+          name, nodes[0], nodes[1], nodes[2], nodes[3], Z0, TD));
+    }
+    case 'D': {
+      const amc_float Is = cache.read<amc_float>();
+      const amc_float n = cache.read<amc_float>();
+      return Element::Handler(new Diode(name, nodes[0], nodes[1], Is, n));
+    }
+    case 'M': {
+      const bool p_channel = cache.read<bool>();
+      const amc_float K = cache.read<amc_float>();
+      const amc_float Vt = cache.read<amc_float>();
+      const amc_float lambda = cache.read<amc_float>();
+      return Element::Handler(new Mosfet(name, nodes[0], nodes[1], nodes[2],
+                                         p_channel, K, Vt, lambda));
+    }
+    case 'L': {
+      const amc_float L = cache.read<amc_float>();
+      const amc_float initial_current = cache.read<amc_float>();
+      return Element::Handler(new Inductor(name, nodes[0], nodes[1], L,
+                                           initial_current));
+    }
+    case 'C': {
+      const amc_float C = cache.read<amc_float>();
+      const amc_float initial_voltage = cache.read<amc_float>();
+      return Element::Handler(new Capacitor(name, nodes[0], nodes[1], C,
+                                            initial_voltage));
+    }
+    case 'E': return Element::Handler(new VoltageControlledVoltageSource(
+        name, nodes[0], nodes[1], nodes[2], nodes[3], cache.read<amc_float>()));
+    case 'F': return Element::Handler(new CurrentControlledCurrentSource(
+        name, nodes[0], nodes[1], nodes[2], nodes[3], cache.read<amc_float>()));
+    case 'G': return Element::Handler(new VoltageControlledCurrentSource(
+        name, nodes[0], nodes[1], nodes[2], nodes[3], cache.read<amc_float>()));
+    case 'H': return Element::Handler(new CurrentControlledVoltageSource(
+        name, nodes[0], nodes[1], nodes[2], nodes[3], cache.read<amc_float>()));
+    case 'I': return Element::Handler(new CurrentSource(
+        name, nodes[0], nodes[1], read_signal(cache)));
+    case 'V': return Element::Handler(new VoltageSource(
+        name, nodes[0], nodes[1], read_signal(cache)));
+    case 'O': return Element::Handler(new IdealOpAmp(
+        name, nodes[0], nodes[1], nodes[2], nodes[3]));
+    default: break;
+  }
+  throw BadFileException("Netlist cache is corrupted");
+}
+
+static void write_elements(CacheWriter& cache,
+                           const std::vector<Element::Handler>& elements) {
+  cache.write(static_cast<unsigned>(elements.size()));
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    write_element(cache, *elements[i]);
+  }
+}
+
+// Elements take at least their type, name size and number of nodes
+static std::vector<Element::Handler> read_elements(CacheReader& cache) {
+  std::vector<Element::Handler> elements;
+  const unsigned num_elements = cache.read_count(1 + 2 * sizeof(unsigned));
+  elements.reserve(num_elements);
+  for (unsigned i = 0; i < num_elements; ++i) {
+    elements.push_back(read_element(cache));
+  }
+  return elements;
+}
+
+static void write_statement(CacheWriter& cache, const Statement& statement) {
+  if (const Tran* tran = dynamic_cast<const Tran*>(&statement)) {
+    cache.write(dynamic_cast<const PeriodicSteadyState*>(tran) ? 'P' : 'T');
+    cache.write(tran->get_t_stop_s());
+    cache.write(tran->get_t_step_s());
+    cache.write(tran->get_admo_order());
+    cache.write(tran->get_internal_steps());
+  } else if (const DCSweep* dc = dynamic_cast<const DCSweep*>(&statement)) {
+    cache.write('D');
+    cache.write(dc->get_source_name());
+    cache.write(dc->get_start());
+    cache.write(dc->get_stop());
+    cache.write(dc->get_step());
+  } else {
+    throw BadFileException("Statement cannot be cached");
+  }
+}
+
+static Statement::Handler read_statement(CacheReader& cache) {
+  const char type = cache.read<char>();
+  if (type == 'T' || type == 'P') {
+    const amc_float t_stop_s = cache.read<amc_float>();
+    const amc_float t_step_s = cache.read<amc_float>();
+    const int admo_order = cache.read<int>();
+    const int internal_steps = cache.read<int>();
+    if (type == 'P') {
+      return Statement::Handler(new PeriodicSteadyState(
+          t_stop_s, t_step_s, admo_order, internal_steps));
+    }
+    return Statement::Handler(new Tran(t_stop_s, t_step_s, admo_order,
+                                       internal_steps));
+  }
+  if (type == 'D') {
+    const std::string source_name = cache.read_string();
+    const amc_float start = cache.read<amc_float>();
+    const amc_float stop = cache.read<amc_float>();
+    const amc_float step = cache.read<amc_float>();
+    return Statement::Handler(new DCSweep(source_name, start, stop, step));
+  }
+  throw BadFileException("Netlist cache is corrupted");
+}
+
+void Netlist::write_cache(const std::string& cache_file_name) const {
+  CacheWriter cache;
+  cache.write(title);
+  cache.write(node_names);
+  cache.write(named_nodes);
+  write_elements(cache, elements);
+  cache.write(static_cast<unsigned>(statements.size()));
+  for (unsigned i = 0; i < statements.size(); ++i) {
+    write_statement(cache, *statements[i]);
+  }
+  cache.write(static_cast<unsigned>(subcircuits.size()));
+  for (std::map<std::string, Subcircuit>::const_iterator it =
+           subcircuits.begin(); it != subcircuits.end(); ++it) {
+    cache.write(it->second.get_name());
+    cache.write(it->second.get_ports());
+    write_elements(cache, it->second.get_elements());
+  }
+
+  CacheHeader header = CacheHeader();
+  memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.version = cache_version;
+  header.float_size = sizeof(amc_float);
+  if (!get_file_stamp(file_name, header.source)) {
+    throw FileNotFound(file_name);
+  }
+  header.source_hash = hash_file(file_name);
+  header.payload_size = cache.data.size();
+
+  // Written aside and then renamed, so a cache is never seen half written
+  const std::string temporary_file_name = cache_file_name + ".tmp";
+  {
+    std::ofstream file(temporary_file_name.c_str(), std::ios::binary);
+    if (!file) {
+      throw FileNotFound(temporary_file_name);
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(cache.data.data(), cache.data.size());
+    if (!file) {
+      throw FileNotFound(temporary_file_name);
+    }
+  }
+  if (rename(temporary_file_name.c_str(), cache_file_name.c_str()) != 0) {
+    remove(temporary_file_name.c_str());
+    throw FileNotFound(cache_file_name);
+  }
+}
+
+// False if there is no cache for the netlist as it is now
+bool Netlist::read_cache(const std::string& cache_file_name) {
+  FileStamp source, cache_stamp;
+  if (!get_file_stamp(file_name, source) ||
+      !get_file_stamp(cache_file_name, cache_stamp) ||
+      cache_stamp.size_bytes < static_cast<long long>(sizeof(CacheHeader))) {
+    return false;
+  }
+  const MappedFile file(cache_file_name);
+  CacheHeader header;
+  memcpy(&header, file.begin(), sizeof(header));
+  if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+      header.version != cache_version ||
+      header.float_size != sizeof(amc_float) ||
+      header.source.size_bytes != source.size_bytes ||
+      header.source.modified != source.modified ||
+      header.payload_size != file.size() - sizeof(header) ||
+      header.source_hash != hash_file(file_name)) {
+    return false;
+  }
+
+  CacheReader cache(file.begin() + sizeof(header), file.end());
+  try {
+    title = cache.read_string();
+    node_names = cache.read_strings();
+    named_nodes = cache.read_strings();
+    elements = read_elements(cache);
+    const unsigned num_statements = cache.read_count(1);
+    for (unsigned i = 0; i < num_statements; ++i) {
+      statements.push_back(read_statement(cache));
+    }
+    const unsigned num_subcircuits = cache.read_count(2 * sizeof(unsigned));
+    for (unsigned i = 0; i < num_subcircuits; ++i) {
+      const std::string name = cache.read_string();
+      Subcircuit subcircuit(name, cache.read_ints());
+      const std::vector<Element::Handler> subcircuit_elements =
+          read_elements(cache);
+      for (unsigned j = 0; j < subcircuit_elements.size(); ++j) {
+        subcircuit.add_element(subcircuit_elements[j]);
+      }
+      subcircuits.insert(std::make_pair(str_upper(name), subcircuit));
+    }
+    if (!cache.at_end()) {
+      throw BadFileException("Netlist cache is corrupted");
+    }
+  } catch (const AMCircuitException&) {
+    title.clear();
+    node_names.clear();
+    named_nodes.clear();
+    elements.clear();
+    statements.clear();
+    subcircuits.clear();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace amcircuit
@@ -0,0 +1,97 @@
+#include <cstring>
+
+#include "NodeTable.h"
+
+namespace amcircuit {
+
+static const unsigned initial_num_slots = 64; // must be a power of two
+
+// FNV-1a, names are short and this is cheap enough not to matter
+inline unsigned hash_name(const char* begin, const char* end) {
+  unsigned hash = 2166136261u;
+  for (const char* p = begin; p != end; ++p) {
+    hash = (hash ^ static_cast<unsigned char>(*p)) * 16777619u;
+  }
+  return hash;
+}
+
+NodeTable::NodeTable(NodeTable* shared)
+    : slots(initial_num_slots), num_used(0), shared(shared) {
+  pthread_mutex_init(&lock, NULL);
+}
+
+NodeTable::~NodeTable() {
+  pthread_mutex_destroy(&lock);
+}
+
+int NodeTable::get_id(const char* begin, const char* end) {
+  const unsigned hash = hash_name(begin, end);
+  unsigned index = find_slot(hash, begin, end);
+  if (slots[index].id != 0) {
+    return slots[index].id;
+  }
+
+  int id;
+  if (shared != NULL) {
+    id = shared->get_shared_id(begin, end);
+  } else {
+    names.push_back(std::string(begin, end));
+    id = -static_cast<int>(names.size());
+  }
+  // Kept at most half full, so probing stays short
+  if (2 * (num_used + 1) > slots.size()) {
+    grow();
+    index = find_slot(hash, begin, end);
+  }
+  Slot& slot = slots[index];
+  slot.hash = hash;
+  slot.id = id;
+  slot.name.assign(begin, end);
+  ++num_used;
+  return id;
+}
+
+const std::vector<std::string>& NodeTable::get_names() const {
+  return names;
+}
+
+int NodeTable::get_shared_id(const char* begin, const char* end) {
+  pthread_mutex_lock(&lock);
+  const int id = get_id(begin, end);
+  pthread_mutex_unlock(&lock);
+  return id;
+}
+
+// Slot holding the name or, if it is not there, the empty slot it should go
+unsigned NodeTable::find_slot(unsigned hash, const char* begin,
+                              const char* end) const {
+  const unsigned mask = static_cast<unsigned>(slots.size()) - 1;
+  const size_t length = end - begin;
+  for (unsigned index = hash & mask; ; index = (index + 1) & mask) {
+    const Slot& slot = slots[index];
+    if (slot.id == 0 || (slot.hash == hash && slot.name.size() == length &&
+                         memcmp(slot.name.data(), begin, length) == 0)) {
+      return index;
+    }
+  }
+}
+
+void NodeTable::grow() {
+  std::vector<Slot> old_slots(slots.size() * 2);
+  old_slots.swap(slots);
+  const unsigned mask = static_cast<unsigned>(slots.size()) - 1;
+  for (unsigned i = 0; i < old_slots.size(); ++i) {
+    if (old_slots[i].id == 0) {
+      continue;
+    }
+    unsigned index = old_slots[i].hash & mask;
+    while (slots[index].id != 0) {
+      index = (index + 1) & mask;
+    }
+    slots[index].hash = old_slots[i].hash;
+    slots[index].id = old_slots[i].id;
+    slots[index].name.swap(old_slots[i].name);
+  }
+}
+
+}  // namespace amcircuit
@@ -3,6 +3,7 @@
 //
 
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include "Signal.h"
 #include "helpers.h"
@@ -12,41 +13,38 @@ namespace amcircuit {
 
 Signal::Signal() { }
 
-Signal::Signal(const std::string& params) : line_stream(params) { }
-
 inline Signal::~Signal() { }
 
 Signal::Handler Signal::get_signal(std::string params) {
-  std::stringstream params_stream(params);
+  Tokenizer tokens(params);
+  return get_signal(tokens);
+}
+
+Signal::Handler Signal::get_signal(Tokenizer& params) {
   std::string type;
-  params_stream >> type;
-  getline(params_stream, params);
+  params >> type;
   type = str_upper(type);
   if (type == "DC") return Handler(new DC(params));
   else if (type == "SIN") return Handler(new Sin(params));
   else if (type == "PULSE") return Handler(new Pulse(params));
-  throw BadElementString("Invalid signal \"" + params + "\"");
+  else if (type == "PWL") return Handler(new Pwl(params));
+  throw BadElementString("Invalid signal \"" + params.str() + "\"");
 }
 
-Signal::Handler Signal::get_signal(std::istream& stream) {
-  std::string params;
-  stream >> std::ws;
-  getline(stream, params);
-  return get_signal(params);
+amc_float Signal::get_value_from(amc_float time, unsigned&) const {
+  return get_value(time);
 }
 
 DC::DC(const amc_float value) : value(value) { }
 
-DC::DC(const std::string& params) : Signal(params) {
-  line_stream >> value;
+DC::DC(Tokenizer params) {
+  params >> value;
 }
 
 amc_float DC::get_value(amc_float) const {
   return value;
 }
 
-const amc_float Sin::PI = std::atan(1) * 4;
-
 Sin::Sin(amc_float offset, amc_float amplitude, amc_float freq_hz,
          amc_float time_delay, amc_float damping_factor, amc_float phase_deg,
          int cycles)
@@ -54,8 +52,8 @@ Sin::Sin(amc_float offset, amc_float amplitude, amc_float freq_hz,
       time_delay(time_delay), damping_factor(damping_factor),
       phase_deg(phase_deg), cycles(cycles) { }
 
-Sin::Sin(const std::string& params) : Signal(params) {
-  line_stream >> offset >> amplitude >> freq_hz >> time_delay >>
+Sin::Sin(Tokenizer params) {
+  params >> offset >> amplitude >> freq_hz >> time_delay >>
       damping_factor >> phase_deg >> cycles;
 }
 
@@ -88,18 +86,8 @@ int Sin::get_cycles() const {
 }
 
 amc_float Sin::get_value(amc_float time) const {
-  amc_float t;
-  if (time <= time_delay) {
-    t = 0;
-  } else {
-    t = time - time_delay;
-  }
-  if (t*freq_hz > cycles) {
-    t = 0;
-  }
-
-  return offset + amplitude * std::exp(-damping_factor * t)
-                  * std::sin(2*PI*freq_hz*t+PI/180*phase_deg);
+  return value_at(offset, amplitude, freq_hz, time_delay, damping_factor,
+                  phase_deg / 360, cycles, time);
 }
 
 Pulse::Pulse(amc_float initial, amc_float pulsed, amc_float delay_time,
@@ -109,8 +97,8 @@ Pulse::Pulse(amc_float initial, amc_float pulsed, amc_float delay_time,
       rise_time(rise_time), fall_time(fall_time), pulse_width(pulse_width),
       period(period), cycles(cycles) { }
 
-Pulse::Pulse(const std::string& params) : Signal(params) {
-  line_stream >> initial >> pulsed >> delay_time >> rise_time >> fall_time >>
+Pulse::Pulse(Tokenizer params) {
+  params >> initial >> pulsed >> delay_time >> rise_time >> fall_time >>
       pulse_width >> period >> cycles;
 }
 
@@ -147,33 +135,214 @@ int Pulse::get_cycles() const {
 }
 
 amc_float Pulse::get_value(amc_float time) const {
-  amc_float t;
-  if (time > period*cycles) {
-    t = 0;
-  } else {
-    t = fmod(time, period);
+  return value_at(initial, pulsed, delay_time, rise_time, fall_time,
+                  pulse_width, period, cycles, time);
+}
+
+Pwl::Pwl(const std::vector<amc_float>& points)
+    : loaded_points(points), file(NULL), points(NULL), num_points(0) {
+  use_loaded_points();
+  if (num_points == 0) {
+    throw BadElementString("Invalid PWL signal");
   }
+}
 
-  t -= delay_time;
-  if (t <= 0) {
-    return initial;
+Pwl::Pwl(const std::string& file_name)
+    : file_name(file_name), file(NULL), points(NULL), num_points(0) {
+  load(file_name);
+}
+
+Pwl::Pwl(Tokenizer params) : file(NULL), points(NULL), num_points(0) {
+  std::string first;
+  params >> first;
+  if (str_upper(first.substr(0, 5)) == "FILE=") {
+    file_name = first.substr(5);
+    try {
+      load(file_name);
+    } catch (const AMCircuitException& e) {
+      throw BadElementString("Invalid PWL signal \"" + params.str() + "\": "
+                             + e.what());
+    }
+    return;
   }
 
-  if (t < rise_time) {
-    return t * (pulsed - initial) / rise_time + initial;
+  Tokenizer first_field(first);
+  amc_float value = 0;
+  bool valid = (first_field >> value) && first_field.at_end();
+  loaded_points.push_back(value);
+  while (valid && !params.at_end()) {
+    valid = params >> value;
+    loaded_points.push_back(value);
+  }
+  use_loaded_points();
+  if (!valid || num_points == 0) {
+    throw BadElementString("Invalid PWL signal \"" + params.str() + "\"");
   }
-  t -= rise_time;
+}
+
+Pwl::~Pwl() {
+  delete file;
+}
+
+const std::string& Pwl::get_file_name() const {
+  return file_name;
+}
+
+unsigned Pwl::get_num_of_points() const {
+  return num_points;
+}
+
+amc_float Pwl::get_time(unsigned point) const {
+  return points[2 * point];
+}
 
-  t -= pulse_width;
-  if (t <= 0) {
-    return pulsed;
+amc_float Pwl::get_point_value(unsigned point) const {
+  return points[2 * point + 1];
+}
+
+// Points are only taken if there is a whole number of them and their times
+// never decrease, `num_points` being left at zero otherwise
+void Pwl::use_loaded_points() {
+  if (loaded_points.empty() || loaded_points.size() % 2 != 0) {
+    return;
+  }
+  for (unsigned i = 2; i < loaded_points.size(); i += 2) {
+    if (!(loaded_points[i] >= loaded_points[i - 2])) {
+      return;
+    }
   }
+  points = &loaded_points[0];
+  num_points = loaded_points.size() / 2;
+}
+
+inline bool is_binary_file(const std::string& name) {
+  return name.size() > 4 && str_upper(name.substr(name.size() - 4)) == ".BIN";
+}
 
-  if (t < fall_time) {
-    return t * (initial - pulsed) / fall_time + pulsed;
+inline bool is_separator(char c) {
+  return c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\v' ||
+         c == '\f';
+}
+
+// Binary files are only checked for their size, reading them all would defeat
+// mapping them. Their times are checked segment by segment, when reached.
+void Pwl::load(const std::string& name) {
+  const std::string error = "Invalid waveform file \"" + name + "\"";
+  if (is_binary_file(name)) {
+    file = new MappedFile(name);
+    const size_t point_size = 2 * sizeof(amc_float);
+    const amc_float* mapped_points =
+        reinterpret_cast<const amc_float*>(file->begin());
+    const size_t num_mapped = file->size() / point_size;
+    if (num_mapped == 0 || file->size() % point_size != 0) {
+      delete file;
+      file = NULL;
+      throw BadFileException(error);
+    }
+    points = mapped_points;
+    num_points = num_mapped;
+    return;
   }
 
-  return initial;
+  MappedFile text(name);
+  const char* position = text.begin();
+  const char* end = text.end();
+  while (position != end) {
+    const char* line_end = static_cast<const char*>(
+        memchr(position, '\n', end - position));
+    if (line_end == NULL) {
+      line_end = end;
+    }
+    while (position != line_end && *position != '#') {
+      if (is_separator(*position)) {
+        ++position;
+        continue;
+      }
+      const char* field_end = position;
+      while (field_end != line_end && *field_end != '#' &&
+             !is_separator(*field_end)) {
+        ++field_end;
+      }
+      Tokenizer field(position, field_end);
+      amc_float value;
+      if (!(field >> value) || !field.at_end()) {
+        throw BadFileException(error);
+      }
+      loaded_points.push_back(value);
+      position = field_end;
+    }
+    position = line_end == end ? end : line_end + 1;
+  }
+  use_loaded_points();
+  if (num_points == 0) {
+    throw BadFileException(error);
+  }
+}
+
+// Times decreasing can only be on files used in place, the others are checked
+// when loaded. Both ends of a segment are compared to their neighbours, as a
+// binary search may stop at either side of a point out of order.
+inline void Pwl::check_segment(unsigned segment) const {
+  if ((segment > 0 && get_time(segment) < get_time(segment - 1)) ||
+      (segment + 1 < num_points && get_time(segment + 1) < get_time(segment))) {
+    throw BadFileException(to_str(
+        "Invalid waveform file \"" << file_name << "\": time decreases at "
+        "point " << segment));
+  }
+}
+
+// Last point at or before `time`, the first if there is none
+unsigned Pwl::find_segment(amc_float time) const {
+  unsigned low = 0;
+  unsigned high = num_points;
+  while (high - low > 1) {
+    const unsigned middle = low + (high - low) / 2;
+    if (get_time(middle) <= time) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+amc_float Pwl::interpolate(amc_float time, unsigned segment) const {
+  const amc_float t0 = get_time(segment);
+  if (segment + 1 == num_points || time <= t0) {
+    return get_point_value(segment);
+  }
+  const amc_float t1 = get_time(segment + 1);
+  const amc_float v0 = get_point_value(segment);
+  const amc_float v1 = get_point_value(segment + 1);
+  if (time >= t1) {
+    return v1;
+  }
+  return v0 + (v1 - v0) * (time - t0) / (t1 - t0);
+}
+
+amc_float Pwl::get_value(amc_float time) const {
+  const unsigned segment = find_segment(time);
+  check_segment(segment);
+  return interpolate(time, segment);
+}
+
+amc_float Pwl::get_value_from(amc_float time, unsigned& cursor) const {
+  unsigned segment = cursor < num_points ? cursor : 0;
+  check_segment(segment);
+  int moves = 0;
+  while (segment + 1 < num_points && get_time(segment + 1) <= time &&
+         moves < PWL_CURSOR_MOVES) {
+    ++segment;
+    ++moves;
+    check_segment(segment);
+  }
+  if (time < get_time(segment) ||
+      (segment + 1 < num_points && get_time(segment + 1) <= time)) {
+    segment = find_segment(time);
+    check_segment(segment);
+  }
+  cursor = segment;
+  return interpolate(time, segment);
 }
 
 }  // namespace amcircuit
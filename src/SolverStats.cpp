@@ -0,0 +1,79 @@
+#include "SolverStats.h"
+
+namespace amcircuit {
+
+SolverStats::SolverStats() {
+  reset();
+}
+
+void SolverStats::reset() {
+  assembly_s = 0;
+  factorization_s = 0;
+  newton_s = 0;
+  output_s = 0;
+  num_nr_iterations = 0;
+  num_steps = 0;
+  num_retries = 0;
+  num_switch_events = 0;
+  max_nr_iterations_per_step = 0;
+  nr_iterations_histogram.clear();
+  system_size = 0;
+  num_nonzeros = 0;
+  peak_memory_kb = 0;
+}
+
+void SolverStats::add_step(int nr_iterations) {
+  ++num_steps;
+  if (nr_iterations > max_nr_iterations_per_step) {
+    max_nr_iterations_per_step = nr_iterations;
+  }
+  if (nr_iterations >= static_cast<int>(nr_iterations_histogram.size())) {
+    nr_iterations_histogram.resize(nr_iterations + 1, 0);
+  }
+  ++nr_iterations_histogram[nr_iterations];
+}
+
+double SolverStats::get_mean_nr_iterations_per_step() const {
+  long total = 0;
+  for (size_t i = 0; i < nr_iterations_histogram.size(); ++i) {
+    total += i * nr_iterations_histogram[i];
+  }
+  return num_steps > 0 ? static_cast<double>(total) / num_steps : 0;
+}
+
+void SolverStats::write_summary(std::ostream& ostream) const {
+  ostream << "System size:          " << system_size << " ("
+          << num_nonzeros << " nonzeros)" << std::endl
+          << "Steps:                " << num_steps << std::endl
+          << "NR iterations:        " << num_nr_iterations << " (mean "
+          << get_mean_nr_iterations_per_step() << ", max "
+          << max_nr_iterations_per_step << " per step)" << std::endl
+          << "NR retries:           " << num_retries << std::endl
+          << "Switch events:        " << num_switch_events << std::endl
+          << "Assembly:             " << assembly_s << " s" << std::endl
+          << "Factorization:        " << factorization_s << " s" << std::endl
+          << "Newton-Raphson (all): " << newton_s << " s" << std::endl
+          << "Output:               " << output_s << " s" << std::endl
+          << "Peak memory:          " << peak_memory_kb << " kB" << std::endl;
+}
+
+void SolverStats::write_json(std::ostream& ostream) const {
+  ostream << "{\"system_size\": " << system_size
+          << ", \"nonzeros\": " << num_nonzeros
+          << ", \"steps\": " << num_steps
+          << ", \"nr_iterations\": " << num_nr_iterations
+          << ", \"max_nr_iterations_per_step\": " << max_nr_iterations_per_step
+          << ", \"nr_iterations_histogram\": [";
+  for (size_t i = 0; i < nr_iterations_histogram.size(); ++i) {
+    ostream << (i > 0 ? ", " : "") << nr_iterations_histogram[i];
+  }
+  ostream << "], \"nr_retries\": " << num_retries
+          << ", \"switch_events\": " << num_switch_events
+          << ", \"assembly_s\": " << assembly_s
+          << ", \"factorization_s\": " << factorization_s
+          << ", \"newton_s\": " << newton_s
+          << ", \"output_s\": " << output_s
+          << ", \"peak_memory_kb\": " << peak_memory_kb << "}" << std::endl;
+}
+
+}  // namespace amcircuit
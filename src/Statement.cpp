@@ -3,7 +3,6 @@
 //
 
 #include <string>
-#include <sstream>
 
 #include "Statement.h"
 #include "AMCircuitException.h"
@@ -13,31 +12,33 @@ namespace amcircuit {
 
 Statement::Statement() { }
 
-Statement::Statement(const std::string& params) : line_stream(params) {}
+Statement::~Statement() { }
 
-inline Statement::~Statement() { }
-
-Statement::Handler Statement::get_statement(std::string params) {
-  if (params[0] == '.') {
-    params = params.substr(1, std::string::npos);
-  }
-  std::stringstream params_stream(params);
+Statement::Handler Statement::get_statement(Tokenizer tokens) {
   std::string type;
-  params_stream >> type;
+  tokens >> type;
+  if (!type.empty() && type[0] == '.') {
+    type.erase(0, 1);
+  }
   type = str_upper(type);
-  getline(params_stream, params);
-  if (type == "TRAN") return Statement::Handler(new Tran(params));
-  throw BadElementString("Invalid string \"" + params + "\"");
+  if (type == "TRAN") return Statement::Handler(new Tran(tokens));
+  if (type == "DC") return Statement::Handler(new DCSweep(tokens));
+  if (type == "PSS") {
+    return Statement::Handler(new PeriodicSteadyState(tokens));
+  }
+  if (type == "SUBCKT") return Statement::Handler(new SubcircuitBegin(tokens));
+  if (type == "ENDS") return Statement::Handler(new SubcircuitEnd());
+  throw BadElementString("Invalid string \"" + tokens.str() + "\"");
 }
 
 Tran::Tran(amc_float t_stop_s, amc_float t_step_s, int admo_order,
            int internal_steps) : t_stop_s(t_stop_s), t_step_s(t_step_s),
                                  admo_order(admo_order),
-                                 internal_steps(internal_steps) { }
+                                 internal_steps(internal_steps), uic(true) { }
 
-Tran::Tran(const std::string& params) : Statement(params) {
+Tran::Tran(Tokenizer params) {
   std::string admo_string;
-  line_stream >> t_stop_s >> t_step_s >> admo_string >> internal_steps;
+  params >> t_stop_s >> t_step_s >> admo_string >> internal_steps;
   admo_order = *admo_string.rbegin() - '0';
   uic = true;
 }
@@ -62,4 +63,85 @@ bool Tran::get_uic() const {
   return uic;
 }
 
-} // namespace amcircuit
+PeriodicSteadyState::PeriodicSteadyState(amc_float period_s,
+                                         amc_float t_step_s, int admo_order,
+                                         int internal_steps)
+    : Tran(period_s, t_step_s, admo_order, internal_steps) { }
+
+PeriodicSteadyState::PeriodicSteadyState(Tokenizer params)
+    : Tran(params) { }
+
+amc_float PeriodicSteadyState::get_period_s() const {
+  return get_t_stop_s();
+}
+
+DCSweep::DCSweep(const std::string& source_name, amc_float start,
+                 amc_float stop, amc_float step)
+    : source_name(source_name), start(start), stop(stop), step(step) {
+  validate();
+}
+
+DCSweep::DCSweep(Tokenizer params) {
+  if (!(params >> source_name >> start >> stop >> step)) {
+    throw BadElementString("Invalid DC sweep \"" + params.str() + "\"");
+  }
+  validate();
+}
+
+void DCSweep::validate() const {
+  if (step == 0 || (stop - start) / step < 0) {
+    throw BadElementString(to_str("Invalid DC sweep step: " << step));
+  }
+}
+
+const std::string& DCSweep::get_source_name() const {
+  return source_name;
+}
+
+amc_float DCSweep::get_start() const {
+  return start;
+}
+
+amc_float DCSweep::get_stop() const {
+  return stop;
+}
+
+amc_float DCSweep::get_step() const {
+  return step;
+}
+
+int DCSweep::get_num_points() const {
+  // The small offset keeps the last point when (stop - start)/step is an
+  // integer that can't be exactly represented
+  return static_cast<int>((stop - start) / step + 1e-9) + 1;
+}
+
+SubcircuitBegin::SubcircuitBegin(const std::string& name,
+                                 const std::vector<int>& ports)
+    : name(name), ports(ports) { }
+
+SubcircuitBegin::SubcircuitBegin(Tokenizer params) {
+  if (!(params >> name)) {
+    throw BadElementString("Missing subcircuit name on \"" + params.str()
+                           + "\"");
+  }
+  int port;
+  while (params >> as_node(port)) {
+    ports.push_back(port);
+  }
+  if (!params.at_end()) {
+    throw BadElementString("Invalid port on \"" + params.str() + "\"");
+  }
+}
+
+const std::string& SubcircuitBegin::get_name() const {
+  return name;
+}
+
+const std::vector<int>& SubcircuitBegin::get_ports() const {
+  return ports;
+}
+
+SubcircuitEnd::SubcircuitEnd() { }
+
+}  // namespace amcircuit
@@ -0,0 +1,47 @@
+#include "Subcircuit.h"
+#include "helpers.h"
+
+namespace amcircuit {
+
+Subcircuit::Subcircuit(const std::string& name, const std::vector<int>& ports)
+    : name(name), ports(ports) { }
+
+const std::string& Subcircuit::get_name() const {
+  return name;
+}
+
+const std::vector<int>& Subcircuit::get_ports() const {
+  return ports;
+}
+
+const std::vector<Element::Handler>& Subcircuit::get_elements() const {
+  return elements;
+}
+
+void Subcircuit::add_element(Element::Handler element) {
+  elements.push_back(element);
+}
+
+NodeMap::NodeMap(std::vector<std::string>& node_names,
+                 const std::string& prefix,
+                 const std::vector<std::string>& local_names)
+    : node_names(node_names), prefix(prefix), local_names(local_names) { }
+
+void NodeMap::add(int node, int mapped_node) {
+  mapped_nodes[node] = mapped_node;
+}
+
+int NodeMap::map(int node) {
+  if (node == 0) {
+    return 0;
+  }
+  std::map<int, int>::const_iterator it = mapped_nodes.find(node);
+  if (it != mapped_nodes.end()) {
+    return it->second;
+  }
+  node_names.push_back(prefix + (node < 0 ? local_names[-node - 1]
+                                          : to_str(node)));
+  return mapped_nodes[node] = static_cast<int>(node_names.size()) - 1;
+}
+
+}  // namespace amcircuit
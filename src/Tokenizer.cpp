@@ -0,0 +1,260 @@
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+
+#include "Tokenizer.h"
+#include "NodeTable.h"
+
+namespace amcircuit {
+
+// Powers of ten that are exactly representable as doubles
+static const double exact_powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+  1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const int max_exact_power = 22;
+// Mantissas with up to 15 digits are exactly representable as doubles
+static const int max_exact_digits = 15;
+// Longer numbers are taken as names
+static const long max_node_number = 100000000;
+
+inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' ||
+         c == '\f';
+}
+
+inline bool is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Falls back to strtod, which needs a null terminated copy
+inline amc_float slow_parse(const char* begin, const char* end) {
+  const std::string number(begin, end);
+  return strtod(number.c_str(), NULL);
+}
+
+// Parses the longest prefix of [begin, end) that is a decimal number, returning
+// where it ends (`begin` if there is no number). When the mantissa and the
+// exponent are small enough the result is exact with a single multiplication
+// or division, as both operands are exact; otherwise strtod is used. Either
+// way it is correctly rounded, just as reading from a stream.
+static const char* parse_number(const char* begin, const char* end,
+                                amc_float& value) {
+  const char* p = begin;
+  bool negative = false;
+  if (p != end && (*p == '+' || *p == '-')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  unsigned long long mantissa = 0;
+  int significant_digits = 0;
+  int exponent = 0;
+  bool has_digits = false;
+  for (; p != end && is_digit(*p); ++p) {
+    has_digits = true;
+    if (mantissa != 0 || *p != '0') {
+      if (++significant_digits <= max_exact_digits) {
+        mantissa = mantissa * 10 + (*p - '0');
+      } else {
+        ++exponent;
+      }
+    }
+  }
+  if (p != end && *p == '.') {
+    ++p;
+    for (; p != end && is_digit(*p); ++p) {
+      has_digits = true;
+      if (mantissa != 0 || *p != '0') {
+        if (++significant_digits <= max_exact_digits) {
+          mantissa = mantissa * 10 + (*p - '0');
+          --exponent;
+        }
+      } else {
+        --exponent;
+      }
+    }
+  }
+  if (!has_digits) {
+    return begin;
+  }
+
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool negative_exponent = false;
+    if (q != end && (*q == '+' || *q == '-')) {
+      negative_exponent = *q == '-';
+      ++q;
+    }
+    if (q != end && is_digit(*q)) {
+      int written_exponent = 0;
+      for (; q != end && is_digit(*q); ++q) {
+        if (written_exponent < 100000) {
+          written_exponent = written_exponent * 10 + (*q - '0');
+        }
+      }
+      exponent += negative_exponent ? -written_exponent : written_exponent;
+      p = q;
+    }
+  }
+
+  if (significant_digits > max_exact_digits || exponent > max_exact_power ||
+      exponent < -max_exact_power) {
+    value = slow_parse(begin, p);
+    return p;
+  }
+  value = static_cast<amc_float>(mantissa);
+  if (exponent < 0) {
+    value /= exact_powers_of_ten[-exponent];
+  } else {
+    value *= exact_powers_of_ten[exponent];
+  }
+  if (negative) {
+    value = -value;
+  }
+  return p;
+}
+
+Tokenizer::Tokenizer(const char* begin, const char* end, NodeTable* node_table)
+    : begin(begin), end(end), position(begin), failed(false),
+      node_table(node_table) { }
+
+Tokenizer::Tokenizer(const char* line)
+    : begin(line), end(line + strlen(line)), position(line), failed(false),
+      node_table(NULL) { }
+
+Tokenizer::Tokenizer(const std::string& line)
+    : begin(line.data()), end(line.data() + line.size()), position(begin),
+      failed(false), node_table(NULL) { }
+
+inline void Tokenizer::skip_whitespace() {
+  while (position != end && is_space(*position)) {
+    ++position;
+  }
+}
+
+Tokenizer& Tokenizer::operator>>(amc_float& value) {
+  if (failed) {
+    return *this;
+  }
+  skip_whitespace();
+  const char* number_end = parse_number(position, end, value);
+  failed = number_end == position;
+  position = number_end;
+  return *this;
+}
+
+Tokenizer& Tokenizer::operator>>(int& value) {
+  if (failed) {
+    return *this;
+  }
+  skip_whitespace();
+  const char* p = position;
+  bool negative = false;
+  if (p != end && (*p == '+' || *p == '-')) {
+    negative = *p == '-';
+    ++p;
+  }
+  if (p == end || !is_digit(*p)) {
+    failed = true;
+    return *this;
+  }
+  long number = 0;
+  for (; p != end && is_digit(*p); ++p) {
+    number = number * 10 + (*p - '0');
+  }
+  value = static_cast<int>(negative ? -number : number);
+  position = p;
+  return *this;
+}
+
+Tokenizer& Tokenizer::operator>>(std::string& value) {
+  if (failed) {
+    return *this;
+  }
+  skip_whitespace();
+  const char* token_begin = position;
+  while (position != end && !is_space(*position)) {
+    ++position;
+  }
+  failed = token_begin == position;
+  if (!failed) {
+    value.assign(token_begin, position);
+  }
+  return *this;
+}
+
+// Unlike numbers, the whole field is the node
+Tokenizer& Tokenizer::operator>>(const NodeField& node) {
+  if (failed) {
+    return *this;
+  }
+  skip_whitespace();
+  const char* field_begin = position;
+  bool numbered = true;
+  long number = 0;
+  for (; position != end && !is_space(*position); ++position) {
+    numbered = numbered && is_digit(*position) && number < max_node_number;
+    if (numbered) {
+      number = number * 10 + (*position - '0');
+    }
+  }
+
+  if (field_begin == position) {
+    failed = true;
+  } else if (numbered) {
+    node.id = static_cast<int>(number);
+  } else if (position - field_begin == 3 &&
+             ::toupper(field_begin[0]) == 'G' &&
+             ::toupper(field_begin[1]) == 'N' &&
+             ::toupper(field_begin[2]) == 'D') {
+    node.id = 0;
+  } else if (node_table != NULL) {
+    node.id = node_table->get_id(field_begin, position);
+  } else {
+    failed = true;
+    position = field_begin;
+  }
+  return *this;
+}
+
+Tokenizer::operator bool() const {
+  return !failed;
+}
+
+bool Tokenizer::operator!() const {
+  return failed;
+}
+
+char Tokenizer::first() const {
+  return begin != end ? *begin : '\0';
+}
+
+bool Tokenizer::at_end() {
+  skip_whitespace();
+  return position == end;
+}
+
+std::string Tokenizer::rest() {
+  if (failed) {
+    return std::string();
+  }
+  skip_whitespace();
+  const char* rest_end = end;
+  while (rest_end != position && is_space(rest_end[-1])) {
+    --rest_end;
+  }
+  const std::string value(position, rest_end);
+  position = end;
+  return value;
+}
+
+Tokenizer Tokenizer::part(const char* part_begin, const char* part_end) const {
+  return Tokenizer(part_begin, part_end, node_table);
+}
+
+std::string Tokenizer::str() const {
+  return std::string(begin, end);
+}
+
+}  // namespace amcircuit
@@ -0,0 +1,72 @@
+#include <fstream>
+
+#include "Tracer.h"
+#include "AMCircuitException.h"
+
+namespace amcircuit {
+
+Tracer::Tracer(int capacity)
+    : spans(capacity > 0 ? capacity : 1), next_span(0), num_recorded(0),
+      origin_s(get_wall_time_s()) { }
+
+void Tracer::add_span(const char* name, double start_s, double end_s,
+                      amc_float sim_time, int index) {
+  Span& span = spans[next_span];
+  span.name = name;
+  span.start_s = start_s;
+  span.duration_s = end_s - start_s;
+  span.sim_time = sim_time;
+  span.index = index;
+  next_span = (next_span + 1) % static_cast<int>(spans.size());
+  ++num_recorded;
+}
+
+// Complete ("X") events on a single thread, times in microseconds
+void Tracer::write_chrome_trace(std::ostream& ostream) const {
+  const int num_spans = get_num_spans();
+  const int first = num_spans < static_cast<int>(spans.size()) ? 0 : next_span;
+  const std::ios::fmtflags flags = ostream.flags();
+  const std::streamsize precision = ostream.precision();
+
+  ostream << "{\"traceEvents\": [" << std::endl;
+  for (int i = 0; i < num_spans; ++i) {
+    const Span& span = spans[(first + i) % spans.size()];
+    ostream.setf(std::ios::fixed, std::ios::floatfield);
+    ostream.precision(3);
+    ostream << "{\"name\": \"" << span.name << "\", \"cat\": \"solver\", "
+            << "\"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+            << "\"ts\": " << (span.start_s - origin_s) * 1E6 << ", "
+            << "\"dur\": " << span.duration_s * 1E6 << ", ";
+    ostream.unsetf(std::ios::floatfield);
+    ostream.precision(12);
+    ostream << "\"args\": {\"time\": " << span.sim_time;
+    if (span.index >= 0) {
+      ostream << ", \"index\": " << span.index;
+    }
+    ostream << "}}" << (i + 1 < num_spans ? "," : "") << std::endl;
+  }
+  ostream << "], \"displayTimeUnit\": \"ms\", \"otherData\": "
+          << "{\"dropped_spans\": " << get_num_dropped() << "}}" << std::endl;
+
+  ostream.flags(flags);
+  ostream.precision(precision);
+}
+
+void Tracer::write_to_file(const std::string& file_name) const {
+  std::ofstream file(file_name.c_str());
+  if (!file) {
+    throw FileNotFound(file_name);
+  }
+  write_chrome_trace(file);
+}
+
+int Tracer::get_num_spans() const {
+  return num_recorded < static_cast<long>(spans.size())
+         ? static_cast<int>(num_recorded) : static_cast<int>(spans.size());
+}
+
+long Tracer::get_num_dropped() const {
+  return num_recorded - get_num_spans();
+}
+
+}  // namespace amcircuit
@@ -9,6 +9,17 @@
 #include <cstdarg>
 #include <cstdio>
 
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
 #include "helpers.h"
 #include "AMCircuitException.h"
 
@@ -56,6 +67,135 @@ std::string str_upper(std::string str) {
   }
 #endif
 
+// Exact suffix, longer than it, so both versions of `list_directory` keep the
+// same files
+inline bool has_extension(const std::string& name,
+                          const std::string& extension) {
+  return name.size() > extension.size() &&
+         name.compare(name.size() - extension.size(), extension.size(),
+                      extension) == 0;
+}
+
+#ifdef _WIN32
+double get_wall_time_s() {
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return static_cast<double>(counter.QuadPart) / frequency.QuadPart;
+}
+
+long get_peak_memory_kb() {
+  PROCESS_MEMORY_COUNTERS counters;
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+}
+
+int get_num_processors() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors;
+}
+
+std::vector<std::string> list_directory(const std::string& directory,
+                                        const std::string& extension) {
+  std::vector<std::string> files;
+  WIN32_FIND_DATAA data;
+  // Every directory has at least "." and "..", so finding nothing means it
+  // doesn't exist
+  HANDLE handle = FindFirstFileA((directory + "\\*").c_str(), &data);
+  if (handle == INVALID_HANDLE_VALUE) {
+    throw FileNotFound("Cannot open directory \"" + directory + "\"");
+  }
+  do {
+    const std::string name = data.cFileName;
+    if (has_extension(name, extension)) {
+      files.push_back(directory + "\\" + name);
+    }
+  } while (FindNextFileA(handle, &data));
+  FindClose(handle);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+bool is_directory(const std::string& path) {
+  DWORD attributes = GetFileAttributesA(path.c_str());
+  return attributes != INVALID_FILE_ATTRIBUTES &&
+         (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool get_file_stamp(const std::string& path, FileStamp& stamp) {
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+    return false;
+  }
+  stamp.size_bytes = (static_cast<long long>(data.nFileSizeHigh) << 32)
+                     | data.nFileSizeLow;
+  stamp.modified = (static_cast<long long>(data.ftLastWriteTime.dwHighDateTime)
+                    << 32) | data.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+#else
+double get_wall_time_s() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+long get_peak_memory_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // bytes on OS X
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+int get_num_processors() {
+  long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+  return num_processors > 0 ? static_cast<int>(num_processors) : 1;
+}
+
+std::vector<std::string> list_directory(const std::string& directory,
+                                        const std::string& extension) {
+  std::vector<std::string> files;
+  DIR* dir = opendir(directory.c_str());
+  if (dir == NULL) {
+    throw FileNotFound("Cannot open directory \"" + directory + "\"");
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const std::string name = entry->d_name;
+    if (has_extension(name, extension)) {
+      files.push_back(directory + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+bool is_directory(const std::string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+bool get_file_stamp(const std::string& path, FileStamp& stamp) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    return false;
+  }
+  stamp.size_bytes = info.st_size;
+#ifdef __APPLE__
+  stamp.modified = info.st_mtimespec.tv_sec * 1000000000LL
+                   + info.st_mtimespec.tv_nsec;
+#else
+  stamp.modified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+  return true;
+}
+#endif
+
 void* createArrayUsingDimensionVector(unsigned sizeof_param,
                                       unsigned num_dimension,
                                       unsigned *dimensionVector);
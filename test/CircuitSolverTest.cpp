@@ -3,11 +3,16 @@
 //
 
 #include <string>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
 
 #include "catch.hpp"
 
 #include "CircuitSolver.h"
 #include "helpers.h"
+#include "AMCircuitException.h"
 
 using namespace amcircuit;
 
@@ -45,5 +50,594 @@ SCENARIO("The CircuitSolver must calculate the circuit parameters",
       REQUIRE( ss.str() == expected_output );
     }
   }
+  GIVEN("A simple netlist driven step by step") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/simplesR.net");
+    Netlist nl = Netlist(netlist_file_name);
+    Tran config(1, 1E-3, 2, 1);
+    CircuitSolver cs(&nl, config);
+    cs.initialize();
+    WHEN("advancing the simulation") {
+      cs.advance_to(2E-2);
+      THEN("the unknowns should be available by name") {
+        REQUIRE( cs.get_time() == Approx(2E-2) );
+        REQUIRE( cs.get_unknown(cs.find_unknown("2")) == Approx(5) );
+        REQUIRE( cs.get_unknown(cs.find_unknown("jV0200")) == Approx(-5E-3) );
+        REQUIRE_THROWS( cs.find_unknown("jV0300") );
+      }
+      AND_WHEN("changing a source value and continuing") {
+        cs.set_source_value("V0200", 4);
+        cs.advance_to(3E-2);
+        THEN("the new value should be used") {
+          REQUIRE( cs.get_time() == Approx(3E-2) );
+          REQUIRE( cs.get_unknown(cs.find_unknown("2")) == Approx(2) );
+        }
+      }
+      AND_WHEN("changing a source signal to another type and back") {
+        cs.set_source_signal("V0200", Signal::get_signal("PWL 0 2 1 6"));
+        cs.advance_to(0.5);
+        const amc_float on_pwl = cs.get_unknown(cs.find_unknown("2"));
+        cs.set_source_value("V0200", 4);
+        cs.advance_to(0.6);
+        THEN("each signal should be used in turn") {
+          REQUIRE( on_pwl == Approx(2) );
+          REQUIRE( cs.get_unknown(cs.find_unknown("2")) == Approx(2) );
+        }
+      }
+    }
+    WHEN("writing the results") {
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      THEN("nothing but the header should have been kept") {
+        REQUIRE( ss.str() == "t 1 2 jV0200\n" );
+      }
+    }
+  }
+  GIVEN("Two simulations sharing the same netlist") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/rc.net");
+    const Netlist nl = Netlist(netlist_file_name);
+    Tran config(5E-3, 1E-5, 4, 1);
+    CircuitSolver reference(&nl, config);
+    CircuitSolver cs1(&nl, config);
+    CircuitSolver cs2(&nl, config);
+    reference.initialize();
+    cs1.initialize();
+    cs2.initialize();
+    WHEN("they are advanced alternately") {
+      const int node = reference.find_unknown("2");
+      bool same_results = true;
+      for (int i = 1; i <= 100; ++i) {
+        reference.advance_to(i * 1E-5);
+        cs1.advance_to(i * 1E-5);
+        cs1.advance_to(i * 1E-5);
+        cs2.advance_to(i * 1E-5);
+        same_results = same_results &&
+            cs1.get_unknown(node) == reference.get_unknown(node) &&
+            cs2.get_unknown(node) == reference.get_unknown(node);
+      }
+      THEN("each should behave as if it were alone") {
+        REQUIRE( same_results );
+      }
+      AND_WHEN("a source is changed on one of them") {
+        cs1.set_source_value("V0200", 0);
+        cs1.advance_to(2E-3);
+        cs2.advance_to(2E-3);
+        reference.advance_to(2E-3);
+        THEN("the others should not see the change") {
+          REQUIRE( cs1.get_unknown(node) != reference.get_unknown(node) );
+          REQUIRE( cs2.get_unknown(node) == reference.get_unknown(node) );
+        }
+      }
+    }
+  }
+  GIVEN("A netlist with a periodic steady state analysis") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/rc_pss.net");
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      std::vector<amc_float> capacitor_voltages;
+      amc_float t, v1, v2, j;
+      while (ss >> t >> v1 >> v2 >> j) {
+        capacitor_voltages.push_back(v2);
+      }
+      THEN("a single period should be written") {
+        REQUIRE( capacitor_voltages.size() == 101 );
+        REQUIRE( t == Approx(1e-3) );
+      }
+      AND_THEN("the capacitor should end the period where it started") {
+        REQUIRE( std::abs(capacitor_voltages.front()
+                          - capacitor_voltages.back()) < 1e-4 );
+        REQUIRE( capacitor_voltages.front() == Approx(1.94).epsilon(0.01) );
+      }
+      AND_THEN("it should match a transient run until it settles") {
+        Tran config(20E-3, 1E-5, 2, 1);
+        CircuitSolver transient(&nl, config);
+        transient.initialize();
+        const int node = transient.find_unknown("2");
+        transient.advance_to(19E-3);
+        amc_float max_error = std::abs(transient.get_unknown(node)
+                                       - capacitor_voltages[0]);
+        for (int i = 1; i < 101; ++i) {
+          transient.advance_to(19E-3 + i * 1E-5);
+          const amc_float error = std::abs(transient.get_unknown(node)
+                                           - capacitor_voltages[i]);
+          max_error = std::max(max_error, error);
+        }
+        REQUIRE( max_error < 1E-3 );
+      }
+    }
+  }
+  GIVEN("A periodic steady state analysis with a microampere inductor") {
+    const std::string netlist_file_name = to_str(get_executable_path()
+        << "/../test/support/result_data/rl_pss.net.tab");
+    std::ofstream netlist_file(netlist_file_name.c_str());
+    netlist_file << "2\n"
+                 << "V0100 1 0 SIN 0 1 1E3 0 0 0 100000\n"
+                 << "R0102 1 2 1E6\n"
+                 << "L0200 2 0 1E3\n"
+                 << ".PSS 1E-3 1E-5 ADMO2 1\n";
+    netlist_file.close();
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      std::vector<amc_float> currents;
+      amc_float t, v1, v2, j1, j2;
+      while (ss >> t >> v1 >> v2 >> j1 >> j2) {
+        currents.push_back(j2);
+      }
+      THEN("its current should match a transient run until it settles") {
+        Tran config(20E-3, 1E-5, 2, 1);
+        CircuitSolver transient(&nl, config);
+        transient.initialize();
+        const int line = transient.find_unknown("jL0200");
+        amc_float max_error = 0;
+        amc_float peak = 0;
+        for (int i = 0; i < 101; ++i) {
+          transient.advance_to(19E-3 + i * 1E-5);
+          const amc_float current = transient.get_unknown(line);
+          max_error = std::max(max_error, std::abs(current - currents[i]));
+          peak = std::max(peak, std::abs(current));
+        }
+        REQUIRE( currents.size() == 101 );
+        REQUIRE( max_error < 1E-2 * peak );
+      }
+    }
+  }
+  GIVEN("A periodic steady state analysis with a transmission line") {
+    const std::string netlist_file_name = to_str(get_executable_path()
+        << "/../test/support/result_data/tline_pss.net.tab");
+    std::ofstream netlist_file(netlist_file_name.c_str());
+    netlist_file << "3\n"
+                 << "V0100 1 0 SIN 0 1 1E6\n"
+                 << "R0102 1 2 10\n"
+                 << "T0203 2 0 3 0 50 0.3E-6\n"
+                 << "C0300 3 0 1E-9\n"
+                 << "R0300 3 0 1E3\n"
+                 << ".PSS 1E-6 1E-9 ADMO2 1\n";
+    netlist_file.close();
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      THEN("it should be refused, the line delays not being in the state") {
+        REQUIRE_THROWS_AS(CircuitSolver cs(&nl), const IncompleteNetList&);
+      }
+    }
+  }
+  GIVEN("A netlist with a DC sweep") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/simplesRLC_dc.net");
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      THEN("the swept source should replace the time column") {
+        REQUIRE( header == "V0100 1 2 3 jL0203 jV0100" );
+      }
+      AND_THEN("capacitors should be open and inductors short circuits") {
+        for (int point = 0; point < 3; ++point) {
+          amc_float v, v1, v2, v3, j_l, j_v;
+          ss >> v >> v1 >> v2 >> v3 >> j_l >> j_v;
+          REQUIRE( v == Approx(5.0 * point) );
+          REQUIRE( v1 == Approx(v) );
+          REQUIRE( v2 == Approx(v / 2) );
+          REQUIRE( v3 == Approx(v / 2) );
+          REQUIRE( j_l == Approx(v / 2e3) );
+          REQUIRE( j_v == Approx(-v / 2e3) );
+        }
+      }
+    }
+  }
+  GIVEN("A nonlinear netlist with a DC sweep") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/diode_dc.net");
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      THEN("every point should be on the piecewise linear curve") {
+        amc_float v, v1, v2, j;
+        int points = 0;
+        while (ss >> v >> v1 >> v2 >> j) {
+          ++points;
+          if (v == 0.5) {
+            REQUIRE( v2 == Approx(0.5 / 1600 * 1e3) );
+          }
+        }
+        REQUIRE( points == 17 );
+      }
+    }
+  }
+  GIVEN("An RC circuit integrated with each Adams-Moulton order") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/result_data/rc_order.net.tab");
+    std::ofstream netlist_file(netlist_file_name.c_str());
+    netlist_file << "2\n" << "V1 1 0 DC 1\n" << "R1 1 2 1000\n"
+                 << "C1 2 0 1e-6\n";
+    netlist_file.close();
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("advancing one time constant") {
+      THEN("every order should charge the capacitor alike") {
+        for (int order = 1; order <= 4; ++order) {
+          Tran config(1, 1E-5, order, 1);
+          CircuitSolver cs(&nl, config);
+          cs.initialize();
+          cs.advance_to(1E-3);
+          REQUIRE( cs.get_unknown(cs.find_unknown("2"))
+                   == Approx(1 - std::exp(-1.0)).epsilon(5E-3) );
+        }
+      }
+      AND_THEN("there should be no other order") {
+        Tran config(1, 1E-5, 5, 1);
+        CircuitSolver cs(&nl, config);
+        cs.initialize();
+        REQUIRE_THROWS_AS( cs.advance_to(1E-3),
+                           const InvalidIntegrationMethod& );
+      }
+    }
+  }
+  GIVEN("A diode with a DC sweep") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/junction_dc.net");
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      THEN("every conducting point should be on the exponential curve") {
+        amc_float v, v1, v2, j;
+        int points = 0;
+        while (ss >> v >> v1 >> v2 >> j) {
+          ++points;
+          if (v > 1) {
+            const amc_float current = (v1 - v2) / 1e3;
+            REQUIRE( current == Approx(
+                1e-14 * (std::exp(v2 / THERMAL_VOLTAGE) - 1)).epsilon(1E-3) );
+          } else if (v < 0) {
+            REQUIRE( v2 == Approx(v) );
+          }
+        }
+        REQUIRE( points == 17 );
+      }
+    }
+  }
+  GIVEN("An n channel MOSFET with its gate voltage swept") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/result_data/nmos.net.tab");
+    std::ofstream netlist_file(netlist_file_name.c_str());
+    netlist_file << "3\n" << "V1 1 0 DC 5\n" << "V2 3 0 DC 0\n"
+                 << "R1 1 2 1000\n" << "M1 2 3 0 NMOS 1e-3 1\n"
+                 << ".DC V2 0 5 0.25\n";
+    netlist_file.close();
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      THEN("the drain should follow each region of operation") {
+        amc_float v, v1, v2, v3, j1, j2;
+        int points = 0;
+        while (ss >> v >> v1 >> v2 >> v3 >> j1 >> j2) {
+          ++points;
+          const amc_float overdrive = v - 1;
+          amc_float drain = 5;
+          if (overdrive > 0) {
+            drain = 5 - overdrive * overdrive;
+          }
+          if (overdrive > 0 && drain < overdrive) {
+            const amc_float a = 2 * overdrive + 1;
+            drain = (a - std::sqrt(a * a - 20)) / 2;
+          }
+          REQUIRE( v2 == Approx(drain).epsilon(1E-4) );
+        }
+        REQUIRE( points == 21 );
+      }
+    }
+  }
+  GIVEN("Behavioral sources with a DC sweep") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/behavioral_dc.net");
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      THEN("each source should follow its expression") {
+        amc_float v, v1, v2, v3, v4, v5, j1, j2, j3, j4;
+        int points = 0;
+        while (ss >> v >> v1 >> v2 >> v3 >> v4 >> v5 >> j1 >> j2 >> j3
+                  >> j4) {
+          ++points;
+          REQUIRE( v2 == Approx(v * v - 2 * v) );
+          REQUIRE( v4 == Approx(v2) );
+          const amc_float current = (v - v5) / 1e3;
+          REQUIRE( current == Approx(
+              1e-14 * (std::exp(v5 / THERMAL_VOLTAGE) - 1)).epsilon(1E-3) );
+        }
+        REQUIRE( points == 9 );
+      }
+    }
+  }
+  GIVEN("A transmission line driven through its impedance, open at the end") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/tline.net");
+    Netlist nl = Netlist(netlist_file_name);
+    CircuitSolver cs(&nl);
+    cs.initialize();
+    const int near_end = cs.find_unknown("2");
+    const int far_end = cs.find_unknown("3");
+    WHEN("the step is still travelling") {
+      cs.advance_to(0.5E-6);
+      THEN("the line should take half the step and the end nothing") {
+        REQUIRE( cs.get_unknown(near_end) == Approx(0.5) );
+        REQUIRE( std::abs(cs.get_unknown(far_end)) < 1E-6 );
+      }
+    }
+    WHEN("the step reached the end") {
+      cs.advance_to(1.5E-6);
+      THEN("it should be reflected back, doubling the voltage there") {
+        REQUIRE( cs.get_unknown(near_end) == Approx(0.5) );
+        REQUIRE( cs.get_unknown(far_end) == Approx(1).epsilon(1E-4) );
+      }
+    }
+    WHEN("the reflection came back") {
+      cs.advance_to(2.5E-6);
+      THEN("the whole line should be charged") {
+        REQUIRE( cs.get_unknown(near_end) == Approx(1).epsilon(1E-4) );
+        REQUIRE( cs.get_unknown(far_end) == Approx(1).epsilon(1E-4) );
+      }
+    }
+  }
+  GIVEN("A transmission line on a DC sweep") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/result_data/tline_dc.net.tab");
+    std::ofstream netlist_file(netlist_file_name.c_str());
+    netlist_file << "3\n" << "V1 1 0 DC 0\n" << "R1 1 2 1000\n"
+                 << "T1 2 0 3 0 50 1e-6\n" << "R2 3 0 1000\n"
+                 << ".DC V1 0 2 1\n";
+    netlist_file.close();
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      THEN("the line should be a wire") {
+        REQUIRE( header == "V1 1 2 3 jV1 j1T1 j2T1" );
+        amc_float v, v1, v2, v3, j_v, j1, j2;
+        while (ss >> v >> v1 >> v2 >> v3 >> j_v >> j1 >> j2) {
+          REQUIRE( v2 == Approx(v / 2) );
+          REQUIRE( v3 == Approx(v2) );
+          REQUIRE( j1 == Approx(-j2) );
+        }
+      }
+    }
+  }
+  GIVEN("Coupled inductors and their equivalent T model") {
+    const std::string coupled_file_name = to_str(
+        get_executable_path() << "/../test/support/tesla_k.net");
+    const std::string t_model_file_name = to_str(
+        get_executable_path() << "/../test/support/tesla.net");
+    Netlist coupled_nl = Netlist(coupled_file_name);
+    Netlist t_model_nl = Netlist(t_model_file_name);
+    CircuitSolver coupled(&coupled_nl);
+    CircuitSolver t_model(&t_model_nl);
+    coupled.initialize();
+    t_model.initialize();
+    WHEN("both are simulated") {
+      coupled.advance_to(5E-5);
+      t_model.advance_to(5E-5);
+      THEN("the voltages on the windings should be the same") {
+        const amc_float primary = t_model.get_unknown(
+            t_model.find_unknown("2"));
+        const amc_float secondary = t_model.get_unknown(
+            t_model.find_unknown("3"));
+        REQUIRE( coupled.get_unknown(coupled.find_unknown("2"))
+                 == Approx(primary) );
+        REQUIRE( coupled.get_unknown(coupled.find_unknown("3"))
+                 == Approx(secondary) );
+      }
+    }
+  }
+  GIVEN("A capacitor charged through a switch closing between steps") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/switch_rc.net");
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      THEN("it should charge from the crossings, not the steps after them") {
+        // On while the 1 kHz control is above 0.5 V, charging with tau = 1 ms
+        const amc_float on = 1 / 12E3;
+        const amc_float off = 5 / 12E3;
+        amc_float t, v1, v2, v3, j1, j3;
+        int points = 0;
+        while (ss >> t >> v1 >> v2 >> v3 >> j1 >> j3) {
+          if (t > on + 2E-4) {
+            const amc_float expected = 1 - std::exp(-(std::min(t, off) - on)
+                                                    / 1E-3);
+            REQUIRE( v2 == Approx(expected).epsilon(5E-3) );
+            ++points;
+          }
+        }
+        REQUIRE( points > 20 );
+#ifndef AMCIRCUIT_NO_STATS
+        REQUIRE( cs.get_stats().num_switch_events == 2 );
+#endif
+      }
+    }
+    WHEN("integrating it with the higher orders") {
+      const amc_float on = 1 / 12E3;
+      const amc_float off = 5 / 12E3;
+      amc_float max_error[5] = {0, 0, 0, 0, 0};
+      for (int order = 2; order <= 4; ++order) {
+        Tran config(1E-3, 3E-5, order, 1);
+        CircuitSolver cs(&nl, config);
+        cs.initialize();
+        const int node = cs.find_unknown("2");
+        for (int i = 1; i <= 33; ++i) {
+          cs.advance_to(i * 3E-5);
+          const amc_float t = cs.get_time();
+          const amc_float expected =
+              t > on ? 1 - std::exp(-(std::min(t, off) - on) / 1E-3) : 0;
+          const amc_float error = std::abs(cs.get_unknown(node) - expected);
+          max_error[order] = std::max(max_error[order], error);
+        }
+      }
+      THEN("past values across a cut step should not be taken as even") {
+        REQUIRE( max_error[2] < 1E-3 );
+        REQUIRE( max_error[3] < 1E-3 );
+        REQUIRE( max_error[4] < 1E-3 );
+      }
+    }
+  }
+  GIVEN("A line whose delay ends inside a step cut by a switch") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/switch_tline.net");
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      CircuitSolver cs(&nl);
+      std::stringstream ss;
+      cs.write_to_stream(ss);
+      std::string header;
+      std::getline(ss, header);
+      THEN("the line should be settled once its waves went back and forth") {
+        amc_float t, v1, v2, v3, v4, v5, v6, j1, j2, j3, j4, j5;
+        bool settled = true;
+        while (ss >> t >> v1 >> v2 >> v3 >> v4 >> v5 >> v6 >> j1 >> j2 >> j3
+                  >> j4 >> j5) {
+          settled = settled && (t < 6E-5 || std::abs(v6 - 1) < 1E-3);
+        }
+        REQUIRE( settled );
+      }
+    }
+  }
+  GIVEN("A switch opening and closing its own control") {
+    const std::string netlist_file_name = to_str(get_executable_path()
+        << "/../test/support/result_data/switch_loop.net.tab");
+    std::ofstream netlist_file(netlist_file_name.c_str());
+    netlist_file << "2\n"
+                 << "R0102 1 2 1e3\n"
+                 << "V0100 1 0 DC 1\n"
+                 << "$0200 2 0 2 0 1 1e-9 0.5\n"
+                 << ".TRAN 1E-3 1E-4 ADMO2 1\n";
+    netlist_file.close();
+    Netlist nl = Netlist(netlist_file_name);
+    WHEN("instantiating the CircuitSolver class") {
+      THEN("it should fail rather than take an inconsistent state") {
+        REQUIRE_THROWS_AS(CircuitSolver cs(&nl), const NewtonRaphsonFailed&);
+      }
+    }
+  }
+  GIVEN("A netlist with nested subcircuits") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/rc_subckt.net");
+    const std::string flat_file_name = to_str(
+        get_executable_path() << "/../test/support/result_data/rc_flat.net.tab");
+    std::ofstream flat_file(flat_file_name.c_str());
+    flat_file << "4\n"
+              << "V1 1 0 SIN 0 1 1e3 0 0 0 10\n"
+              << "R1 1 2 100\n" << "C1 2 0 1e-6\n"
+              << "R2 2 4 100\n" << "C2 4 0 1e-6\n"
+              << "R3 4 3 100\n" << "C3 3 0 1e-6\n"
+              << ".TRAN 2E-3 1E-5 ADMO2 1 UIC\n";
+    flat_file.close();
+    WHEN("solving it and the same circuit written flat") {
+      Netlist nl = Netlist(netlist_file_name);
+      Netlist flat_nl = Netlist(flat_file_name);
+      CircuitSolver cs(&nl);
+      CircuitSolver flat_cs(&flat_nl);
+      std::stringstream ss, flat_ss;
+      cs.write_to_stream(ss);
+      flat_cs.write_to_stream(flat_ss);
+      THEN("both solutions should be the same") {
+        REQUIRE( cs.get_system_size() == flat_cs.get_system_size() );
+        const std::string output = ss.str();
+        const std::string flat_output = flat_ss.str();
+        REQUIRE( output.substr(0, output.find('\n')) == "t 1 2 3 X2.2 jV1" );
+        REQUIRE( output.substr(output.find('\n')) ==
+                 flat_output.substr(flat_output.find('\n')) );
+      }
+    }
+  }
+#ifndef AMCIRCUIT_NO_STATS
+  GIVEN("A simulated netlist") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/rc.net");
+    Netlist nl = Netlist(netlist_file_name);
+    CircuitSolver cs(&nl);
+    std::stringstream ss;
+    cs.write_to_stream(ss);
+    WHEN("getting its statistics") {
+      const SolverStats stats = cs.get_stats();
+      THEN("they should describe the simulation") {
+        REQUIRE( stats.system_size == cs.get_system_size() );
+        REQUIRE( stats.num_nonzeros == 6 );
+        REQUIRE( stats.num_nr_iterations == cs.get_num_nr_iterations() );
+        REQUIRE( stats.num_steps > 500 );
+        long iterations = 0;
+        for (size_t i = 0; i < stats.nr_iterations_histogram.size(); ++i) {
+          iterations += i * stats.nr_iterations_histogram[i];
+        }
+        REQUIRE( iterations == stats.num_nr_iterations );
+        REQUIRE( stats.max_nr_iterations_per_step >=
+                 stats.get_mean_nr_iterations_per_step() );
+        REQUIRE( stats.newton_s >= stats.assembly_s + stats.factorization_s );
+        REQUIRE( stats.peak_memory_kb > 0 );
+      }
+      AND_THEN("they should be written as JSON") {
+        std::stringstream json;
+        stats.write_json(json);
+        REQUIRE( json.str().find("\"nr_iterations\": " +
+                                 to_str(stats.num_nr_iterations))
+                 != std::string::npos );
+      }
+    }
+  }
+#endif
 }
 #pragma GCC diagnostic pop
@@ -2,9 +2,13 @@
 // Created by Hugo Sadok on 2/7/16.
 //
 
+#include <algorithm>
+
 #include "catch.hpp"
 
 #include "Elements.h"
+#include "ElementGroups.h"
+#include "DeviceModels.h"
 
 using namespace amcircuit;
 
@@ -168,6 +172,121 @@ SCENARIO("Elements should be created from a string", "[elements]") {
       }
     }
   }
+  GIVEN("A mutual inductance string") {
+    std::string str = "K123 L1 L2 L3 0.9";
+    WHEN("Using the MutualInductance object") {
+      MutualInductance* k = new MutualInductance(str);
+      THEN("The coupled inductors and coefficient should be specified") {
+        REQUIRE(k->get_name() == "K123");
+        REQUIRE(k->get_inductors().size() == 3);
+        REQUIRE(k->get_inductors()[0] == "L1");
+        REQUIRE(k->get_inductors()[2] == "L3");
+        REQUIRE(k->get_k() == 0.9);
+        REQUIRE(k->get_num_of_currents() == 0);
+      }
+      delete k;
+    }
+    WHEN("Using the get_element") {
+      Element::Handler element = Element::get_element(str);
+      THEN("I should have a MutualInductance object") {
+        REQUIRE_NOTHROW(dynamic_cast<MutualInductance&>(*element));
+      }
+      AND_THEN("A single inductor or k above 1 should be refused") {
+        REQUIRE_THROWS(Element::get_element("K124 L1 0.5"));
+        REQUIRE_THROWS(Element::get_element("K125 L1 L2 1.5"));
+      }
+    }
+  }
+  GIVEN("A transmission line string") {
+    std::string str = "T123 4 3 2 1 50 1e-9";
+    WHEN("Using the TransmissionLine object") {
+      TransmissionLine* t = new TransmissionLine(str);
+      THEN("The transmission line parameters should be specified") {
+        REQUIRE(t->get_name() == "T123");
+        REQUIRE(t->get_port1_p() == 4);
+        REQUIRE(t->get_port1_n() == 3);
+        REQUIRE(t->get_port2_p() == 2);
+        REQUIRE(t->get_port2_n() == 1);
+        REQUIRE(t->get_Z0() == 50);
+        REQUIRE(t->get_TD() == 1e-9);
+        REQUIRE(t->get_num_of_currents() == 2);
+      }
+      delete t;
+    }
+    WHEN("Using the get_element") {
+      Element::Handler element = Element::get_element(str);
+      THEN("I should have a TransmissionLine object") {
+        REQUIRE_NOTHROW(dynamic_cast<TransmissionLine&>(*element));
+      }
+      AND_THEN("Lines with no impedance should be refused") {
+        REQUIRE_THROWS(Element::get_element("T124 4 3 2 1 0 1e-9"));
+      }
+    }
+  }
+  GIVEN("A diode string") {
+    std::string str1 = "D123 4 3";
+    std::string str2 = "D124 5 4 1e-12 1.8";
+    WHEN("Using the Diode object") {
+      Diode* d1 = new Diode(str1);
+      Diode* d2 = new Diode(str2);
+      THEN("The diode parameters should be specified") {
+        REQUIRE(d1->get_name() == "D123");
+        REQUIRE(d1->get_node1() == 4);
+        REQUIRE(d1->get_node2() == 3);
+        REQUIRE(d1->get_Is() == 1e-14);
+        REQUIRE(d1->get_n() == 1);
+
+        REQUIRE(d2->get_name() == "D124");
+        REQUIRE(d2->get_Is() == 1e-12);
+        REQUIRE(d2->get_n() == 1.8);
+      }
+      delete d1;
+      delete d2;
+    }
+    WHEN("Using the get_element") {
+      Element::Handler element = Element::get_element(str1);
+      THEN("I should have a Diode object") {
+        REQUIRE_NOTHROW(dynamic_cast<Diode&>(*element));
+      }
+      AND_THEN("A negative saturation current should be refused") {
+        REQUIRE_THROWS(Element::get_element("D125 5 4 -1e-12"));
+      }
+    }
+  }
+  GIVEN("A MOSFET string") {
+    std::string str1 = "M123 4 3 2 NMOS 1e-3 0.7";
+    std::string str2 = "M124 5 4 3 pmos 2e-3 -0.8 0.02";
+    WHEN("Using the Mosfet object") {
+      Mosfet* m1 = new Mosfet(str1);
+      Mosfet* m2 = new Mosfet(str2);
+      THEN("The MOSFET parameters should be specified") {
+        REQUIRE(m1->get_name() == "M123");
+        REQUIRE(m1->get_drain() == 4);
+        REQUIRE(m1->get_gate() == 3);
+        REQUIRE(m1->get_source() == 2);
+        REQUIRE_FALSE(m1->is_p_channel());
+        REQUIRE(m1->get_K() == 1e-3);
+        REQUIRE(m1->get_Vt() == 0.7);
+        REQUIRE(m1->get_lambda() == 0);
+
+        REQUIRE(m2->is_p_channel());
+        REQUIRE(m2->get_K() == 2e-3);
+        REQUIRE(m2->get_Vt() == -0.8);
+        REQUIRE(m2->get_lambda() == 0.02);
+      }
+      delete m1;
+      delete m2;
+    }
+    WHEN("Using the get_element") {
+      Element::Handler element = Element::get_element(str1);
+      THEN("I should have a Mosfet object") {
+        REQUIRE_NOTHROW(dynamic_cast<Mosfet&>(*element));
+      }
+      AND_THEN("Unknown channel types should be refused") {
+        REQUIRE_THROWS(Element::get_element("M125 4 3 2 JFET 1e-3 0.7"));
+      }
+    }
+  }
   GIVEN("A voltage controlled voltage source string") {
     std::string str = "E123 4 3 2 1 20";
     WHEN("Using the VoltageControlledVoltageSource object") {
@@ -268,6 +387,38 @@ SCENARIO("Elements should be created from a string", "[elements]") {
       }
     }
   }
+  GIVEN("A behavioral source string") {
+    std::string str = "B123 4 3 V=V(2, 1) * I(5, 6) + 1";
+    WHEN("Using the BehavioralSource object") {
+      BehavioralSource* b = new BehavioralSource(str);
+      THEN("The source parameters should be specified") {
+        REQUIRE(b->get_name() == "B123");
+        REQUIRE(b->get_node_p() == 4);
+        REQUIRE(b->get_node_n() == 3);
+        REQUIRE(b->is_voltage_output());
+        REQUIRE(b->get_expression().str() == "V(2, 1) * I(5, 6) + 1");
+        REQUIRE(b->get_num_of_currents() == 2);
+      }
+      AND_THEN("The control nodes should follow the output ones") {
+        std::vector<int> nodes;
+        b->append_nodes(nodes);
+        REQUIRE(nodes.size() == 6);
+        REQUIRE(nodes[2] == 2);
+        REQUIRE(nodes[5] == 6);
+      }
+      delete b;
+    }
+    WHEN("Using the get_element") {
+      Element::Handler element = Element::get_element(str);
+      THEN("I should have a BehavioralSource object") {
+        REQUIRE_NOTHROW(dynamic_cast<BehavioralSource&>(*element));
+      }
+      AND_THEN("Sources with no valid expression should be refused") {
+        REQUIRE_THROWS(Element::get_element("B124 4 3 2"));
+        REQUIRE_THROWS(Element::get_element("B125 4 3 I=V(2"));
+      }
+    }
+  }
   GIVEN("A current source string") {
     std::string str = "I123 4 3 DC 12";
     WHEN("Using the CurrentSource object") {
@@ -333,5 +484,204 @@ SCENARIO("Elements should be created from a string", "[elements]") {
       }
     }
   }
+  GIVEN("A subcircuit instance string") {
+    std::string str = "X0400 3 0 7 RCCELL";
+    WHEN("Using the SubcircuitInstance object") {
+      SubcircuitInstance* si = new SubcircuitInstance(str);
+      THEN("The instance parameters should be specified") {
+        REQUIRE(si->get_name() == "X0400");
+        REQUIRE(si->get_nodes().size() == 3);
+        REQUIRE(si->get_nodes()[2] == 7);
+        REQUIRE(si->get_subcircuit_name() == "RCCELL");
+        REQUIRE(si->get_num_of_currents() == 0);
+      }
+      delete si;
+    }
+    WHEN("Using the get_element") {
+      Element::Handler element = Element::get_element(str);
+      THEN("I should have a SubcircuitInstance object") {
+        REQUIRE_NOTHROW(dynamic_cast<SubcircuitInstance&>(*element));
+      }
+    }
+    WHEN("A node is not a number") {
+      THEN("It should raise an exception") {
+        REQUIRE_THROWS(Element::get_element("X0400 3 a RCCELL"));
+      }
+    }
+  }
+}
+
+// Stamps every element on its own, as the solver used to
+inline void stamp_one_by_one(const std::vector<Element::Handler>& elements,
+                             int first_current_line, StampParameters& p) {
+  int next_line = first_current_line;
+  int next_state = 0;
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    const int num_of_currents = elements[i]->get_num_of_currents();
+    p.currents_position = num_of_currents > 0 ? next_line : -1;
+    p.state_position = next_state;
+    next_line += num_of_currents;
+    next_state += elements[i]->get_num_of_states();
+    elements[i]->place_stamp(p);
+  }
+}
+
+inline void prepare_stamp(const std::vector<Element::Handler>& elements,
+                          int system_size, StampParameters& p) {
+  int next_state = 0;
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    elements[i]->initialize_state(p.state + next_state);
+    next_state += elements[i]->get_num_of_states();
+  }
+  for (int i = 0; i < system_size; ++i) {
+    p.x[i] = p.last_nr_trial[i] = 0.1 * i;
+    p.b[i] = 0;
+    for (int j = 0; j < system_size; ++j) {
+      p.A[i][j] = 0;
+    }
+  }
+  p.method_order = 2;
+  p.step_s = 1E-6;
+  p.time = 1E-3;
+}
+
+SCENARIO("Grouped elements should stamp as the elements themselves",
+         "[elements]") {
+  GIVEN("Elements of every group and one without a group") {
+    const char* lines[] = {"V1 1 0 SIN 0 1 1e3 0 0 0 10", "R1 1 2 10",
+                           "C1 2 0 1e-6", "L1 2 3 1e-3", "I1 3 0 DC 0.5",
+                           "E1 3 0 1 2 2", "D1 1 2 1e-12 1.5",
+                           "M1 3 1 2 NMOS 1e-3 -0.5 0.01",
+                           "M2 2 3 1 PMOS 1e-3 0.5", "T1 1 0 3 0 50 1",
+                           "$1 2 3 1 0 1e-2 1e-6 -0.5"};
+    std::vector<Element::Handler> elements;
+    for (int i = 0; i < 11; ++i) {
+      elements.push_back(Element::get_element(lines[i]));
+    }
+    const int num_nodes = 4;
+    const int system_size = num_nodes + 5;
+    const int num_states = Capacitor::NUM_OF_STATES + Inductor::NUM_OF_STATES
+                           + Diode::NUM_OF_STATES + 2 * Mosfet::NUM_OF_STATES
+                           + TransmissionLine::NUM_OF_STATES
+                           + VoltageControlledSwitch::NUM_OF_STATES;
+    StampParameters expected(system_size, num_states);
+    StampParameters grouped(system_size, num_states);
+    prepare_stamp(elements, system_size, expected);
+    prepare_stamp(elements, system_size, grouped);
+    ElementGroups groups(elements, num_nodes);
+
+    WHEN("stamping them over a few steps") {
+      bool same_system = true;
+      for (int step = 0; step < 4; ++step) {
+        for (int i = 0; i < system_size; ++i) {
+          expected.b[i] = grouped.b[i] = 0;
+          for (int j = 0; j < system_size; ++j) {
+            expected.A[i][j] = grouped.A[i][j] = 0;
+          }
+        }
+        stamp_one_by_one(elements, num_nodes, expected);
+        groups.place_stamps(grouped);
+        for (int i = 0; i < system_size; ++i) {
+          same_system = same_system && grouped.b[i] == expected.b[i];
+          for (int j = 0; j < system_size; ++j) {
+            same_system = same_system && grouped.A[i][j] == expected.A[i][j];
+          }
+        }
+        // The next step starts from another solution
+        for (int i = 0; i < system_size; ++i) {
+          expected.x[i] = grouped.x[i] = expected.x[i] + 0.01 * (i + step);
+        }
+        expected.method_order = grouped.method_order = step + 1;
+      }
+      THEN("the systems should be the same") {
+        REQUIRE( same_system );
+      }
+    }
+    WHEN("replacing a source") {
+      const ArbitrarySourceElement& source =
+          dynamic_cast<const ArbitrarySourceElement&>(*elements[4]);
+      elements[4] = source.with_signal(Signal::Handler(new DC(2)));
+      groups.replace(4, elements[4]);
+      stamp_one_by_one(elements, num_nodes, expected);
+      groups.place_stamps(grouped);
+      THEN("the new signal should be stamped") {
+        REQUIRE( grouped.b[3] == expected.b[3] );
+      }
+    }
+  }
+}
+// Segment as found by a binary search over the whole table
+inline int search_segment(const NonLinearResistor& resistor,
+                          amc_float voltage) {
+  const std::vector<NonLinearResistor::coordinate>& coordinates =
+      resistor.get_coordinates();
+  const int k = std::lower_bound(coordinates.begin() + 1, coordinates.end(),
+                                 NonLinearResistor::coordinate(voltage, 0))
+                - coordinates.begin();
+  return std::min(k, static_cast<int>(coordinates.size()) - 1);
+}
+
+SCENARIO("Non linear resistor segments should be found from any hint",
+         "[elements]") {
+  GIVEN("A small table and a large unevenly spaced one") {
+    std::vector<NonLinearResistor::coordinate> small_table, large_table;
+    for (int i = 0; i < 4; ++i) {
+      small_table.push_back(NonLinearResistor::coordinate(i, 2 * i));
+    }
+    for (int i = 0; i < 200; ++i) {
+      large_table.push_back(
+          NonLinearResistor::coordinate(0.01 * i * i - 50, i));
+    }
+    const Element::Handler small_element(
+        new NonLinearResistor("N1", 1, 0, small_table));
+    const Element::Handler large_element(
+        new NonLinearResistor("N2", 1, 0, large_table));
+    const NonLinearResistor& small =
+        dynamic_cast<const NonLinearResistor&>(*small_element);
+    const NonLinearResistor& large =
+        dynamic_cast<const NonLinearResistor&>(*large_element);
+
+    WHEN("searching voltages on and off the tables") {
+      bool same_segment = true;
+      for (amc_float voltage = -60; voltage < 460; voltage += 0.37) {
+        for (int hint = -1; hint <= 201; hint += 7) {
+          same_segment = same_segment &&
+              small.find_segment(voltage, hint) ==
+              search_segment(small, voltage) &&
+              large.find_segment(voltage, hint) ==
+              search_segment(large, voltage);
+        }
+      }
+      for (unsigned i = 0; i < large_table.size(); ++i) {
+        const amc_float voltage = large.get_coordinates()[i].first;
+        same_segment = same_segment &&
+            large.find_segment(voltage, i) == search_segment(large, voltage);
+      }
+      THEN("they should be on the segment a binary search finds") {
+        REQUIRE( same_segment );
+      }
+    }
+  }
+}
+
+SCENARIO("MOSFET gate voltages should be limited as by SPICE's fetlim",
+         "[elements]") {
+  GIVEN("A threshold of 1 V") {
+    const amc_float Vt = 1;
+    THEN("an off gate should stop just past the threshold when turning on") {
+      REQUIRE( limit_gate_voltage(10, 0, Vt) == Approx(1.5) );
+      REQUIRE( limit_gate_voltage(0.8, 0, Vt) == Approx(0.8) );
+      REQUIRE( limit_gate_voltage(-10, 0, Vt) == Approx(-4) );
+    }
+    AND_THEN("a gate close to the threshold should stay around it") {
+      REQUIRE( limit_gate_voltage(10, 2, Vt) == Approx(5) );
+      REQUIRE( limit_gate_voltage(-5, 2, Vt) == Approx(0.5) );
+    }
+    AND_THEN("a fully on gate should move about twice its overdrive") {
+      REQUIRE( limit_gate_voltage(100, 6, Vt) == Approx(18) );
+      REQUIRE( limit_gate_voltage(0, 6, Vt) == Approx(3) );
+      REQUIRE( limit_gate_voltage(10, 6, Vt) == Approx(10) );
+    }
+  }
 }
 #pragma GCC diagnostic pop
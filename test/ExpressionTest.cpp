@@ -0,0 +1,72 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "Expression.h"
+#include "NodeTable.h"
+#include "AMCircuitException.h"
+
+using namespace amcircuit;
+
+// Getting rid of unused-value warning from GCC and clang
+// It's a useful warning but doesn't make sense for test
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-value"
+
+SCENARIO("Expressions should be evaluated along with their derivatives",
+         "[expression]") {
+  GIVEN("An expression over two voltages and time") {
+    NodeTable nodes;
+    const std::string line = "B1 1 0 V=...";
+    Tokenizer tokens(line.data(), line.data() + line.size(), &nodes);
+    Expression e("2 * V(1)^2 - sin(V(in, 3)) / (1 + TIME) + V(1)", tokens);
+    std::vector<amc_float> registers(e.get_num_of_registers());
+    e.initialize_registers(&registers[0]);
+    THEN("each voltage should be a control, used once") {
+      const std::vector<Expression::Control>& controls = e.get_controls();
+      REQUIRE( controls.size() == 2 );
+      REQUIRE( controls[0].type == Expression::VOLTAGE );
+      REQUIRE( controls[0].node_p == 1 );
+      REQUIRE( controls[0].node_n == 0 );
+      REQUIRE( controls[1].node_p == nodes.get_id("in", "in" + 2) );
+      REQUIRE( controls[1].node_n == 3 );
+    }
+    WHEN("evaluating it") {
+      registers[0] = 1.5;
+      registers[1] = 0.3;
+      const amc_float* derivatives;
+      const amc_float value = e.evaluate(2, &registers[0], derivatives);
+      THEN("the value and derivatives should be those of the expression") {
+        const amc_float expected = 2 * 1.5 * 1.5 - std::sin(0.3) / 3 + 1.5;
+        const amc_float d0 = derivatives[0];
+        const amc_float d1 = derivatives[1];
+        REQUIRE( value == Approx(expected) );
+        REQUIRE( d0 == Approx(4 * 1.5 + 1) );
+        REQUIRE( d1 == Approx(-std::cos(0.3) / 3) );
+      }
+    }
+  }
+  GIVEN("An expression with constant parts") {
+    Expression e("I(2, 1) * (2 * pi + exp(0)) - -1", Tokenizer(""));
+    THEN("they should be folded into single constants") {
+      REQUIRE( e.get_controls().size() == 1 );
+      REQUIRE( e.get_controls()[0].type == Expression::CURRENT );
+      REQUIRE( e.get_program().size() == 2 );
+      REQUIRE( e.get_constants().size() == 2 );
+    }
+  }
+  GIVEN("Invalid expressions") {
+    const char* invalid[] = { "V(1", "2 +", "foo(1)", "V(1) V(2)", "V(a)",
+                              "min(1)", "" };
+    THEN("they should be refused") {
+      for (int i = 0; i < 7; ++i) {
+        REQUIRE_THROWS_AS(Expression(invalid[i], Tokenizer("")),
+                          const BadElementString&);
+      }
+    }
+  }
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,77 @@
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "JobScheduler.h"
+#include "BatchRunner.h"
+#include "helpers.h"
+
+using namespace amcircuit;
+
+// Getting rid of unused-value warning from GCC and clang
+// It's a useful warning but doesn't make sense for test
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-value"
+
+class CountingJob : public Job {
+ public:
+  explicit CountingJob(int cost) : cost(cost), times_run(0) { }
+  virtual void run() {
+    volatile double sum = 0;
+    for (int i = 0; i < cost * 1000; ++i) { sum += i; }
+    ++times_run;
+  }
+  virtual double get_cost_estimate() const { return cost; }
+
+  int cost;
+  int times_run;
+};
+
+SCENARIO("Jobs should be run by the work-stealing scheduler",
+         "[job_scheduler]") {
+  GIVEN("Jobs of very different sizes") {
+    std::vector<CountingJob*> jobs;
+    for (int i = 0; i < 50; ++i) {
+      jobs.push_back(new CountingJob(i % 7 == 0 ? 500 : 1));
+    }
+    WHEN("running them on many workers") {
+      JobScheduler scheduler(4);
+      for (unsigned i = 0; i < jobs.size(); ++i) {
+        scheduler.add_job(jobs[i]);
+      }
+      scheduler.run();
+      THEN("each job should run exactly once") {
+        for (unsigned i = 0; i < jobs.size(); ++i) {
+          REQUIRE(jobs[i]->times_run == 1);
+        }
+      }
+    }
+    for (unsigned i = 0; i < jobs.size(); ++i) {
+      delete jobs[i];
+    }
+  }
+}
+
+SCENARIO("Many netlists should be simulated in batch", "[batch]") {
+  GIVEN("The test netlists directory") {
+    const std::string support = to_str(get_executable_path()
+                                       << "/../test/support");
+    std::vector<std::string> inputs;
+    inputs.push_back(support);
+    WHEN("running them in batch") {
+      BatchRunner batch(inputs, support + "/result_data", 2);
+      batch.run();
+      std::stringstream report;
+      batch.write_report(report);
+      THEN("only the netlist without analysis should fail") {
+        REQUIRE(batch.get_num_jobs() ==
+                static_cast<int>(list_directory(support, ".net").size()));
+        REQUIRE(batch.get_num_failed() == 1);
+        REQUIRE(report.str().find("defective_simples.net failed") !=
+                std::string::npos);
+      }
+    }
+  }
+}
+#pragma GCC diagnostic pop
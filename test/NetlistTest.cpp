@@ -4,7 +4,17 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
 #include "Netlist.h"
+#include "AMCircuitException.h"
 #include "helpers.h"
 
 using namespace amcircuit;
@@ -36,3 +46,309 @@ SCENARIO("netlist should be correctly processed from a file", "[netlist]") {
     }
   }
 }
+
+// Large enough to be split among many workers
+inline void write_large_netlist(const std::string& file_name, int bad_line,
+                                const std::string& bad_element = "") {
+  std::ofstream file(file_name.c_str());
+  const int num_sections = 100000;
+  file << num_sections + 1 << std::endl;
+  int line = 1;
+  file << "V1 1 0 SIN 0 1 1e3 0 0 0 1000" << std::endl;
+  for (int i = 1; i <= num_sections; ++i) {
+    if (++line == bad_line && !bad_element.empty()) {
+      file << bad_element << std::endl;
+    } else if (line == bad_line) {
+      file << "Q" << i << " " << i << " 0" << std::endl;
+    } else {
+      file << "R" << i << " " << i << " " << i + 1 << " 10" << std::endl;
+    }
+    file << "* section " << i << std::endl;
+    ++line;
+    file << "C" << i << " " << i + 1 << " 0 1e-6 IC=" << i << std::endl;
+    ++line;
+  }
+  file << ".TRAN 1e-4 1e-5 ADMO2 1 UIC" << std::endl;
+}
+
+SCENARIO("large netlists should be parsed in parallel", "[netlist]") {
+  GIVEN("a large netlist") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/result_data/large.net.tab");
+    write_large_netlist(netlist_file_name, -1);
+
+    WHEN("parsing it serially and in parallel") {
+      Netlist serial = Netlist(netlist_file_name, 1);
+      Netlist parallel = Netlist(netlist_file_name, 4);
+      THEN("both should be the same") {
+        const std::vector<Element::Handler>& a = serial.get_elements();
+        const std::vector<Element::Handler>& b = parallel.get_elements();
+        REQUIRE( a.size() == 200001 );
+        REQUIRE( b.size() == a.size() );
+        bool same_order = true;
+        for (unsigned i = 0; i < a.size(); ++i) {
+          same_order = same_order && a[i]->get_name() == b[i]->get_name();
+        }
+        REQUIRE( same_order );
+        REQUIRE( parallel.get_statements().size() == 1 );
+        REQUIRE( parallel.get_number_of_nodes() ==
+                 serial.get_number_of_nodes() );
+      }
+    }
+  }
+  GIVEN("a large netlist with a bad line near its end") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/result_data/bad.net.tab");
+    write_large_netlist(netlist_file_name, 290000);
+
+    WHEN("parsing it in parallel") {
+      THEN("the bad line should be reported") {
+        std::string error;
+        try {
+          Netlist(netlist_file_name, 4);
+        } catch (const BadFileException& e) {
+          error = e.what();
+        }
+        REQUIRE( error.find("Line: 290000 \"Q") == 0 );
+      }
+    }
+  }
+  GIVEN("a large netlist with a source reading a missing file") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/result_data/bad.net.tab");
+    write_large_netlist(netlist_file_name, 150002,
+                        "V2 5 0 PWL FILE=/nonexistent/source.csv");
+
+    WHEN("parsing it serially and in parallel") {
+      std::string serial_error, parallel_error;
+      try {
+        Netlist(netlist_file_name, 1);
+      } catch (const BadFileException& e) {
+        serial_error = e.what();
+      }
+      try {
+        Netlist(netlist_file_name, 4);
+      } catch (const BadFileException& e) {
+        parallel_error = e.what();
+      }
+      THEN("both should report the same line and error") {
+        REQUIRE( parallel_error.find("Line: 150002 \"V2 5 0 PWL") == 0 );
+        REQUIRE( parallel_error.find("source.csv\": ") != std::string::npos );
+        REQUIRE( parallel_error == serial_error );
+      }
+    }
+  }
+}
+
+inline void write_netlist(const std::string& file_name,
+                          const std::string& contents) {
+  std::ofstream file(file_name.c_str());
+  file << contents;
+}
+
+SCENARIO("subcircuits should be defined once and flattened", "[netlist]") {
+  GIVEN("a netlist with nested subcircuits") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/rc_subckt.net");
+    Netlist nl = Netlist(netlist_file_name);
+
+    WHEN("parsing it") {
+      THEN("definitions should be kept apart from the elements") {
+        REQUIRE( nl.get_elements().size() == 3 );
+        REQUIRE( nl.get_statements().size() == 1 );
+        REQUIRE( nl.get_subcircuit("rccell").get_elements().size() == 2 );
+        REQUIRE( nl.get_subcircuit("STAGE").get_ports().size() == 2 );
+        REQUIRE_THROWS_AS( nl.get_subcircuit("FILTER"),
+                           const IncompleteNetList& );
+      }
+    }
+    WHEN("flattening it") {
+      std::vector<std::string> node_names;
+      const std::vector<Element::Handler> elements =
+          nl.get_flat_elements(node_names);
+      THEN("instances should be replaced by their elements") {
+        REQUIRE( elements.size() == 7 );
+        REQUIRE( elements[1]->get_name() == "X1.R1" );
+        REQUIRE( elements[5]->get_name() == "X2.X2.R1" );
+      }
+      AND_THEN("internal nodes should be numbered after the netlist ones") {
+        REQUIRE( node_names.size() == 5 );
+        REQUIRE( node_names[4] == "X2.2" );
+        const Resistor& resistor = dynamic_cast<const Resistor&>(*elements[3]);
+        REQUIRE( resistor.get_node1() == 2 );
+        REQUIRE( resistor.get_node2() == 4 );
+      }
+    }
+  }
+  GIVEN("bad subcircuit definitions") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/result_data/subckt.net.tab");
+
+    WHEN("a definition is not closed") {
+      write_netlist(netlist_file_name, "2\n.SUBCKT CELL 1 2\nR1 1 2 1\n");
+      THEN("parsing should fail") {
+        REQUIRE_THROWS_AS( Netlist(netlist_file_name, 1),
+                           const BadFileException& );
+      }
+    }
+    WHEN("a definition instantiates itself") {
+      write_netlist(netlist_file_name, "2\n.SUBCKT CELL 1 2\nX1 1 2 CELL\n"
+                                       ".ENDS\nX1 1 2 CELL\n");
+      Netlist nl = Netlist(netlist_file_name);
+      std::vector<std::string> node_names;
+      THEN("flattening should fail") {
+        REQUIRE_THROWS_AS( nl.get_flat_elements(node_names),
+                           const IncompleteNetList& );
+      }
+    }
+    WHEN("an instance has the wrong number of nodes") {
+      write_netlist(netlist_file_name, "2\n.SUBCKT CELL 1 2\nR1 1 2 1\n"
+                                       ".ENDS\nX1 1 CELL\n");
+      Netlist nl = Netlist(netlist_file_name);
+      std::vector<std::string> node_names;
+      THEN("flattening should fail") {
+        REQUIRE_THROWS_AS( nl.get_flat_elements(node_names),
+                           const IncompleteNetList& );
+      }
+    }
+  }
+}
+
+SCENARIO("nodes should be numbered again from 1", "[netlist]") {
+  const std::string netlist_file_name = to_str(
+      get_executable_path() << "/../test/support/result_data/nodes.net.tab");
+
+  GIVEN("a netlist with named nodes and gaps on the numbered ones") {
+    write_netlist(netlist_file_name, "title\n"
+                                     "V1 in GND DC 1\n"
+                                     "R1 in 70 1\n"
+                                     "R2 70 out 1\n"
+                                     "R3 out 0 1\n"
+                                     "R4 5 0 1\n");
+    Netlist nl = Netlist(netlist_file_name);
+
+    THEN("only the nodes used should be kept") {
+      REQUIRE( nl.get_number_of_nodes() == 4 );
+    }
+    AND_THEN("numbered nodes should come first, then named ones") {
+      const std::vector<std::string>& names = nl.get_node_names();
+      REQUIRE( names.size() == 5 );
+      REQUIRE( names[0] == "0" );
+      REQUIRE( names[1] == "5" );
+      REQUIRE( names[2] == "70" );
+      REQUIRE( names[3] == "in" );
+      REQUIRE( names[4] == "out" );
+      const Resistor& resistor = dynamic_cast<const Resistor&>(
+          *nl.get_elements()[2]);
+      REQUIRE( resistor.get_node1() == 2 );
+      REQUIRE( resistor.get_node2() == 4 );
+    }
+  }
+  GIVEN("a subcircuit with named ports and internal nodes") {
+    write_netlist(netlist_file_name, "title\n"
+                                     ".SUBCKT CELL in out\n"
+                                     "R1 in mid 1\n"
+                                     "R2 mid out 1\n"
+                                     ".ENDS\n"
+                                     "X1 a b CELL\n");
+    Netlist nl = Netlist(netlist_file_name);
+    std::vector<std::string> node_names;
+    const std::vector<Element::Handler> elements =
+        nl.get_flat_elements(node_names);
+
+    THEN("internal nodes should be named after the instance") {
+      REQUIRE( node_names.size() == 4 );
+      REQUIRE( node_names[3] == "X1.mid" );
+      const Resistor& resistor = dynamic_cast<const Resistor&>(*elements[1]);
+      REQUIRE( resistor.get_node1() == 3 );
+      REQUIRE( resistor.get_node2() == 2 );
+    }
+  }
+}
+
+#ifndef _WIN32
+// Modification time as kept on `FileStamp`, in nanoseconds
+inline void set_file_modified(const std::string& file_name,
+                              long long modified) {
+  struct timespec times[2];
+  times[0].tv_sec = times[1].tv_sec = modified / 1000000000LL;
+  times[0].tv_nsec = times[1].tv_nsec = modified % 1000000000LL;
+  utimensat(AT_FDCWD, file_name.c_str(), times, 0);
+}
+#endif
+
+SCENARIO("parsed netlists should be cached", "[netlist]") {
+  const std::string netlist_file_name = to_str(
+      get_executable_path() << "/../test/support/result_data/cached.net.tab");
+  const std::string cache_file_name = netlist_file_name
+                                      + NETLIST_CACHE_EXTENSION;
+  remove(cache_file_name.c_str());
+
+  GIVEN("a netlist loaded with the cache enabled") {
+    write_netlist(netlist_file_name, "title\n"
+                                     ".SUBCKT CELL in out\n"
+                                     "R1 in mid 1\n"
+                                     "C1 mid out 1e-6\n"
+                                     ".ENDS\n"
+                                     "V1 a GND SIN 0 1 1e3 0 0 0 10\n"
+                                     "X1 a b CELL\n"
+                                     "E1 b 0 a 7 2\n"
+                                     "M1 b a 0 PMOS 1e-3 -1 0.02\n"
+                                     ".TRAN 1E-3 1E-5 BE 1\n");
+    Netlist parsed(netlist_file_name, 1, true);
+
+    THEN("the cache should be written") {
+      REQUIRE( std::ifstream(cache_file_name.c_str()).good() );
+    }
+    WHEN("loading it again") {
+      Netlist cached(netlist_file_name, 1, true);
+      THEN("it should be the same netlist") {
+        REQUIRE( cached.get_node_names() == parsed.get_node_names() );
+        REQUIRE( cached.get_elements().size() == 4 );
+        REQUIRE( cached.get_statements().size() == 1 );
+        REQUIRE( cached.get_subcircuit("CELL").get_elements().size() == 2 );
+        const VoltageControlledVoltageSource& source =
+            dynamic_cast<const VoltageControlledVoltageSource&>(
+                *cached.get_elements()[2]);
+        REQUIRE( source.get_Av() == 2 );
+        REQUIRE( source.get_node_ctrl_p() == 2 );
+        REQUIRE( source.get_node_ctrl_n() == 1 );
+        const Mosfet& mosfet = dynamic_cast<const Mosfet&>(
+            *cached.get_elements()[3]);
+        REQUIRE( mosfet.get_drain() == 3 );
+        REQUIRE( mosfet.get_gate() == 2 );
+        REQUIRE( mosfet.is_p_channel() );
+        REQUIRE( mosfet.get_lambda() == 0.02 );
+      }
+    }
+    WHEN("the netlist changes") {
+      write_netlist(netlist_file_name, "title\nR1 1 0 1\n");
+      Netlist changed(netlist_file_name, 1, true);
+      THEN("it should be parsed again") {
+        REQUIRE( changed.get_elements().size() == 1 );
+      }
+    }
+#ifndef _WIN32
+    WHEN("the netlist changes keeping its size and modification time") {
+      FileStamp stamp;
+      get_file_stamp(netlist_file_name, stamp);
+      std::string text = "title\nR1 1 0 1\n";
+      text.resize(stamp.size_bytes, '*');
+      write_netlist(netlist_file_name, text);
+      set_file_modified(netlist_file_name, stamp.modified);
+      Netlist changed(netlist_file_name, 1, true);
+      THEN("it should be parsed again") {
+        REQUIRE( changed.get_elements().size() == 1 );
+      }
+    }
+#endif
+    WHEN("the cache is corrupted") {
+      write_netlist(cache_file_name, "AMCNETC");
+      Netlist reparsed(netlist_file_name, 1, true);
+      THEN("it should be parsed again") {
+        REQUIRE( reparsed.get_elements().size() == 4 );
+      }
+    }
+  }
+  remove(cache_file_name.c_str());
+}
@@ -2,11 +2,16 @@
 // Created by Hugo Sadok on 2/10/16.
 //
 
+#include <cmath>
 #include <string>
+#include <fstream>
+#include <vector>
 
 #include "catch.hpp"
 
 #include "Signal.h"
+#include "helpers.h"
+#include "AMCircuitException.h"
 
 using namespace amcircuit;
 
@@ -54,6 +59,18 @@ SCENARIO("Sinals should be created from a string", "[signal]") {
       }
       delete sin;
     }
+    WHEN("Finding its value over a few cycles") {
+      Signal::Handler sin = Signal::get_signal("SIN 1 2 50 0.01 3 45 10");
+      THEN("it should be that of the damped sine") {
+        for (int i = 0; i < 100; ++i) {
+          const amc_float t = 0.01 + i * 1.7e-3;
+          const amc_float expected = 1 + 2 * std::exp(-3 * (t - 0.01)) *
+              std::sin(2 * M_PI * (50 * (t - 0.01) + 0.125));
+          const amc_float value = sin->get_value(t);
+          REQUIRE( value == Approx(expected) );
+        }
+      }
+    }
     WHEN("Using the get_signal") {
       Signal::Handler element = Signal::get_signal(str);
       THEN("I should have a Sin object") {
@@ -93,4 +110,88 @@ SCENARIO("Sinals should be created from a string", "[signal]") {
     }
   }
 }
+SCENARIO("Piecewise linear signals should follow their points", "[signal]") {
+  GIVEN("A PWL signal string") {
+    Signal::Handler signal = Signal::get_signal("PWL 0 0 1 2 1 4 3 0");
+    const Pwl& pwl = dynamic_cast<const Pwl&>(*signal);
+    THEN("it should interpolate between the points and hold the last ones") {
+      REQUIRE( pwl.get_num_of_points() == 4 );
+      REQUIRE( pwl.get_value(-1) == 0 );
+      REQUIRE( pwl.get_value(0.5) == 1 );
+      REQUIRE( pwl.get_value(1) == 4 );
+      REQUIRE( pwl.get_value(2) == 2 );
+      REQUIRE( pwl.get_value(5) == 0 );
+    }
+    AND_THEN("a cursor should give the same values, even going back") {
+      const amc_float times[] = {0, 0.25, 0.5, 1, 1.5, 2.5, 0.75, 4, 0.1};
+      unsigned cursor = 0;
+      bool same = true;
+      for (int i = 0; i < 9; ++i) {
+        same = same && pwl.get_value_from(times[i], cursor)
+                       == pwl.get_value(times[i]);
+      }
+      REQUIRE( same );
+    }
+    AND_THEN("signals with points out of order should be refused") {
+      REQUIRE_THROWS(Signal::get_signal("PWL 0 0 1"));
+      REQUIRE_THROWS(Signal::get_signal("PWL 0 0 2 1 1 0"));
+    }
+  }
+  GIVEN("The same waveform on a text and on a binary file") {
+    const std::string text_name = to_str(
+        get_executable_path() << "/../test/support/result_data/wave.csv.tab");
+    const std::string binary_name = to_str(
+        get_executable_path() << "/../test/support/result_data/wave.bin");
+    std::vector<amc_float> points;
+    std::ofstream text_file(text_name.c_str());
+    text_file.precision(17);
+    text_file << "# time, value\n";
+    for (int i = 0; i < 1000; ++i) {
+      points.push_back(i * 1e-3);
+      points.push_back(i % 7 - 3);
+      text_file << points[2 * i] << ", " << points[2 * i + 1] << "\n";
+    }
+    text_file.close();
+    std::ofstream binary_file(binary_name.c_str(), std::ios::binary);
+    binary_file.write(reinterpret_cast<const char*>(&points[0]),
+                      points.size() * sizeof(amc_float));
+    binary_file.close();
+    WHEN("loading both") {
+      Signal::Handler text = Signal::get_signal("PWL FILE=" + text_name);
+      Signal::Handler binary = Signal::get_signal("PWL FILE=" + binary_name);
+      THEN("they should have the same values") {
+        unsigned cursor = 0;
+        bool same = true;
+        for (int i = 0; i < 2000; ++i) {
+          const amc_float time = i * 0.5e-3 + 1e-4;
+          same = same && text->get_value(time) == binary->get_value(time)
+                 && binary->get_value_from(time, cursor)
+                    == binary->get_value(time);
+        }
+        REQUIRE( same );
+        REQUIRE( binary->get_value(0.4995) == Approx(-0.5) );
+      }
+    }
+    WHEN("the binary file has a time going back") {
+      points[2 * 900] = 0;
+      std::ofstream bad_file(binary_name.c_str(), std::ios::binary);
+      bad_file.write(reinterpret_cast<const char*>(&points[0]),
+                     points.size() * sizeof(amc_float));
+      bad_file.close();
+      Signal::Handler binary = Signal::get_signal("PWL FILE=" + binary_name);
+      THEN("it should only be refused once that segment is reached") {
+        unsigned cursor = 0;
+        REQUIRE( binary->get_value_from(0.5, cursor) == Approx(0) );
+        REQUIRE_THROWS( binary->get_value_from(0.8995, cursor) );
+        REQUIRE_THROWS( binary->get_value(0.9) );
+      }
+    }
+    WHEN("the file does not exist") {
+      THEN("it should be refused as a bad element") {
+        REQUIRE_THROWS_AS(Signal::get_signal("PWL FILE=/nonexistent.bin"),
+                          const BadElementString&);
+      }
+    }
+  }
+}
 #pragma GCC diagnostic pop
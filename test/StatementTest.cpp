@@ -47,5 +47,66 @@ SCENARIO("Statements should be created from a string", "[statement]") {
       }
     }
   }
+  GIVEN("A periodic steady state statement string") {
+    std::string str = ".PSS 1E-3 5E-6 ADMO3 2";
+    WHEN("Using the get_statement") {
+      Statement::Handler element = Statement::get_statement(str);
+      THEN("I should have a PeriodicSteadyState object") {
+        REQUIRE_NOTHROW(dynamic_cast<PeriodicSteadyState&>(*element));
+      }
+      AND_THEN("The integration parameters should be specified") {
+        PeriodicSteadyState& pss = dynamic_cast<PeriodicSteadyState&>(*element);
+        REQUIRE(pss.get_period_s() == 1E-3);
+        REQUIRE(pss.get_t_step_s() == 5E-6);
+        REQUIRE(pss.get_admo_order() == 3);
+        REQUIRE(pss.get_internal_steps() == 2);
+      }
+    }
+  }
+  GIVEN("A DC sweep statement string") {
+    std::string str = ".DC V0200 -1 10 0.5";
+    WHEN("using the DCSweep object") {
+      std::string params(str);
+      params.erase(0,3);
+      DCSweep* dc(new DCSweep(params));
+      THEN("The sweep parameters should be specified") {
+        REQUIRE(dc->get_source_name() == "V0200");
+        REQUIRE(dc->get_start() == -1.0);
+        REQUIRE(dc->get_stop() == 10.0);
+        REQUIRE(dc->get_step() == 0.5);
+        REQUIRE(dc->get_num_points() == 23);
+      }
+      delete dc;
+    }
+    WHEN("Using the get_statement") {
+      Statement::Handler element = Statement::get_statement(str);
+      THEN("I should have a DCSweep object") {
+        REQUIRE_NOTHROW(dynamic_cast<DCSweep&>(*element));
+      }
+    }
+    WHEN("the step doesn't lead from start to stop") {
+      THEN("an exception should be raised") {
+        REQUIRE_THROWS(Statement::get_statement(".DC V0200 10 -1 0.5"));
+        REQUIRE_THROWS(Statement::get_statement(".DC V0200 -1 10 0"));
+      }
+    }
+  }
+  GIVEN("A subcircuit definition string") {
+    std::string str = ".SUBCKT RCCELL 1 2";
+    WHEN("using the get_statement") {
+      Statement::Handler statement = Statement::get_statement(str);
+      const SubcircuitBegin& begin =
+          dynamic_cast<const SubcircuitBegin&>(*statement);
+      THEN("the subcircuit name and ports should be specified") {
+        REQUIRE(begin.get_name() == "RCCELL");
+        REQUIRE(begin.get_ports().size() == 2);
+        REQUIRE(begin.get_ports()[1] == 2);
+      }
+      AND_THEN("it should be closed by an ENDS statement") {
+        REQUIRE_NOTHROW(dynamic_cast<const SubcircuitEnd&>(
+            *Statement::get_statement(".ENDS")));
+      }
+    }
+  }
 }
 #pragma GCC diagnostic pop
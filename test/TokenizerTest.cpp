@@ -0,0 +1,120 @@
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+
+#include "catch.hpp"
+
+#include "Tokenizer.h"
+#include "NodeTable.h"
+#include "helpers.h"
+
+using namespace amcircuit;
+
+// Getting rid of unused-value warning from GCC and clang
+// It's a useful warning but doesn't make sense for test
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-value"
+
+SCENARIO("The tokenizer should read values just as streams do",
+         "[tokenizer]") {
+  GIVEN("Numbers written in many ways") {
+    const char* numbers[] = {
+      "0", "-0", "1", "+2.5", "-1e-6", "1E+3", ".5", "5.", "10000E-5",
+      "5.86082142617873E-1", "3.64397675632798E-1", "1.41517470742647",
+      "0.000000000000000000000001", "123456789012345678901234", "1e-300",
+      "4.9e-324", "1.7976931348623157e308", "0.1", "0.3", "2.2250738585072014e-308"
+    };
+    const int num_numbers = sizeof(numbers) / sizeof(numbers[0]);
+    WHEN("reading them") {
+      THEN("they should be exactly as read by a stream") {
+        for (int i = 0; i < num_numbers; ++i) {
+          amc_float expected, value;
+          std::stringstream(numbers[i]) >> expected;
+          Tokenizer tokens(numbers[i]);
+          REQUIRE( (tokens >> value) );
+          REQUIRE( value == expected );
+          REQUIRE( tokens.at_end() );
+        }
+      }
+    }
+  }
+  GIVEN("A line with mixed values") {
+    std::string line = "R0100  1\t0 1.5k IC=3";
+    Tokenizer tokens(line);
+    WHEN("reading them") {
+      std::string name, rest;
+      int node1, node2;
+      amc_float value;
+      tokens >> name >> node1 >> node2 >> value >> rest;
+      THEN("only the numeric prefix of a number should be consumed") {
+        REQUIRE( tokens );
+        REQUIRE( name == "R0100" );
+        REQUIRE( node1 == 1 );
+        REQUIRE( node2 == 0 );
+        REQUIRE( value == 1.5 );
+        REQUIRE( rest == "k" );
+        REQUIRE( tokens.first() == 'R' );
+        REQUIRE( tokens.str() == line );
+      }
+      AND_THEN("failures should be sticky") {
+        REQUIRE( !(tokens >> node1) );
+        REQUIRE( !(tokens >> name) );
+      }
+    }
+  }
+  GIVEN("A line with numbered and named nodes") {
+    std::string line = "E1 out gnd 12 out";
+    NodeTable shared;
+    NodeTable cache(&shared);
+    Tokenizer tokens(line.data(), line.data() + line.size(), &cache);
+    WHEN("reading them") {
+      std::string name;
+      int out, ground, numbered, out_again;
+      tokens >> name >> as_node(out) >> as_node(ground) >> as_node(numbered)
+             >> as_node(out_again);
+      THEN("names should get negative ids from the shared table") {
+        REQUIRE( tokens );
+        REQUIRE( out == -1 );
+        REQUIRE( out_again == out );
+        REQUIRE( ground == 0 );
+        REQUIRE( numbered == 12 );
+        REQUIRE( shared.get_names().size() == 1 );
+        REQUIRE( shared.get_names()[0] == "out" );
+      }
+    }
+    WHEN("reading them without a node table") {
+      Tokenizer plain_tokens(line);
+      std::string name;
+      int node;
+      plain_tokens >> name >> as_node(node);
+      THEN("names should not be accepted") {
+        REQUIRE( !plain_tokens );
+      }
+    }
+  }
+  GIVEN("More names than a table starts with") {
+    NodeTable table;
+    std::vector<std::string> names;
+    for (int i = 0; i < 1000; ++i) {
+      names.push_back(to_str("n" << i));
+    }
+    WHEN("adding all of them twice") {
+      bool same_ids = true;
+      for (int i = 0; i < 1000; ++i) {
+        const char* name = names[i].c_str();
+        table.get_id(name, name + names[i].size());
+      }
+      for (int i = 0; i < 1000; ++i) {
+        const char* name = names[i].c_str();
+        same_ids = same_ids &&
+            table.get_id(name, name + names[i].size()) == -(i + 1);
+      }
+      THEN("every name should keep its id") {
+        REQUIRE( same_ids );
+        REQUIRE( table.get_names().size() == 1000 );
+      }
+    }
+  }
+}
+#pragma GCC diagnostic pop
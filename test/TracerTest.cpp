@@ -0,0 +1,72 @@
+#include <string>
+#include <sstream>
+
+#include "catch.hpp"
+
+#include "Tracer.h"
+#include "CircuitSolver.h"
+#include "helpers.h"
+
+using namespace amcircuit;
+
+// Getting rid of unused-value warning from GCC and clang
+// It's a useful warning but doesn't make sense for test
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-value"
+
+inline int count_occurrences(const std::string& str, const std::string& sub) {
+  int count = 0;
+  for (std::string::size_type pos = str.find(sub); pos != std::string::npos;
+       pos = str.find(sub, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+SCENARIO("The tracer should keep the last spans", "[tracer]") {
+  GIVEN("A tracer smaller than the spans added to it") {
+    Tracer tracer(3);
+    const char* names[] = {"a", "b", "c", "d", "e"};
+    for (int i = 0; i < 5; ++i) {
+      tracer.add_span(names[i], i, i + 0.5, i * 1E-3, i);
+    }
+    WHEN("writing the trace") {
+      std::stringstream ss;
+      tracer.write_chrome_trace(ss);
+      const std::string trace = ss.str();
+      THEN("only the newest spans should be written, oldest first") {
+        REQUIRE( tracer.get_num_spans() == 3 );
+        REQUIRE( tracer.get_num_dropped() == 2 );
+        REQUIRE( trace.find("\"name\": \"b\"") == std::string::npos );
+        REQUIRE( trace.find("\"name\": \"c\"") < trace.find("\"name\": \"e\"") );
+        REQUIRE( count_occurrences(trace, "\"ph\": \"X\"") == 3 );
+      }
+    }
+  }
+#ifndef AMCIRCUIT_NO_STATS
+  GIVEN("A circuit simulated with a tracer") {
+    const std::string netlist_file_name = to_str(
+        get_executable_path() << "/../test/support/rc.net");
+    Netlist nl = Netlist(netlist_file_name);
+    Tracer tracer;
+    CircuitSolver cs(&nl, &tracer);
+    std::stringstream output;
+    cs.write_to_stream(output);
+    WHEN("writing the trace") {
+      std::stringstream ss;
+      tracer.write_chrome_trace(ss);
+      const std::string trace = ss.str();
+      THEN("every Newton-Raphson iteration should be on it") {
+        REQUIRE( count_occurrences(trace, "\"newton_iteration\"")
+                 == cs.get_num_nr_iterations() );
+        REQUIRE( count_occurrences(trace, "\"factorization\"")
+                 == cs.get_num_nr_iterations() );
+        REQUIRE( count_occurrences(trace, "\"step\"")
+                 == cs.get_stats().num_steps );
+        REQUIRE( count_occurrences(trace, "\"output\"") == 1 );
+      }
+    }
+  }
+#endif
+}
+#pragma GCC diagnostic pop